@@ -1,21 +1,216 @@
 #include "animation.h"
 #include "event.h"
 
-static CVReturn animation_frame_callback(CVDisplayLinkRef display_link, const CVTimeStamp* now, const CVTimeStamp* output_time, CVOptionFlags flags, CVOptionFlags* flags_out, void* context) {
-  struct event event = { (void*)output_time->hostTime, ANIMATOR_REFRESH };
+// Returns whether a frame was produced
+static bool animator_tick(struct animator* animator, uint64_t output_time) {
+  // The budget is slightly relaxed to absorb the frame source jitter
+  if (animator->max_fps > 0
+      && output_time - animator->last_frame
+         < animator->frame_budget - animator->frame_budget / 8) {
+    return false;
+  }
+
+  animator->last_frame = output_time;
+  struct event event = { (void*)output_time, ANIMATOR_REFRESH };
   event_post(&event);
+  return true;
+}
+
+// Runs on the main queue, the flag is cleared by the frame itself
+static void display_link_frame(void* context) {
+  struct animator* animator = context;
+  if (!animator_tick(animator, animator->frame_time))
+    animator_frame_done(animator);
+}
+
+static CVReturn animation_frame_callback(CVDisplayLinkRef display_link, const CVTimeStamp* now, const CVTimeStamp* output_time, CVOptionFlags flags, CVOptionFlags* flags_out, void* context) {
+  struct animator* animator = context;
+
+  // The frame is produced on the main queue. A tick that arrives while the
+  // previous frame is still queued or being produced, or whose output time
+  // has already passed, would only add to the backlog.
+  if (__sync_lock_test_and_set(&animator->frame_in_flight, 1)) {
+    __sync_fetch_and_add(&animator->frames_dropped, 1);
+    return kCVReturnSuccess;
+  }
+
+  if (CVGetCurrentHostTime() > output_time->hostTime) {
+    __sync_fetch_and_add(&animator->frames_dropped, 1);
+    animator_frame_done(animator);
+    return kCVReturnSuccess;
+  }
+
+  animator->frame_time = output_time->hostTime;
+  dispatch_async_f(dispatch_get_main_queue(), animator, display_link_frame);
   return kCVReturnSuccess;
 }
 
+static bool display_link_start(struct animator* animator) {
+  if (CVDisplayLinkCreateWithActiveCGDisplays(&animator->display_link)
+      != kCVReturnSuccess) {
+    animator->display_link = NULL;
+    return false;
+  }
+
+  CVDisplayLinkSetOutputCallback(animator->display_link,
+                                 animation_frame_callback,
+                                 animator                 );
+
+  animator->clock = CVGetHostClockFrequency();
+  CVDisplayLinkStart(animator->display_link);
+  return true;
+}
+
+static void display_link_stop(struct animator* animator) {
+  if (animator->display_link) {
+    CVDisplayLinkStop(animator->display_link);
+    CVDisplayLinkRelease(animator->display_link);
+    animator->display_link = NULL;
+  }
+}
+
+static bool display_link_is_running(struct animator* animator) {
+  return animator->display_link != NULL;
+}
+
+static uint64_t display_link_get_time(struct animator* animator) {
+  return CVGetCurrentHostTime();
+}
+
+// The virtual clock advances by exactly one period per tick, independent of
+// when the timer actually fires, such that animation trajectories only
+// depend on the configured rate.
+static uint64_t virtual_clock_step(struct animator* animator) {
+  animator->virtual_time += NSEC_PER_SEC / animator->virtual_rate;
+  return animator->virtual_time;
+}
+
+static void virtual_clock_handler(void* context) {
+  struct animator* animator = context;
+  animator_tick(animator, virtual_clock_step(animator));
+}
+
+static bool virtual_clock_start(struct animator* animator) {
+  uint64_t period = NSEC_PER_SEC / animator->virtual_rate;
+  animator->virtual_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER,
+                                                   0,
+                                                   0,
+                                                   dispatch_get_main_queue());
+  if (!animator->virtual_timer) return false;
+
+  dispatch_source_set_timer(animator->virtual_timer,
+                            dispatch_time(DISPATCH_TIME_NOW, period),
+                            period,
+                            0                                       );
+
+  dispatch_set_context(animator->virtual_timer, animator);
+  dispatch_source_set_event_handler_f(animator->virtual_timer,
+                                      virtual_clock_handler   );
+
+  animator->clock = NSEC_PER_SEC;
+  dispatch_resume(animator->virtual_timer);
+  return true;
+}
+
+static void virtual_clock_stop(struct animator* animator) {
+  if (animator->virtual_timer) {
+    dispatch_source_cancel(animator->virtual_timer);
+    dispatch_release(animator->virtual_timer);
+    animator->virtual_timer = NULL;
+  }
+}
+
+static bool virtual_clock_is_running(struct animator* animator) {
+  return animator->virtual_timer != NULL;
+}
+
+static uint64_t virtual_clock_get_time(struct animator* animator) {
+  return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+// The stepped clock has no timer at all, its frames are only produced by
+// animator_advance, such that a driver can replay animations headlessly.
+static bool stepped_clock_start(struct animator* animator) {
+  animator->clock = NSEC_PER_SEC;
+  animator->stepping = true;
+  return true;
+}
+
+static void stepped_clock_stop(struct animator* animator) {
+  animator->stepping = false;
+  animator->trace = NULL;
+}
+
+static bool stepped_clock_is_running(struct animator* animator) {
+  return animator->stepping;
+}
+
+static struct frame_source g_display_link_source = {
+  display_link_start,
+  display_link_stop,
+  display_link_is_running,
+  display_link_get_time
+};
+
+static struct frame_source g_virtual_clock_source = {
+  virtual_clock_start,
+  virtual_clock_stop,
+  virtual_clock_is_running,
+  virtual_clock_get_time
+};
+
+static struct frame_source g_stepped_clock_source = {
+  stepped_clock_start,
+  stepped_clock_stop,
+  stepped_clock_is_running,
+  virtual_clock_get_time
+};
+
+// Animations are carved from slabs and recycled through a free list, such
+// that adding and removing animations does not hit the allocator.
+#define ANIMATION_SLAB_SIZE 64
+
+struct animation_slab {
+  struct animation animations[ANIMATION_SLAB_SIZE];
+  struct animation_slab* next;
+};
+
+static struct animation_slab* g_animation_slabs = NULL;
+static struct animation* g_animation_free_list = NULL;
+
 struct animation* animation_create() {
-  struct animation* animation = malloc(sizeof(struct animation));
+  if (!g_animation_free_list) {
+    struct animation_slab* slab = malloc(sizeof(struct animation_slab));
+    slab->next = g_animation_slabs;
+    g_animation_slabs = slab;
+
+    for (int i = ANIMATION_SLAB_SIZE - 1; i >= 0; i--) {
+      slab->animations[i].pool_next = g_animation_free_list;
+      g_animation_free_list = &slab->animations[i];
+    }
+  }
+
+  struct animation* animation = g_animation_free_list;
+  g_animation_free_list = animation->pool_next;
   memset(animation, 0, sizeof(struct animation));
 
   return animation;
 }
 
 static void animation_destroy(struct animation* animation) {
-  if (animation) free(animation);
+  if (!animation) return;
+  if (animation->keyframes && animation->keyframes != &animation->keyframe)
+    free(animation->keyframes);
+  if (animation->property) free(animation->property);
+
+  animation->pool_next = g_animation_free_list;
+  g_animation_free_list = animation;
+}
+
+static struct animation_curve* animation_curve_get(char type) {
+  if (type == INTERP_FUNCTION_CUSTOM && g_bar_manager.animator.curve)
+    return g_bar_manager.animator.curve;
+  return animation_curve_builtin(type);
 }
 
 static void animation_lock(struct animation* animation) {
@@ -25,128 +220,395 @@ static void animation_lock(struct animation* animation) {
 void animation_setup(struct animation* animation, void* target, animator_function* update_function, int initial_value, int final_value, uint32_t duration, char interp_function) {
   // The animation duration is represented as a frame count equivalent on a
   // 60Hz display. E.g. 120frames = 2 seconds
-  animation->duration = (double)duration / 60.0;
+  animation->keyframe.value = final_value;
+  animation->keyframe.delay = 0.f;
+  animation->keyframe.duration = (double)duration / 60.0;
+  animation->keyframe.curve = animation_curve_get(interp_function);
+  animation->keyframes = &animation->keyframe;
+  animation->keyframe_count = 1;
+  animation->keyframe_capacity = 1;
+  animation->period = animation->keyframe.duration;
+  animation->repeat = 0;
+  animation->yoyo = false;
+
   animation->initial_value = initial_value;
-  animation->final_value = final_value;
   animation->update_function = update_function;
   animation->target = target;
   animation->separate_bytes = false;
   animation->as_float = false;
+}
 
-  if (interp_function == INTERP_FUNCTION_TANH) {
-    animation->interp_function = &function_tanh;
-  } else if (interp_function == INTERP_FUNCTION_SIN) {
-    animation->interp_function = &function_sin;
-  } else if (interp_function == INTERP_FUNCTION_QUADRATIC) {
-    animation->interp_function = &function_square;
-  } else if (interp_function == INTERP_FUNCTION_EXP) {
-    animation->interp_function = &function_exp;
-  } else if (interp_function == INTERP_FUNCTION_CIRC) {
-    animation->interp_function = &function_circ;
-  } else {
-    animation->interp_function = &function_linear;
-  }
+// Applies to a freshly set up animation, the delay is given in the same
+// frame units as the duration.
+void animation_set_timeline(struct animation* animation, uint32_t delay, uint32_t repeat, bool yoyo) {
+  animation->keyframe.delay = (double)delay / 60.0;
+  animation->period = animation->keyframe.delay + animation->keyframe.duration;
+  animation->repeat = repeat;
+  animation->yoyo = yoyo;
 }
 
-static bool animation_update(struct animation* animation, uint64_t time, uint64_t clock) {
-  if (!animation->target
-      || !animation->update_function
-      || animation->waiting         ) {
-    return false;
+// The keyframes of animation are appended to the timeline, continuing from
+// the last keyframe of the timeline.
+static void animation_append(struct animation* timeline, struct animation* animation) {
+  uint32_t count = timeline->keyframe_count + animation->keyframe_count;
+  if (count > timeline->keyframe_capacity) {
+    uint32_t capacity = max(count, 2 * timeline->keyframe_capacity);
+    struct animation_keyframe* keyframes
+                          = malloc(sizeof(struct animation_keyframe) * capacity);
+
+    memcpy(keyframes,
+           timeline->keyframes,
+           sizeof(struct animation_keyframe) * timeline->keyframe_count);
+
+    if (timeline->keyframes != &timeline->keyframe) free(timeline->keyframes);
+    timeline->keyframes = keyframes;
+    timeline->keyframe_capacity = capacity;
   }
 
-  if (!animation->initial_time) animation->initial_time = time;
-  double t = animation->duration > 0
-             ? ((double)(time - animation->initial_time)
-               / (double)(animation->duration * clock))
-             : 1.0;
+  memcpy(timeline->keyframes + timeline->keyframe_count,
+         animation->keyframes,
+         sizeof(struct animation_keyframe) * animation->keyframe_count);
+
+  timeline->keyframe_count = count;
+  timeline->period += animation->period;
+  if (animation->repeat) timeline->repeat = animation->repeat;
+  timeline->yoyo |= animation->yoyo;
+}
 
-  bool final_frame = t >= 1.0;
-  if (t < 0.0) t = 0.0;
-  if (t > 1.0) t = 1.0;
+static int animation_get_segment_start(struct animation* animation) {
+  return animation->segment > 0
+         ? animation->keyframes[animation->segment - 1].value
+         : animation->initial_value;
+}
 
-  double slider = final_frame ? 1.0 : animation->interp_function(t);
+static int animation_get_final_value(struct animation* animation) {
+  if (animation->yoyo
+      && animation->repeat != ANIMATION_REPEAT_FOREVER
+      && (animation->repeat & 1)) {
+    return animation->initial_value;
+  }
+  return animation->keyframes[animation->keyframe_count - 1].value;
+}
 
-  int value;
-  if (animation->separate_bytes) {
-    for (int i = 0; i < 4; i++) {
-      unsigned char byte_i = *((unsigned char*)&animation->initial_value + i);
-      unsigned char byte_f = *((unsigned char*)&animation->final_value + i);
+// Locates the segment of the timeline at the given time and the progress
+// within that segment. Delays hold the value the segment starts from.
+static bool animation_prepare(struct animation* animation, uint64_t time, double clock, double* progress) {
+  if (!animation->target || !animation->update_function) return false;
+
+  if (!animation->initial_time) animation->initial_time = time;
+  double elapsed = time > animation->initial_time
+                   ? (double)(time - animation->initial_time) / clock
+                   : 0.0;
+
+  double period = animation->period;
+  uint64_t cycle = period > 0.0 ? elapsed / period : 0;
+  if (period <= 0.0
+      || (animation->repeat != ANIMATION_REPEAT_FOREVER
+          && cycle > animation->repeat)) {
+    // A yoyo timeline with an odd repeat count ends where it started
+    bool at_start = animation->yoyo
+                    && animation->repeat != ANIMATION_REPEAT_FOREVER
+                    && (animation->repeat & 1);
+
+    animation->segment = at_start ? 0 : animation->keyframe_count - 1;
+    animation->finished = true;
+    animation->waiting = false;
+    animation->progress = at_start ? 0.0 : 1.0;
+    *progress = animation->progress;
+    return true;
+  }
 
-      unsigned char byte_val = (1. - slider) * byte_i + slider * byte_f;
-      *((unsigned char*)&value + i) = byte_val;
+  double local = elapsed - cycle * period;
+  if (animation->yoyo && (cycle & 1)) local = period - local;
+
+  uint32_t segment = 0;
+  double t = 1.0;
+  animation->waiting = false;
+  for (; segment < animation->keyframe_count; segment++) {
+    struct animation_keyframe* keyframe = &animation->keyframes[segment];
+    if (local < keyframe->delay) {
+      animation->waiting = true;
+      t = 0.0;
+      break;
+    }
+    local -= keyframe->delay;
+    if (local < keyframe->duration) {
+      t = local / keyframe->duration;
+      break;
     }
-  } else if (animation->as_float) {
-    *((float*)&value) = (1. - slider) * *(float*)&animation->initial_value
-             + slider * *(float*)&animation->final_value;
+    local -= keyframe->duration;
+  }
 
-  } else {
-    value = (1. - slider) * animation->initial_value
-            + slider * animation->final_value
-            + 0.5;
-    if (final_frame) value = animation->final_value;
+  if (segment == animation->keyframe_count) {
+    segment = animation->keyframe_count - 1;
+    t = 1.0;
   }
 
-  bool needs_update;
-  if (animation->as_float) {
+  animation->segment = segment;
+  animation->progress = t;
+  *progress = t;
+  return true;
+}
+
+static uint32_t animation_get_kind(struct animation* animation) {
+  if (animation->separate_bytes) return ANIMATION_KIND_BYTES;
+  if (animation->as_float) return ANIMATION_KIND_FLOAT;
+  return ANIMATION_KIND_INT;
+}
+
+static bool animation_apply(struct animation* animation, int value) {
+  // Unchanged values (e.g. integers that did not move in this frame) are
+  // not applied, such that the frame can be skipped entirely.
+  bool needs_update = false;
+  bool changed = !animation->has_last_value
+                 || value != animation->last_value;
+
+  if (changed && animation->as_float) {
     needs_update =
       ((bool (*)(void*, float))animation->update_function)(animation->target,
                                                            *((float*)&value) );
-  } else {
+  } else if (changed) {
     needs_update = animation->update_function(animation->target, value);
   }
+  animation->last_value = value;
+  animation->has_last_value = true;
 
-  bool found_item = false;
-  for (int i = 0; i < g_bar_manager.bar_item_count; i++) {
-    if (needs_update
-        && (animation->target >= (void*)g_bar_manager.bar_items[i])
-        && (animation->target < ((void*)g_bar_manager.bar_items[i]
-                                 + sizeof(struct bar_item)         ))) {
-
-      bar_item_needs_update(g_bar_manager.bar_items[i]);
-      found_item = true;
-    }
+  if (needs_update) {
+    if (animation->owner) bar_item_needs_update(animation->owner);
+    else g_bar_manager.bar_needs_update = true;
   }
 
-  if (!found_item && needs_update) g_bar_manager.bar_needs_update = true;
-
-  animation->finished = final_frame;
-  if (animation->finished && animation->next) {
-    animation->next->previous = NULL;
-    animation->next->waiting = false;
-    animation->next = NULL;
-  }
   return needs_update;
 }
 
 void animator_init(struct animator* animator) {
   animator->animations = NULL;
   animator->animation_count = 0;
-  animator->interp_function = 0;
-  animator->duration = 0;
+  animator->animation_capacity = 0;
+  animator->index = NULL;
+  animator->index_size = 0;
+  animator->index_count = 0;
+  animator->owner = NULL;
+  animator->property[0] = '\0';
+  memset(&animator->batch, 0, sizeof(struct animation_batch));
+  animator->curve = NULL;
+  animator_reset_timing(animator);
   animator->display_link = NULL;
+  animator->virtual_timer = NULL;
+  animator->virtual_rate = 0;
+  animator->virtual_time = 0;
+  animator->stepping = false;
+  animator->trace = NULL;
+  animator->frame_source = &g_display_link_source;
+  animator->frame_in_flight = 0;
+  animator->frame_time = 0;
+  animator->max_fps = 0;
+  animator->frame_budget = 0;
+  animator->last_frame = 0;
+  animator->frames_rendered = 0;
+  animator->frames_skipped = 0;
+  animator->frames_dropped = 0;
+  animator->frames_over_budget = 0;
+  animator->last_frame_duration = 0;
+  animator->frame_time_total = 0;
+  memset(animator->frame_histogram, 0, sizeof(animator->frame_histogram));
+  animator->peak_animations = 0;
+
+  animator_renew_frame_source(animator);
+}
+
+static void animator_calculate_frame_budget(struct animator* animator) {
+  double period = 1.0 / 60.0;
+  if (animator->virtual_rate > 0) {
+    period = 1.0 / animator->virtual_rate;
+  } else if (animator->display_link) {
+    CVTime refresh_period
+      = CVDisplayLinkGetNominalOutputVideoRefreshPeriod(animator->display_link);
+
+    if (!(refresh_period.flags & kCVTimeIsIndefinite)
+        && refresh_period.timeScale > 0
+        && refresh_period.timeValue > 0) {
+      period = (double)refresh_period.timeValue
+               / (double)refresh_period.timeScale;
+    }
+  }
 
-  animator_renew_display_link(animator);
+  if (animator->max_fps > 0 && 1.0 / animator->max_fps > period)
+    period = 1.0 / animator->max_fps;
+
+  animator->frame_budget = period * animator->clock;
 }
 
-void animator_renew_display_link(struct animator* animator) {
-  animator_destroy_display_link(animator);
-  CVDisplayLinkCreateWithActiveCGDisplays(&animator->display_link);
+void animator_reset_timing(struct animator* animator) {
+  animator->interp_function = '\0';
+  animator->duration = 0;
+  animator->delay = 0;
+  animator->repeat = 0;
+  animator->yoyo = false;
+}
 
-  CVDisplayLinkSetOutputCallback(animator->display_link,
-                                 animation_frame_callback,
-                                 animator                 );
+void animator_save_settings(struct animator* animator, struct animator_settings* settings) {
+  settings->interp_function = animator->interp_function;
+  settings->duration = animator->duration;
+  settings->delay = animator->delay;
+  settings->repeat = animator->repeat;
+  settings->yoyo = animator->yoyo;
+  settings->curve = animator->curve;
+  settings->owner = animator->owner;
+  memcpy(settings->property, animator->property, sizeof(settings->property));
+}
 
-  animator->clock = CVGetHostClockFrequency();
-  CVDisplayLinkStart(animator->display_link);
+void animator_restore_settings(struct animator* animator, struct animator_settings* settings) {
+  animator->interp_function = settings->interp_function;
+  animator->duration = settings->duration;
+  animator->delay = settings->delay;
+  animator->repeat = settings->repeat;
+  animator->yoyo = settings->yoyo;
+  animator->curve = settings->curve;
+  animator->owner = settings->owner;
+  memcpy(animator->property, settings->property, sizeof(animator->property));
 }
 
-void animator_destroy_display_link(struct animator* animator) {
-  if (animator->display_link) {
-    CVDisplayLinkStop(animator->display_link);
-    CVDisplayLinkRelease(animator->display_link);
-    animator->display_link = NULL;
+// Parametrized curves are held by the animator, named ones by their type
+bool animator_set_curve(struct animator* animator, char* description) {
+  struct animation_curve* curve = animation_curve_parse(description);
+  if (!curve) return false;
+
+  if (curve->type == INTERP_FUNCTION_BEZIER
+      || curve->type == INTERP_FUNCTION_SPRING) {
+    animator->curve = curve;
+    animator->interp_function = INTERP_FUNCTION_CUSTOM;
+  } else {
+    animator->interp_function = description[0];
+  }
+  return true;
+}
+
+// Accepts "delay=<frames>", "repeat=<count|forever>" and "yoyo=<boolean>"
+bool animator_set_timeline_option(struct animator* animator, char* option) {
+  if (!option) return false;
+  struct key_value_pair key_value_pair = get_key_value_pair(option, '=');
+  if (!key_value_pair.key || !key_value_pair.value) return false;
+
+  struct token key = { key_value_pair.key, strlen(key_value_pair.key) };
+  struct token value = { key_value_pair.value, strlen(key_value_pair.value) };
+
+  if (token_equals(key, ARGUMENT_ANIMATION_DELAY)) {
+    animator->delay = token_to_uint32t(value);
+  } else if (token_equals(key, ARGUMENT_ANIMATION_REPEAT)) {
+    animator->repeat = token_equals(value, ARGUMENT_ANIMATION_FOREVER)
+                       ? ANIMATION_REPEAT_FOREVER
+                       : token_to_uint32t(value);
+  } else if (token_equals(key, ARGUMENT_ANIMATION_YOYO)) {
+    animator->yoyo = evaluate_boolean_state(value, animator->yoyo);
+  } else {
+    return false;
   }
+  return true;
+}
+
+bool animator_set_max_fps(struct animator* animator, uint32_t max_fps) {
+  if (animator->max_fps == max_fps) return false;
+  animator->max_fps = max_fps;
+  animator_calculate_frame_budget(animator);
+  return true;
+}
+
+void animator_record_frame(struct animator* animator, uint64_t start, bool rendered) {
+  if (!rendered) {
+    animator->frames_skipped++;
+    return;
+  }
+
+  animator->last_frame_duration = animator_get_time(animator) - start;
+  animator->frames_rendered++;
+  if (animator->last_frame_duration > animator->frame_budget)
+    animator->frames_over_budget++;
+
+  uint64_t microseconds = animator->last_frame_duration * 1e6
+                          / animator->clock;
+  uint64_t bucket = min(microseconds / ANIMATOR_FRAME_HISTOGRAM_STEP,
+                        ANIMATOR_FRAME_HISTOGRAM_SIZE - 1           );
+
+  animator->frame_time_total += animator->last_frame_duration;
+  animator->frame_histogram[bucket]++;
+}
+
+// Ends the frame the display link handed to the main queue
+void animator_frame_done(struct animator* animator) {
+  __sync_lock_release(&animator->frame_in_flight);
+}
+
+uint64_t animator_get_time(struct animator* animator) {
+  return animator->frame_source->get_time(animator);
+}
+
+void animator_renew_frame_source(struct animator* animator) {
+  animator_stop_frame_source(animator);
+  animator->frame_source->start(animator);
+  animator_calculate_frame_budget(animator);
+}
+
+void animator_stop_frame_source(struct animator* animator) {
+  animator->frame_source->stop(animator);
+}
+
+static bool animator_switch_frame_source(struct animator* animator, struct frame_source* frame_source, uint32_t virtual_rate) {
+  if (animator->frame_source == frame_source
+      && animator->virtual_rate == virtual_rate) {
+    return false;
+  }
+  bool running = animator->frame_source->is_running(animator);
+  animator_stop_frame_source(animator);
+
+  animator->virtual_rate = virtual_rate;
+  animator->frame_source = frame_source;
+
+  // Animations in flight measured their progress in the previous clock
+  for (uint32_t i = 0; i < animator->animation_count; i++) {
+    animator->animations[i]->initial_time = 0;
+  }
+  animator->last_frame = 0;
+
+  if (running) animator_renew_frame_source(animator);
+  return true;
+}
+
+// A rate of zero selects the display link, any other rate a virtual clock
+// ticking at the given frequency.
+bool animator_set_frame_source(struct animator* animator, uint32_t virtual_rate) {
+  return animator_switch_frame_source(animator,
+                                      virtual_rate > 0
+                                      ? &g_virtual_clock_source
+                                      : &g_display_link_source,
+                                      virtual_rate                );
+}
+
+// Selects the stepped clock at the given rate, frames are then only
+// produced by animator_advance
+bool animator_set_stepped_clock(struct animator* animator, uint32_t virtual_rate) {
+  if (!virtual_rate) return false;
+  return animator_switch_frame_source(animator,
+                                      &g_stepped_clock_source,
+                                      virtual_rate            );
+}
+
+// Advances a virtual or stepped clock by the given number of periods and
+// produces every frame synchronously, bypassing the event loop and the fps
+// cap. Returns whether any frame changed a property.
+bool animator_advance(struct animator* animator, uint32_t ticks) {
+  if (!animator->virtual_rate) return false;
+
+  bool needs_refresh = false;
+  for (uint32_t i = 0; i < ticks; i++) {
+    uint64_t start = animator_get_time(animator);
+    uint64_t time = virtual_clock_step(animator);
+    bool rendered = animator_update(animator, time);
+    animator->last_frame = time;
+    animator_record_frame(animator, start, rendered);
+    needs_refresh |= rendered;
+  }
+  return needs_refresh;
 }
 
 void animator_lock(struct animator* animator) {
@@ -155,142 +617,342 @@ void animator_lock(struct animator* animator) {
   }
 }
 
-static void animator_calculate_offset_for_animation(struct animator* animator, struct animation* animation) {
-  if (animator->animation_count < 1) return;
+// Names the property new animations are attributed to, NULL clears it
+void animator_set_property(struct animator* animator, char* property) {
+  snprintf(animator->property,
+           sizeof(animator->property),
+           "%s",
+           property ? property : ""    );
+}
 
-  struct animation* previous = NULL;
-  for (int i = animator->animation_count - 1; i >= 0; i--) {
-    struct animation* current = animator->animations[i];
-    if (current->target == animation->target
-        && current->update_function == animation->update_function) {
-      previous = current;
-      break;
+static uint32_t animator_index_bucket(uint32_t size, void* target, animator_function* function) {
+  uint64_t hash = hash_combine(0xcbf29ce484222325ULL, (uintptr_t)target);
+  hash = hash_combine(hash, (uintptr_t)function);
+  return (hash ^ (hash >> 32)) & (size - 1);
+}
+
+static struct animation** animator_index_find_slot(struct animator* animator, void* target, animator_function* function) {
+  if (!animator->index) return NULL;
+  uint32_t bucket = animator_index_bucket(animator->index_size,
+                                          target,
+                                          function            );
+
+  struct animation** slot = &animator->index[bucket];
+  while (*slot) {
+    if ((*slot)->target == target
+        && (*slot)->update_function == function) {
+      return slot;
     }
+    slot = &(*slot)->index_next;
   }
+  return NULL;
+}
+
+static struct animation* animator_index_find(struct animator* animator, void* target, animator_function* function) {
+  struct animation** slot = animator_index_find_slot(animator,
+                                                     target,
+                                                     function );
+  return slot ? *slot : NULL;
+}
 
-  if (previous) {
-    animation->initial_value = previous->final_value;
-    previous->next = animation;
-    animation->previous = previous;
-    animation->waiting = true;
+static void animator_index_grow(struct animator* animator) {
+  uint32_t size = animator->index_size ? 2 * animator->index_size : 64;
+  struct animation** index = malloc(sizeof(struct animation*) * size);
+  memset(index, 0, sizeof(struct animation*) * size);
+
+  for (uint32_t i = 0; i < animator->index_size; i++) {
+    struct animation* animation = animator->index[i];
+    while (animation) {
+      struct animation* next = animation->index_next;
+      uint32_t bucket = animator_index_bucket(size,
+                                              animation->target,
+                                              animation->update_function);
+      animation->index_next = index[bucket];
+      index[bucket] = animation;
+      animation = next;
+    }
   }
+
+  if (animator->index) free(animator->index);
+  animator->index = index;
+  animator->index_size = size;
 }
 
-void animator_add(struct animator* animator, struct animation* animation) {
-  animator_calculate_offset_for_animation(animator, animation);
-  animator->animations = realloc(animator->animations,
-                                 sizeof(struct animation*)
-                                        * ++animator->animation_count);
-  animator->animations[animator->animation_count - 1] = animation;
+static void animator_index_insert(struct animator* animator, struct animation* animation) {
+  if (animator->index_count >= animator->index_size)
+    animator_index_grow(animator);
 
-  if (!animator->display_link) animator_renew_display_link(animator);
+  uint32_t bucket = animator_index_bucket(animator->index_size,
+                                          animation->target,
+                                          animation->update_function);
+  animation->index_next = animator->index[bucket];
+  animator->index[bucket] = animation;
+  animator->index_count++;
 }
 
-static void animator_remove(struct animator* animator, struct animation* animation) {
-  if (animator->animation_count == 1) {
-    free(animator->animations);
-    animator->animations = NULL;
-    animator->animation_count = 0;
-  } else {
-    struct animation* tmp[animator->animation_count - 1];
-    int count = 0;
-    for (int i = 0; i < animator->animation_count; i++) {
-      if (animator->animations[i] == animation) continue;
-      tmp[count++] = animator->animations[i];
-    }
-    animator->animation_count--;
+void animator_add(struct animator* animator, struct animation* animation) {
+  animation->owner = animator->owner;
+  struct animation* timeline = animator_index_find(animator,
+                                                   animation->target,
+                                                   animation->update_function);
+  if (timeline) {
+    animation_append(timeline, animation);
+    animation_destroy(animation);
+    return;
+  }
+  animator_index_insert(animator, animation);
+  if (animator->property[0])
+    animation->property = string_copy(animator->property);
+
+  if (animator->animation_count == animator->animation_capacity) {
+    animator->animation_capacity = animator->animation_capacity
+                                   ? 2 * animator->animation_capacity
+                                   : 16;
     animator->animations = realloc(animator->animations,
                                    sizeof(struct animation*)
-                                          *animator->animation_count);
-
-    memcpy(animator->animations,
-           tmp,
-           sizeof(struct animation*)*animator->animation_count);
+                                   * animator->animation_capacity);
   }
+  animation->slot = animator->animation_count;
+  animator->animations[animator->animation_count++] = animation;
+  if (animator->animation_count > animator->peak_animations)
+    animator->peak_animations = animator->animation_count;
 
-  if (animation->previous) animation->previous->next = NULL;
-  if (animation->next) animation->next->previous = NULL;
+  if (!animator->frame_source->is_running(animator))
+    animator_renew_frame_source(animator);
+}
+
+static void animator_remove(struct animator* animator, struct animation* animation) {
+  struct animation* last = animator->animations[--animator->animation_count];
+  animator->animations[animation->slot] = last;
+  last->slot = animation->slot;
+
+  struct animation** slot = animator_index_find_slot(animator,
+                                                     animation->target,
+                                                     animation->update_function);
+  if (slot && *slot == animation) {
+    *slot = animation->index_next;
+    animator->index_count--;
+  }
+  animation->index_next = NULL;
 
   animation_destroy(animation);
 }
 
 void animator_cancel_locked(struct animator* animator, void* target, animator_function* function) {
-  struct animation* remove[animator->animation_count];
-  memset(remove, 0, animator->animation_count);
-  uint32_t remove_count = 0;
+  struct animation* animation = animator_index_find(animator,
+                                                    target,
+                                                    function );
+  if (animation && animation->locked) animator_remove(animator, animation);
+}
 
-  for (int i = 0; i < animator->animation_count; i++) {
+bool animator_cancel(struct animator* animator, void* target, animator_function* function) {
+  struct animation* animation = animator_index_find(animator,
+                                                    target,
+                                                    function );
+  if (!animation) return false;
+
+  bool needs_update = function(animation->target,
+                               animation_get_final_value(animation));
+  animator_remove(animator, animation);
+  return needs_update;
+}
+
+// Drops the animations of an item that is about to be destroyed
+void animator_cancel_owner(struct animator* animator, struct bar_item* owner) {
+  uint32_t i = 0;
+  while (i < animator->animation_count) {
     struct animation* animation = animator->animations[i];
-    if (animation->locked
-        && animation->target == target
-        && animation->update_function == function) {
-      remove[remove_count++] = animation;
-    }
+    if (animation->owner == owner) animator_remove(animator, animation);
+    else i++;
   }
+}
 
-  for (uint32_t i = 0; i < remove_count; i++) {
-    animator_remove(animator, remove[i]);
+// Writes the values applied in this frame, one line per animation
+static void animator_trace_frame(struct animator* animator, uint32_t active_count) {
+  struct animation_batch* batch = &animator->batch;
+  for (uint32_t i = 0; i < active_count; i++) {
+    struct animation* animation = batch->animations[i];
+    int value = batch->values[i];
+    fprintf(animator->trace, "%s\t%s\t", animation->owner
+                                          ? animation->owner->name
+                                          : "bar",
+                                          animation->property
+                                          ? animation->property
+                                          : ""                   );
+
+    if (animation->as_float) fprintf(animator->trace, "%g\n", *((float*)&value));
+    else if (animation->separate_bytes) fprintf(animator->trace, "0x%08x\n", value);
+    else fprintf(animator->trace, "%d\n", value);
   }
 }
 
-bool animator_cancel(struct animator* animator, void* target, animator_function* function) {
-  bool needs_update = false;
+bool animator_update(struct animator* animator, uint64_t time) {
+  struct animation_batch* batch = &animator->batch;
+  animation_batch_reserve(batch, animator->animation_count);
 
-  struct animation* remove[animator->animation_count];
-  memset(remove, 0, animator->animation_count);
-  uint32_t remove_count = 0;
+  // The active animations are bucketed by (easing, kind) and scattered into
+  // structure of arrays storage, group by group.
+  uint32_t group_count = 0;
+  uint32_t active_count = 0;
 
-  for (int i = 0; i < animator->animation_count; i++) {
+  for (uint32_t i = 0; i < animator->animation_count; i++) {
     struct animation* animation = animator->animations[i];
-    if (animation->target == target
-        && animation->update_function == function) {
-      needs_update |= function(animation->target, animation->final_value);
-      remove[remove_count++] = animation;
+    batch->group_of[i] = ANIMATION_NO_GROUP;
+    if (!animation_prepare(animation,
+                           time,
+                           animator->clock,
+                           &batch->scratch[i])) {
+      continue;
+    }
+
+    uint32_t kind = animation_get_kind(animation);
+    struct animation_curve* curve = animation->keyframes[animation->segment].curve;
+    uint32_t group = 0;
+    while (group < group_count
+           && (batch->groups[group].curve != curve
+               || batch->groups[group].kind != kind)) {
+      group++;
+    }
+
+    if (group == group_count) {
+      animation_batch_add_group(batch, group_count++, curve, kind);
     }
+    batch->groups[group].count++;
+    batch->group_of[i] = group;
+    active_count++;
   }
 
-  for (uint32_t i = 0; i < remove_count; i++) {
-    animator_remove(animator, remove[i]);
+  uint32_t* cursor = batch->group_cursor;
+  for (uint32_t g = 0, offset = 0; g < group_count; g++) {
+    batch->groups[g].offset = offset;
+    cursor[g] = offset;
+    offset += batch->groups[g].count;
   }
 
-  return needs_update;
-}
+  for (uint32_t i = 0; i < animator->animation_count; i++) {
+    uint32_t group = batch->group_of[i];
+    if (group == ANIMATION_NO_GROUP) continue;
 
-bool animator_update(struct animator* animator, uint64_t time) {
-  bool needs_refresh = false;
-  struct animation* remove[animator->animation_count];
-  memset(remove, 0, animator->animation_count);
-  uint32_t remove_count = 0;
+    struct animation* animation = animator->animations[i];
+    uint32_t position = cursor[group]++;
+    batch->animations[position] = animation;
+    batch->progress[position] = batch->scratch[i];
+    batch->from[position] = animation_get_segment_start(animation);
+    batch->to[position] = animation->keyframes[animation->segment].value;
+  }
 
-  for (uint32_t i = 0; i < animator->animation_count; i++) {
-    needs_refresh |= animation_update(animator->animations[i],
-                                      time,
-                                      animator->clock         );
+  for (uint32_t g = 0; g < group_count; g++) {
+    animation_batch_evaluate(batch, &batch->groups[g]);
+  }
 
-    if (animator->animations[i]->finished) {
-      remove[remove_count++] = animator->animations[i];
-    }
+  bool needs_refresh = false;
+  for (uint32_t i = 0; i < active_count; i++) {
+    needs_refresh |= animation_apply(batch->animations[i], batch->values[i]);
   }
 
-  for (uint32_t i = 0; i < remove_count; i++) {
-    animator_remove(animator, remove[i]);
+  if (animator->trace) animator_trace_frame(animator, active_count);
+
+  for (uint32_t i = 0; i < active_count; i++) {
+    if (batch->animations[i]->finished)
+      animator_remove(animator, batch->animations[i]);
   }
 
-  if (animator->animation_count == 0) animator_destroy_display_link(animator);
+  if (animator->animation_count == 0) animator_stop_frame_source(animator);
   return needs_refresh;
 }
 
 void animator_destroy(struct animator* animator) {
-  if (animator->animation_count > 0) {
-    if (animator->display_link)
-      CVDisplayLinkStop(animator->display_link);
-    CVDisplayLinkRelease(animator->display_link);
-    animator->display_link = NULL;
+  animator_stop_frame_source(animator);
+  for (int i = 0; i < animator->animation_count; i++) {
+    animation_destroy(animator->animations[i]);
+  }
 
-    for (int i = 0; i < animator->animation_count; i++) {
-      animation_destroy(animator->animations[i]);
+  if (animator->animations) free(animator->animations);
+  if (animator->index) free(animator->index);
+  animation_batch_destroy(&animator->batch);
+  animator->animations = NULL;
+  animator->animation_count = 0;
+  animator->animation_capacity = 0;
+  animator->index = NULL;
+  animator->index_size = 0;
+  animator->index_count = 0;
+}
+
+// Returns the remaining time of the animation in seconds, or a negative
+// value for animations repeating forever.
+static double animation_get_remaining(struct animation* animation, uint64_t time, double clock) {
+  if (animation->repeat == ANIMATION_REPEAT_FOREVER) return -1.0;
+
+  double elapsed = animation->initial_time && time > animation->initial_time
+                   ? (double)(time - animation->initial_time) / clock
+                   : 0.0;
+
+  double remaining = animation->period * (animation->repeat + 1.0) - elapsed;
+  return max(remaining, 0.0);
+}
+
+static double animator_get_frame_time_percentile(struct animator* animator, double percentile) {
+  uint64_t count = 0;
+  for (uint32_t i = 0; i < ANIMATOR_FRAME_HISTOGRAM_SIZE; i++) {
+    count += animator->frame_histogram[i];
+  }
+  if (count == 0) return 0.0;
+
+  uint64_t threshold = ceil(count * percentile);
+  uint64_t cumulative = 0;
+  for (uint32_t i = 0; i < ANIMATOR_FRAME_HISTOGRAM_SIZE; i++) {
+    cumulative += animator->frame_histogram[i];
+    if (cumulative >= threshold) {
+      return (i + 1) * ANIMATOR_FRAME_HISTOGRAM_STEP / 1000.0;
     }
   }
+  return ANIMATOR_FRAME_HISTOGRAM_SIZE * ANIMATOR_FRAME_HISTOGRAM_STEP / 1000.0;
+}
 
-  if (animator->animations) free(animator->animations);
+void animator_serialize(struct animator* animator, struct json* json) {
+  double mean = animator->frames_rendered > 0 && animator->clock > 0
+                ? 1000.0 * animator->frame_time_total
+                  / animator->frames_rendered
+                  / animator->clock
+                : 0.0;
+
+  json_uint(json, "frames_rendered", animator->frames_rendered);
+  json_uint(json, "frames_skipped", animator->frames_skipped);
+  json_uint(json, "frames_dropped", animator->frames_dropped);
+  json_uint(json, "frames_over_budget", animator->frames_over_budget);
+  json_float(json, "frame_time_mean_ms", mean, 3);
+  json_float(json, "frame_time_p99_ms",
+                   animator_get_frame_time_percentile(animator, 0.99),
+                   3                                                  );
+  json_uint(json, "peak_animations", animator->peak_animations);
+
+  // Animation start times are measured in frame times of the frame source
+  json_array_begin(json, "animations");
+  for (uint32_t i = 0; i < animator->animation_count; i++) {
+    struct animation* animation = animator->animations[i];
+    double remaining = animation_get_remaining(animation,
+                                               animator->last_frame,
+                                               animator->clock      );
+    char curve[128];
+    animation_curve_get_name(animation->keyframes[animation->segment].curve,
+                             curve,
+                             sizeof(curve)                                 );
+
+    json_object_begin(json, NULL);
+    json_string(json, "item", animation->owner ? animation->owner->name
+                                               : "bar"                 );
+    json_string(json, "property", animation->property ? animation->property
+                                                      : ""                 );
+    json_string(json, "state", !animation->initial_time || animation->waiting
+                               ? "waiting"
+                               : "active"                                  );
+    json_uint(json, "segment", animation->segment);
+    json_uint(json, "keyframes", animation->keyframe_count);
+    json_float(json, "progress", animation->progress, 3);
+    json_string(json, "curve", curve);
+    if (remaining < 0.0) json_null(json, "remaining_ms");
+    else json_float(json, "remaining_ms", 1000.0 * remaining, 1);
+    json_object_end(json);
+  }
+  json_array_end(json);
 }
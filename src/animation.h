@@ -1,8 +1,11 @@
 #pragma once
 #include <CoreVideo/CoreVideo.h>
 #include "misc/helpers.h"
+#include "interpolation.h"
+#include "json.h"
 
 extern struct bar_manager g_bar_manager;
+struct bar_item;
 
 #define ANIMATE(f, o, p, t) \
 {\
@@ -16,6 +19,10 @@ extern struct bar_manager g_bar_manager;
                     t, \
                     g_bar_manager.animator.duration, \
                     g_bar_manager.animator.interp_function ); \
+    animation_set_timeline(animation, \
+                           g_bar_manager.animator.delay, \
+                           g_bar_manager.animator.repeat, \
+                           g_bar_manager.animator.yoyo   ); \
     animator_add(&g_bar_manager.animator, animation); \
   } else { \
     needs_refresh = animator_cancel(&g_bar_manager.animator, (void*)o, (bool (*)(void*, int))&f); \
@@ -37,6 +44,10 @@ extern struct bar_manager g_bar_manager;
                     *(int*)&final_value, \
                     g_bar_manager.animator.duration, \
                     g_bar_manager.animator.interp_function ); \
+    animation_set_timeline(animation, \
+                           g_bar_manager.animator.delay, \
+                           g_bar_manager.animator.repeat, \
+                           g_bar_manager.animator.yoyo   ); \
     animation->as_float = true; \
     animator_add(&g_bar_manager.animator, animation); \
   } else { \
@@ -57,6 +68,10 @@ extern struct bar_manager g_bar_manager;
                     t, \
                     g_bar_manager.animator.duration, \
                     g_bar_manager.animator.interp_function ); \
+    animation_set_timeline(animation, \
+                           g_bar_manager.animator.delay, \
+                           g_bar_manager.animator.repeat, \
+                           g_bar_manager.animator.yoyo   ); \
     animation->separate_bytes = true; \
     animator_add(&g_bar_manager.animator, animation); \
   } else { \
@@ -68,62 +83,165 @@ extern struct bar_manager g_bar_manager;
 #define ANIMATOR_FUNCTION(name) bool name(void* target, int value);
 typedef ANIMATOR_FUNCTION(animator_function);
 
-#define ANIMATION_FUNCTION(name) double name(double x);
-typedef ANIMATION_FUNCTION(animation_function);
-
-#define INTERP_FUNCTION_LINEAR    'l'
-#define INTERP_FUNCTION_QUADRATIC 'q'
-#define INTERP_FUNCTION_SIN       's'
-#define INTERP_FUNCTION_TANH      't'
-#define INTERP_FUNCTION_CIRC      'c'
-#define INTERP_FUNCTION_BOUNCE    'b'
-#define INTERP_FUNCTION_EXP       'e'
-#define INTERP_FUNCTION_OVERSHOOT 'o'
+// A keyframe ends a segment of the timeline: after waiting for delay the
+// value moves to the keyframe value over duration. Times are in seconds.
+struct animation_keyframe {
+  int value;
+  float delay;
+  float duration;
+  struct animation_curve* curve;
+};
 
+#define ANIMATION_REPEAT_FOREVER UINT32_MAX
 
 struct animation {
   bool separate_bytes;
   bool as_float;
   bool locked;
   bool finished;
-  bool waiting;
 
   uint64_t initial_time;
-  double duration;
 
+  // All changes of one (target, update_function) pair within a message form
+  // a single timeline, which is played repeat + 1 times. Odd passes of a
+  // yoyo timeline are played backwards.
   int initial_value;
-  int final_value;
-  animation_function* interp_function;
+  struct animation_keyframe* keyframes;
+  uint32_t keyframe_count;
+  uint32_t keyframe_capacity;
+  struct animation_keyframe keyframe;
+  uint32_t segment;
+  uint32_t repeat;
+  bool yoyo;
+  double period;
+
+  // Progress within the current segment, waiting while in a delay
+  double progress;
+  bool waiting;
+
+  int last_value;
+  bool has_last_value;
 
   void* target;
   animator_function* update_function;
 
-  struct animation* next;
-  struct animation* previous;
+  struct animation* index_next;
+  struct animation* pool_next;
+  uint32_t slot;
+
+  // The item whose state is animated, NULL for bar level properties
+  struct bar_item* owner;
+  char* property;
 };
 
 struct animation* animation_create();
 void animation_setup(struct animation* animation, void* target, animator_function* update_function, int initial_value, int final_value, uint32_t duration, char interp_function);
+void animation_set_timeline(struct animation* animation, uint32_t delay, uint32_t repeat, bool yoyo);
+
+// Frame times are recorded in buckets of 250us, the last bucket collects
+// all frames exceeding the histogram range.
+#define ANIMATOR_FRAME_HISTOGRAM_SIZE 128
+#define ANIMATOR_FRAME_HISTOGRAM_STEP 250
+
+struct animator;
+
+// The animation settings of the message being handled, saved across a
+// nested batch which resets them for its own commands.
+struct animator_settings {
+  uint32_t interp_function;
+  uint32_t duration;
+  uint32_t delay;
+  uint32_t repeat;
+  bool yoyo;
+  struct animation_curve* curve;
+  struct bar_item* owner;
+  char property[64];
+};
+
+// Drives the animator: a source posts ANIMATOR_REFRESH events carrying the
+// frame time, expressed in units of animator->clock ticks per second.
+struct frame_source {
+  bool (*start)(struct animator* animator);
+  void (*stop)(struct animator* animator);
+  bool (*is_running)(struct animator* animator);
+  uint64_t (*get_time)(struct animator* animator);
+};
 
 struct animator {
+  struct frame_source* frame_source;
   CVDisplayLinkRef display_link;
+  dispatch_source_t virtual_timer;
+  uint32_t virtual_rate;
+  uint64_t virtual_time;
+  bool stepping;
 
   double clock;
   uint32_t interp_function;
   uint32_t duration;
+  uint32_t delay;
+  uint32_t repeat;
+  bool yoyo;
+  struct animation_curve* curve;
   struct animation** animations;
   uint32_t animation_count;
+  uint32_t animation_capacity;
+
+  struct animation** index;
+  uint32_t index_size;
+  uint32_t index_count;
+
+  // Item whose properties are currently being set; new animations are
+  // attributed to it such that only this item is redrawn per frame.
+  struct bar_item* owner;
+  char property[64];
+  struct animation_batch batch;
+
+  // Frame pacing: ticks are dropped while a frame is in flight or when they
+  // arrive faster than the optional fps cap. All times are in host time.
+  // The display link is shared by all displays, hence so is the cap.
+  volatile uint32_t frame_in_flight;
+  uint64_t frame_time;
+  uint32_t max_fps;
+  uint64_t frame_budget;
+  uint64_t last_frame;
+
+  uint64_t frames_rendered;
+  uint64_t frames_skipped;
+  uint64_t frames_dropped;
+  uint64_t frames_over_budget;
+  uint64_t last_frame_duration;
+  uint64_t frame_time_total;
+  uint64_t frame_histogram[ANIMATOR_FRAME_HISTOGRAM_SIZE];
+  uint32_t peak_animations;
+
+  // Receives the values applied per frame when set
+  FILE* trace;
 };
 
 void animator_init(struct animator* animator);
+void animator_reset_timing(struct animator* animator);
+void animator_save_settings(struct animator* animator, struct animator_settings* settings);
+void animator_restore_settings(struct animator* animator, struct animator_settings* settings);
+bool animator_set_curve(struct animator* animator, char* description);
+bool animator_set_timeline_option(struct animator* animator, char* option);
 void animator_add(struct animator* animator, struct animation* animation);
 
 bool animator_cancel(struct animator* animator, void* target, animator_function* function);
+void animator_cancel_owner(struct animator* animator, struct bar_item* owner);
 void animator_cancel_locked(struct animator* animator, void* target, animator_function* function);
 
 bool animator_update(struct animator* animator, uint64_t time);
+bool animator_set_max_fps(struct animator* animator, uint32_t max_fps);
+void animator_frame_done(struct animator* animator);
+void animator_record_frame(struct animator* animator, uint64_t start, bool rendered);
 void animator_lock(struct animator* animator);
+void animator_set_property(struct animator* animator, char* property);
+void animator_serialize(struct animator* animator, struct json* json);
 void animator_destroy(struct animator* animator);
 
-void animator_renew_display_link(struct animator* animator);
-void animator_destroy_display_link(struct animator* animator);
+uint64_t animator_get_time(struct animator* animator);
+bool animator_set_frame_source(struct animator* animator, uint32_t virtual_rate);
+bool animator_set_stepped_clock(struct animator* animator, uint32_t virtual_rate);
+bool animator_advance(struct animator* animator, uint32_t ticks);
+void animator_renew_frame_source(struct animator* animator);
+void animator_stop_frame_source(struct animator* animator);
@@ -23,6 +23,7 @@ void background_init(struct background* background) {
   background->corner_radii.bottom_right = 0;
   background->x_offset = 0;
   background->y_offset = 0;
+  background->shape.path = NULL;
 
   color_init(&background->color, 0x00000000);
   color_init(&background->border_color, 0x00000000);
@@ -38,11 +39,18 @@ bool background_set_height(struct background* background, uint32_t height) {
   return true;
 }
 
-static void background_reset_clip(struct background* background) {
-  for (uint32_t i = 0; i < background->num_clips; i++)
+static void background_free_clips(struct background* background) {
+  for (uint32_t i = 0; i < background->num_clips; i++) {
+    if (!background->clips[i]) continue;
+    rounded_rect_path_destroy(&background->clips[i]->shape);
     free(background->clips[i]);
+  }
 
   if (background->clips) free(background->clips);
+}
+
+static void background_reset_clip(struct background* background) {
+  background_free_clips(background);
   background->clips = NULL;
   background->num_clips = 0;
 }
@@ -184,9 +192,12 @@ bool background_clip_needs_update(struct background* background, struct bar* bar
   return false;
 }
 
+// The shape of a clip caches the path of the clipped region on its display
 static void background_update_clip(struct background* background, struct background* clip) {
+  struct rounded_rect_path shape = clip->shape;
   memcpy(clip, background, sizeof(struct background));
   background_clear_pointers(clip);
+  clip->shape = shape;
 }
 
 struct background* background_get_clip(struct background* background, uint32_t adid) {
@@ -227,34 +238,79 @@ void background_clip_bar(struct background* background, int offset, struct bar*
   background_bounds.origin.y += background->y_offset;
 
   clip_rect(bar->window.context,
+            &clip->shape,
             background_bounds,
             background->clip,
             &background->corner_radii);
 }
 
+// The fill, border, gradient clip and shadow all share this rect (the shadow
+// offset by a translation), such that a single cached path serves all of them.
+static CGRect background_get_path_rect(struct background* background) {
+  CGRect background_bounds = background->bounds;
+  background_bounds.origin.x += background->x_offset;
+  background_bounds.origin.y += background->y_offset;
+  return CGRectInset(background_bounds,
+                     (float)(background->border_width) / 2.f,
+                     (float)(background->border_width) / 2.f);
+}
+
+// Refreshes the cached geometry and gradient, main thread only.
+void background_prepare(struct background* background) {
+  rounded_rect_path_update(&background->shape,
+                           background_get_path_rect(background),
+                           &background->corner_radii            );
+  gradient_prepare(&background->gradient);
+}
+
 void background_calculate_bounds(struct background* background, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
   background->bounds.origin.x = x;
   background->bounds.origin.y = y - height / 2;
   background->bounds.size.width = width;
   background->bounds.size.height = height;
 
+  background_prepare(background);
   if (background->image.enabled)
     image_calculate_bounds(&background->image, x, y);
 }
 
-static void draw_rect(CGContextRef context, CGRect region, struct color* fill_color, struct corner_radii* corner_radii, uint32_t line_width, struct color* stroke_color) {
+static void draw_path(CGContextRef context, CGPathRef path, struct color* fill_color, uint32_t line_width, struct color* stroke_color) {
   CGContextSetLineWidth(context, line_width);
   if (stroke_color) CGContextSetRGBStrokeColor(context, stroke_color->r, stroke_color->g, stroke_color->b, stroke_color->a);
   CGContextSetRGBFillColor(context, fill_color->r, fill_color->g, fill_color->b, fill_color->a);
 
-  CGMutablePathRef path = CGPathCreateMutable();
-  CGRect inset_region = CGRectInset(region, (float)(line_width) / 2.f, (float)(line_width) / 2.f);
-  add_rounded_rect_path(path, inset_region,
-                       corner_radii->top_left, corner_radii->top_right,
-                       corner_radii->bottom_left, corner_radii->bottom_right);
   CGContextAddPath(context, path);
   CGContextDrawPath(context, kCGPathFillStroke);
-  CFRelease(path);
+}
+
+// Identifies the drawn appearance of the background, such that cached
+// renderings of it can be reused as long as the key does not change.
+uint64_t background_get_key(struct background* background) {
+  uint64_t hash = hash_combine(0xcbf29ce484222325ULL, background->enabled);
+  if (!background->enabled) return hash;
+
+  hash = hash_rect(hash, background->bounds);
+  hash = hash_combine(hash, background->x_offset);
+  hash = hash_combine(hash, background->y_offset);
+  hash = hash_combine(hash, background->border_width);
+  hash = hash_combine(hash, background->corner_radii.top_left);
+  hash = hash_combine(hash, background->corner_radii.top_right);
+  hash = hash_combine(hash, background->corner_radii.bottom_left);
+  hash = hash_combine(hash, background->corner_radii.bottom_right);
+  hash = hash_combine(hash, background->color.hex);
+  hash = hash_combine(hash, background->border_color.hex);
+
+  hash = hash_combine(hash, background->gradient.enabled);
+  if (background->gradient.enabled) {
+    hash = hash_combine(hash, background->gradient.type);
+    hash = hash_combine(hash, background->gradient.angle);
+    hash = hash_float(hash, background->gradient.radius_h);
+    hash = hash_float(hash, background->gradient.radius_v);
+    hash = hash_combine(hash, gradient_get_key(&background->gradient));
+  }
+
+  hash = shadow_get_key(&background->shadow, hash);
+  return image_get_key(&background->image, hash);
 }
 
 void background_draw(struct background* background, CGContextRef context) {
@@ -269,25 +325,25 @@ void background_draw(struct background* background, CGContextRef context) {
     return;
   }
 
-  CGRect background_bounds = background->bounds;
-  background_bounds.origin.x += background->x_offset;
-  background_bounds.origin.y += background->y_offset;
+  CGRect path_rect = background_get_path_rect(background);
+  CGPathRef path = rounded_rect_path_get(&background->shape,
+                                         path_rect,
+                                         &background->corner_radii);
+
   if (background->shadow.enabled) {
-    CGRect bounds = shadow_get_bounds(&background->shadow, background_bounds);
-    draw_rect(context,
-              bounds,
+    CGContextSaveGState(context);
+    CGContextTranslateCTM(context, background->shadow.offset.x,
+                                   background->shadow.offset.y );
+    draw_path(context,
+              path,
               &background->shadow.color,
-              &background->corner_radii,
               background->border_width,
               &background->shadow.color);
+    CGContextRestoreGState(context);
   }
 
   if (background->gradient.enabled) {
-    CGRect inset = CGRectInset(background_bounds,
-                               (float)(background->border_width) / 2.f,
-                               (float)(background->border_width) / 2.f);
-    gradient_draw(&background->gradient, context, inset,
-                  &background->corner_radii);
+    gradient_draw(&background->gradient, context, path_rect, path);
 
     if (background->border_width > 0 && background->border_color.a > 0) {
       CGContextSetLineWidth(context, background->border_width);
@@ -296,27 +352,17 @@ void background_draw(struct background* background, CGContextRef context) {
                                   background->border_color.g,
                                   background->border_color.b,
                                   background->border_color.a);
-      CGMutablePathRef path = CGPathCreateMutable();
-      CGRect inset_region = CGRectInset(background_bounds,
-                                         (float)(background->border_width) / 2.f,
-                                         (float)(background->border_width) / 2.f);
-      add_rounded_rect_path(path, inset_region,
-                           background->corner_radii.top_left,
-                           background->corner_radii.top_right,
-                           background->corner_radii.bottom_left,
-                           background->corner_radii.bottom_right);
       CGContextAddPath(context, path);
       CGContextStrokePath(context);
-      CFRelease(path);
     }
   } else {
-    draw_rect(context,
-              background_bounds,
+    draw_path(context,
+              path,
               &background->color,
-              &background->corner_radii,
               background->border_width,
               &background->border_color);
   }
+  CGPathRelease(path);
 
   if (background->image.enabled)
     image_draw(&background->image, context);
@@ -326,72 +372,55 @@ void background_draw(struct background* background, CGContextRef context) {
 void background_clear_pointers(struct background* background) {
   background->clips = NULL;
   background->num_clips = 0;
+  background->shape.path = NULL;
+  gradient_clear_pointers(&background->gradient);
   image_clear_pointers(&background->image);
 }
 
 void background_destroy(struct background* background) {
-  for (uint32_t i = 0; i < background->num_clips; i++)
-    free(background->clips[i]);
-
-  if (background->clips) free(background->clips);
+  background_free_clips(background);
 
+  rounded_rect_path_destroy(&background->shape);
   gradient_destroy(&background->gradient);
   image_destroy(&background->image);
   background_clear_pointers(background);
 }
 
-void background_serialize(struct background* background, char* indent, FILE* rsp, bool detailed) {
-  fprintf(rsp, "%s\"drawing\": \"%s\",\n"
-               "%s\"color\": \"0x%x\",\n"
-               "%s\"border_color\": \"0x%x\",\n"
-               "%s\"border_width\": %u,\n"
-               "%s\"height\": %u,\n",
-               indent, format_bool(background->enabled),
-               indent, background->color.hex,
-               indent, background->border_color.hex,
-               indent, background->border_width,
-               indent, background->overrides_height ? (int)background->bounds.size.height : 0);
-
-  fprintf(rsp, "%s\"corner_radius\": {\n"
-               "%s  \"top_left\": %u,\n"
-               "%s  \"top_right\": %u,\n"
-               "%s  \"bottom_left\": %u,\n"
-               "%s  \"bottom_right\": %u\n"
-               "%s},\n",
-               indent,
-               indent, background->corner_radii.top_left,
-               indent, background->corner_radii.top_right,
-               indent, background->corner_radii.bottom_left,
-               indent, background->corner_radii.bottom_right,
-               indent);
-
-  fprintf(rsp, "%s\"padding_left\": %d,\n"
-               "%s\"padding_right\": %d,\n"
-               "%s\"x_offset\": %d,\n"
-               "%s\"y_offset\": %d,\n"
-               "%s\"clip\": %f,\n",
-               indent, background->padding_left,
-               indent, background->padding_right,
-               indent, background->x_offset,
-               indent, background->y_offset,
-               indent, background->clip                                                       );
-
-  char deeper_indent[strlen(indent) + 2];
-  snprintf(deeper_indent, strlen(indent) + 2, "%s\t", indent);
-
-  fprintf(rsp, "%s\"image\": {\n", indent);
-  image_serialize(&background->image, deeper_indent, rsp);
-  fprintf(rsp, "\n%s}", indent);
-
-  fprintf(rsp, ",\n%s\"gradient\": {\n", indent);
-  gradient_serialize(&background->gradient, deeper_indent, rsp);
-  fprintf(rsp, "\n%s}", indent);
+void background_serialize(struct background* background, struct json* json, bool detailed) {
+  json_string(json, "drawing", format_bool(background->enabled));
+  json_color(json, "color", background->color.hex);
+  json_color(json, "border_color", background->border_color.hex);
+  json_uint(json, "border_width", background->border_width);
+  json_uint(json, "height", background->overrides_height
+                            ? (int)background->bounds.size.height
+                            : 0                                  );
+
+  json_object_begin(json, "corner_radius");
+  json_uint(json, "top_left", background->corner_radii.top_left);
+  json_uint(json, "top_right", background->corner_radii.top_right);
+  json_uint(json, "bottom_left", background->corner_radii.bottom_left);
+  json_uint(json, "bottom_right", background->corner_radii.bottom_right);
+  json_object_end(json);
+
+  json_int(json, "padding_left", background->padding_left);
+  json_int(json, "padding_right", background->padding_right);
+  json_int(json, "x_offset", background->x_offset);
+  json_int(json, "y_offset", background->y_offset);
+  json_float(json, "clip", background->clip, 6);
+
+  json_object_begin(json, "image");
+  image_serialize(&background->image, json);
+  json_object_end(json);
+
+  json_object_begin(json, "gradient");
+  gradient_serialize(&background->gradient, json);
+  json_object_end(json);
 
   if (!detailed) return;
 
-  fprintf(rsp, ",\n%s\"shadow\": {\n", indent);
-  shadow_serialize(&background->shadow, deeper_indent, rsp);
-  fprintf(rsp, "\n%s}", indent);
+  json_object_begin(json, "shadow");
+  shadow_serialize(&background->shadow, json);
+  json_object_end(json);
 }
 
 bool background_parse_sub_domain(struct background* background, FILE* rsp, struct token property, char* message) {
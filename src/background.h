@@ -23,11 +23,14 @@ struct background {
 
   struct background** clips;
   uint32_t num_clips;
+
+  struct rounded_rect_path shape;
 };
 
 struct bar;
 
 void background_init(struct background* background);
+void background_prepare(struct background* background);
 void background_calculate_bounds(struct background* background, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
 
 bool background_set_enabled(struct background* background, bool enabled);
@@ -36,6 +39,7 @@ bool background_set_height(struct background* background, uint32_t height);
 bool background_set_padding_left(struct background* background, uint32_t pad);
 bool background_set_padding_right(struct background* background, uint32_t pad);
 
+uint64_t background_get_key(struct background* background);
 void background_draw(struct background* background, CGContextRef context);
 
 struct background* background_get_clip(struct background* background, uint32_t adid);
@@ -46,5 +50,5 @@ bool background_clips_bar(struct background* background);
 void background_clear_pointers(struct background* background);
 void background_destroy(struct background* background);
 
-void background_serialize(struct background* background, char* indent, FILE* rsp, bool detailed);
+void background_serialize(struct background* background, struct json* json, bool detailed);
 bool background_parse_sub_domain(struct background* background, FILE* rsp, struct token property, char* message);
@@ -154,6 +154,7 @@ void bar_draw(struct bar* bar, bool forced, bool threaded) {
     bar_check_for_clip_updates(bar);
 
   if (g_bar_manager.bar_needs_update) {
+    gradient_prepare(&g_bar_manager.background.gradient);
     struct background background = g_bar_manager.background;
     background.bounds = bar->window.frame;
     background.bounds.origin.y -= background.y_offset;
@@ -213,7 +214,7 @@ void bar_draw(struct bar* bar, bool forced, bool threaded) {
                      context        );
     } else {
       CGContextClearRect(window->context, window->frame);
-      bar_item_draw(bar_item, window->context);
+      bar_item_draw(bar_item, window);
       CGContextFlush(window->context);
       window_flush(window);
     }
@@ -5,6 +5,7 @@
 #include "power.h"
 #include "media.h"
 #include "app_windows.h"
+#include "startup.h"
 
 struct bar_item* bar_item_create() {
   struct bar_item* bar_item = malloc(sizeof(struct bar_item));
@@ -33,6 +34,7 @@ void bar_item_init(struct bar_item* bar_item, struct bar_item* default_item) {
   bar_item->blur_radius = 0;
   bar_item->event_port = 0;
   bar_item->shadow = false;
+  bar_item->restored = false;
   bar_item->scroll_texts = false;
   bar_item->mouse_over = false;
 
@@ -110,10 +112,15 @@ void bar_item_reset_associated_bar(struct bar_item* bar_item) {
 bool bar_item_update(struct bar_item* bar_item, char* sender, bool forced, struct env_vars* env_vars) {
   bool is_shown = bar_item_is_shown(bar_item);
   if (is_shown && bar_item->scroll_texts && (bar_item->counter % 15 == 0)) {
+    struct bar_item* owner = g_bar_manager.animator.owner;
+    g_bar_manager.animator.owner = bar_item;
+    animator_set_property(&g_bar_manager.animator, PROPERTY_SCROLL_TEXTS);
     text_animate_scroll(&bar_item->icon);
     text_animate_scroll(&bar_item->label);
     if (bar_item->type == BAR_COMPONENT_SLIDER)
       text_animate_scroll(&bar_item->slider.knob);
+    animator_set_property(&g_bar_manager.animator, NULL);
+    g_bar_manager.animator.owner = owner;
   }
 
   bar_item->counter++;
@@ -157,7 +164,7 @@ bool bar_item_update(struct bar_item* bar_item, char* sender, bool forced, struc
     }
     // Script Update
     if (bar_item->script && strlen(bar_item->script) > 0) {
-      fork_exec(bar_item->script, env_vars);
+      startup_script(&g_startup, fork_exec_pid(bar_item->script, env_vars));
     }
 
     // Mach events
@@ -719,15 +726,59 @@ void bar_item_clip_bar(struct bar_item* bar_item, int offset, struct bar* bar) {
 void* draw_item_proc(void* context) {
   struct { struct window* window; struct bar_item bar_item; }* info = context;
   CGContextClearRect(info->window->context, info->window->frame);
-  bar_item_draw(&info->bar_item, info->window->context);
+  bar_item_draw(&info->bar_item, info->window);
   CGContextFlush(info->window->context);
   window_flush(info->window);
   free(context);
   return NULL;
 }
 
-void bar_item_draw(struct bar_item* bar_item, CGContextRef context) {
-  background_draw(&bar_item->background, context);
+// The item background is rendered into a layer owned by the window and only
+// re-rendered when its key changes, such that content updates (e.g. a label
+// changing every second) are drawn on top of a cached background.
+static void bar_item_draw_background(struct bar_item* bar_item, struct window* window) {
+  if (!bar_item->background.enabled) return;
+
+  uint64_t key = background_get_key(&bar_item->background);
+  key = hash_rect(key, window->frame);
+
+  if (window->layer) {
+    CGSize layer_size = CGLayerGetSize(window->layer);
+    if (!CGSizeEqualToSize(layer_size, window->frame.size)) {
+      CGLayerRelease(window->layer);
+      window->layer = NULL;
+    }
+  }
+
+  if (!window->layer) {
+    if (window->frame.size.width <= 0 || window->frame.size.height <= 0) {
+      return;
+    }
+    window->layer = CGLayerCreateWithContext(window->context,
+                                             window->frame.size,
+                                             NULL               );
+    if (!window->layer) {
+      background_draw(&bar_item->background, window->context);
+      return;
+    }
+    window->layer_key = ~key;
+  }
+
+  if (window->layer_key != key) {
+    CGContextRef layer_context = CGLayerGetContext(window->layer);
+    CGContextClearRect(layer_context, window->frame);
+    background_draw(&bar_item->background, layer_context);
+    window->layer_key = key;
+  }
+
+  CGContextDrawLayerAtPoint(window->context,
+                            window->frame.origin,
+                            window->layer        );
+}
+
+void bar_item_draw(struct bar_item* bar_item, struct window* window) {
+  CGContextRef context = window->context;
+  bar_item_draw_background(bar_item, window);
   if (bar_item->type == BAR_COMPONENT_GROUP) return;
 
   text_draw(&bar_item->icon, context);
@@ -766,6 +817,9 @@ void bar_item_inherit_from_item(struct bar_item* bar_item, struct bar_item* ance
   text_destroy(&bar_item->icon);
   text_destroy(&bar_item->label);
   text_destroy(&bar_item->slider.knob);
+
+  // Pending loads would otherwise complete into the inherited images
+  image_cancel_requests(&bar_item->background.image, false);
   
   char* name = bar_item->name;
   char* script = bar_item->script;
@@ -796,6 +850,26 @@ void bar_item_inherit_from_item(struct bar_item* bar_item, struct bar_item* ance
   image_copy(&bar_item->label.background.image,
              ancestor->label.background.image.image_ref);
 
+  gradient_copy(&bar_item->background.gradient,
+                &ancestor->background.gradient);
+
+  gradient_copy(&bar_item->icon.background.gradient,
+                &ancestor->icon.background.gradient);
+
+  gradient_copy(&bar_item->label.background.gradient,
+                &ancestor->label.background.gradient);
+
+  gradient_copy(&bar_item->slider.background.gradient,
+                &ancestor->slider.background.gradient);
+
+  gradient_copy(&bar_item->slider.foreground.gradient,
+                &ancestor->slider.foreground.gradient);
+
+  gradient_copy(&bar_item->popup.background.gradient,
+                &ancestor->popup.background.gradient);
+
+  graph_copy(&bar_item->graph, &ancestor->graph);
+
   if (bar_item->type == BAR_COMPONENT_SPACE) {
     env_vars_set(&bar_item->signal_args.env_vars,
                  string_copy("SELECTED"),
@@ -841,7 +915,7 @@ void bar_item_destroy(struct bar_item* bar_item, bool free_memory) {
   if (free_memory) free(bar_item);
 }
 
-void bar_item_serialize(struct bar_item* bar_item, FILE* rsp) {
+void bar_item_serialize(struct bar_item* bar_item, struct json* json) {
   char type[32] = { 0 };
   switch (bar_item->type) {
     case BAR_ITEM:
@@ -892,105 +966,90 @@ void bar_item_serialize(struct bar_item* bar_item, FILE* rsp) {
       break;
   }
 
-  fprintf(rsp, "{\n"
-               "\t\"name\": \"%s\",\n"
-               "\t\"type\": \"%s\",\n"
-               "\t\"geometry\": {\n"
-               "\t\t\"drawing\": \"%s\",\n"
-               "\t\t\"position\": \"%s\",\n"
-               "\t\t\"associated_space_mask\": %u,\n"
-               "\t\t\"associated_display_mask\": %u,\n"
-               "\t\t\"ignore_association\": \"%s\",\n"
-               "\t\t\"y_offset\": %d,\n"
-               "\t\t\"padding_left\": %d,\n"
-               "\t\t\"padding_right\": %d,\n"
-               "\t\t\"scroll_texts\": \"%s\",\n"
-               "\t\t\"width\": %d,\n"
-               "\t\t\"background\": {\n",
-               bar_item->name,
-               type,
-               format_bool(bar_item->drawing),
-               position,
-               bar_item->associated_space,
-               bar_item->associated_display,
-               format_bool(bar_item->ignore_association),
-               bar_item->y_offset,
-               bar_item->background.padding_left,
-               bar_item->background.padding_right,
-               format_bool(bar_item->scroll_texts),
-               bar_item->has_const_width ? bar_item->custom_width : -1);
-
-  background_serialize(&bar_item->background, "\t\t\t", rsp, true);
-  fprintf(rsp, "\n\t\t}\n\t},\n");
-
-  fprintf(rsp, "\t\"icon\": {\n");
-  text_serialize(&bar_item->icon, "\t\t", rsp);
-  fprintf(rsp, "\n\t},\n");
-
-  fprintf(rsp, "\t\"label\": {\n");
-  text_serialize(&bar_item->label, "\t\t", rsp);
-  fprintf(rsp, "\n\t},\n");
-
-
-  char* escaped_script = escape_string(bar_item->script);
-  char* escaped_click_script = escape_string(bar_item->click_script);
-  fprintf(rsp, "\t\"scripting\": {\n"
-               "\t\t\"script\": \"%s\",\n"
-               "\t\t\"click_script\": \"%s\",\n"
-               "\t\t\"update_freq\": %u,\n"
-               "\t\t\"update_mask\": %llu,\n"
-               "\t\t\"updates\": \"%s\"\n\t},\n",
-               escaped_script,
-               escaped_click_script,
-               bar_item->update_frequency,
-               bar_item->update_mask,
-               bar_item->updates_only_when_shown
-                ? "when_shown"
-                : format_bool(bar_item->updates) );
-
-  if (escaped_script) free(escaped_script);
-  if (escaped_click_script) free(escaped_click_script);
-
-  fprintf(rsp, "\t\"bounding_rects\": {\n");
-  int counter = 0;
+  json_object_begin(json, NULL);
+  json_string(json, "name", bar_item->name);
+  json_string(json, "type", type);
+
+  json_object_begin(json, "geometry");
+  json_string(json, "drawing", format_bool(bar_item->drawing));
+  json_string(json, "position", position);
+  json_uint(json, "associated_space_mask", bar_item->associated_space);
+  json_uint(json, "associated_display_mask", bar_item->associated_display);
+  json_string(json, "ignore_association",
+                    format_bool(bar_item->ignore_association));
+  json_int(json, "y_offset", bar_item->y_offset);
+  json_int(json, "padding_left", bar_item->background.padding_left);
+  json_int(json, "padding_right", bar_item->background.padding_right);
+  json_string(json, "scroll_texts", format_bool(bar_item->scroll_texts));
+  json_int(json, "width", bar_item->has_const_width
+                          ? bar_item->custom_width
+                          : -1                    );
+
+  json_object_begin(json, "background");
+  background_serialize(&bar_item->background, json, true);
+  json_object_end(json);
+  json_object_end(json);
+
+  json_object_begin(json, "icon");
+  text_serialize(&bar_item->icon, json);
+  json_object_end(json);
+
+  json_object_begin(json, "label");
+  text_serialize(&bar_item->label, json);
+  json_object_end(json);
+
+  json_object_begin(json, "scripting");
+  json_string(json, "script", bar_item->script);
+  json_string(json, "click_script", bar_item->click_script);
+  json_uint(json, "update_freq", bar_item->update_frequency);
+  json_uint(json, "update_mask", bar_item->update_mask);
+  json_string(json, "updates", bar_item->updates_only_when_shown
+                               ? "when_shown"
+                               : format_bool(bar_item->updates) );
+  json_object_end(json);
+
+  json_object_begin(json, "bounding_rects");
   for (int i = 0; i < bar_item->num_windows; i++) {
     if (!bar_item->windows[i]) continue;
-    if (counter++ > 0) fprintf(rsp, ",\n");
-    fprintf(rsp, "\t\t\"display-%d\": {\n"
-            "\t\t\t\"origin\": [ %f, %f ],\n"
-            "\t\t\t\"size\": [ %f, %f ]\n\t\t}",
-            i + 1,
-            bar_item->windows[i]->origin.x,
-            bar_item->windows[i]->origin.y,
-            bar_item->windows[i]->frame.size.width,
-            bar_item->windows[i]->frame.size.height);
-  } 
-  fprintf(rsp, "\n\t}");
+    char display[32];
+    snprintf(display, 32, "display-%d", i + 1);
+
+    json_object_begin(json, display);
+    json_array_begin(json, "origin");
+    json_float(json, NULL, bar_item->windows[i]->origin.x, 6);
+    json_float(json, NULL, bar_item->windows[i]->origin.y, 6);
+    json_array_end(json);
+    json_array_begin(json, "size");
+    json_float(json, NULL, bar_item->windows[i]->frame.size.width, 6);
+    json_float(json, NULL, bar_item->windows[i]->frame.size.height, 6);
+    json_array_end(json);
+    json_object_end(json);
+  }
+  json_object_end(json);
 
   if (bar_item->popup.num_items > 0) {
-    fprintf(rsp, ",\n\t\"popup\": {\n");
-    popup_serialize(&bar_item->popup, "\t\t", rsp);
-    fprintf(rsp, "\n\t}");
+    json_object_begin(json, "popup");
+    popup_serialize(&bar_item->popup, json);
+    json_object_end(json);
   }
 
   if (bar_item->type == BAR_COMPONENT_GROUP && bar_item->group) {
-    fprintf(rsp, ",\n\t\"bracket\": [\n");
-    group_serialize(bar_item->group, "\t\t", rsp);
-    fprintf(rsp, "\n\t]");
+    json_array_begin(json, "bracket");
+    group_serialize(bar_item->group, json);
+    json_array_end(json);
   } else if (bar_item->type == BAR_COMPONENT_GRAPH) {
-    fprintf(rsp, ",\n\t\"graph\": {\n");
-    graph_serialize(&bar_item->graph, "\t\t", rsp);
-    fprintf(rsp, "\n\t}");
+    json_object_begin(json, "graph");
+    graph_serialize(&bar_item->graph, json);
+    json_object_end(json);
   } else if (bar_item->type == BAR_COMPONENT_SLIDER) {
-    fprintf(rsp, ",\n\t\"slider\": {\n");
-    slider_serialize(&bar_item->slider, "\t\t", rsp);
-    fprintf(rsp, "\n\t}");
+    json_object_begin(json, "slider");
+    slider_serialize(&bar_item->slider, json);
+    json_object_end(json);
   }
-
-  fprintf(rsp, "\n}\n");
+  json_object_end(json);
 }
 
-void bar_item_parse_set_message(struct bar_item* bar_item, char* message, FILE* rsp) {
+static void bar_item_apply_set_message(struct bar_item* bar_item, char* message, FILE* rsp) {
   bool needs_refresh = false;
   struct token property = get_token(&message);
 
@@ -1245,6 +1304,18 @@ void bar_item_parse_set_message(struct bar_item* bar_item, char* message, FILE*
   if (needs_refresh) bar_item_needs_update(bar_item);
 }
 
+void bar_item_parse_set_message(struct bar_item* bar_item, char* message, FILE* rsp) {
+  struct bar_item* owner = g_bar_manager.animator.owner;
+  g_bar_manager.animator.owner = bar_item != &g_bar_manager.default_item
+                                 ? bar_item
+                                 : NULL;
+
+  animator_set_property(&g_bar_manager.animator, message);
+  bar_item_apply_set_message(bar_item, message, rsp);
+  animator_set_property(&g_bar_manager.animator, NULL);
+  g_bar_manager.animator.owner = owner;
+}
+
 void bar_item_parse_subscribe_message(struct bar_item* bar_item, char* message, FILE* rsp) {
   struct token event = get_token(&message);
 
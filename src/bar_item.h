@@ -22,6 +22,9 @@ struct bar_item {
   char type;
   char* name;
 
+  // Restored from the snapshot and not yet claimed by an --add or --clone
+  bool restored;
+
   // Update Modifiers
   uint32_t counter;
   bool needs_update;
@@ -99,7 +102,7 @@ struct bar_item {
 struct bar_item* bar_item_create();
 void bar_item_inherit_from_item(struct bar_item* bar_item, struct bar_item* ancestor);
 void bar_item_init(struct bar_item* bar_item, struct bar_item* default_item);
-void bar_item_serialize(struct bar_item* bar_item, FILE* rsp);
+void bar_item_serialize(struct bar_item* bar_item, struct json* json);
 void bar_item_destroy(struct bar_item* bar_item, bool free_memory);
 
 bool bar_item_is_shown(struct bar_item* bar_item);
@@ -133,7 +136,7 @@ void bar_item_remove_window(struct bar_item* bar_item, uint32_t adid);
 CGPoint bar_item_calculate_shadow_offsets(struct bar_item* bar_item);
 uint32_t bar_item_calculate_bounds(struct bar_item* bar_item, uint32_t bar_height, uint32_t x, uint32_t y);
 void* draw_item_proc(void* context);
-void bar_item_draw(struct bar_item* bar_item, CGContextRef context);
+void bar_item_draw(struct bar_item* bar_item, struct window* window);
 bool bar_item_clip_needs_update_for_bar(struct bar_item* bar_item, struct bar* bar);
 void bar_item_clip_bar(struct bar_item* bar_item, int offset, struct bar* bar);
 bool bar_item_clips_bar(struct bar_item* bar_item);
@@ -10,6 +10,7 @@
 #include "mouse.h"
 #include "media.h"
 #include "app_windows.h"
+#include "startup.h"
 
 extern void forced_front_app_event();
 
@@ -32,7 +33,7 @@ void bar_manager_init(struct bar_manager* bar_manager) {
   bar_manager->shadow = false;
   bar_manager->blur_radius = 0;
   bar_manager->margin = 0;
-  bar_manager->frozen = false;
+  bar_manager->frozen = 0;
   bar_manager->sleeps = false;
   bar_manager->window_level = kCGBackstopMenuLevel;
   bar_manager->topmost = false;
@@ -61,6 +62,12 @@ void bar_manager_init(struct bar_manager* bar_manager) {
   custom_events_init(&bar_manager->custom_events);
 
   animator_init(&bar_manager->animator);
+  watch_list_init(&bar_manager->watch_list);
+  snapshot_init(&bar_manager->snapshot);
+  snapshot_init(&bar_manager->config);
+  snapshot_init(&bar_manager->shadow);
+  bar_manager->reconciling = false;
+  bar_manager->restoring = false;
 
   int shell_refresh_frequency = 1;
 
@@ -177,6 +184,7 @@ void bar_manager_remove_item(struct bar_manager* bar_manager, struct bar_item* b
            sizeof(struct bar_item*)*bar_manager->bar_item_count);
   }
 
+  animator_cancel_owner(&bar_manager->animator, bar_item);
   bar_item_destroy(bar_item, true);
 }
 
@@ -315,11 +323,11 @@ bool bar_manager_set_sticky(struct bar_manager *bar_manager, bool sticky) {
 }
 
 void bar_manager_freeze(struct bar_manager *bar_manager) {
-  bar_manager->frozen = true;
+  bar_manager->frozen++;
 }
 
 void bar_manager_unfreeze(struct bar_manager *bar_manager) {
-  bar_manager->frozen = false;
+  if (bar_manager->frozen > 0) bar_manager->frozen--;
 }
 
 uint32_t bar_manager_length_for_bar_side(struct bar_manager* bar_manager, struct bar* bar, char side) {
@@ -434,19 +442,24 @@ void bar_manager_refresh(struct bar_manager* bar_manager, bool forced, bool thre
 
   if (forced || bar_manager->bar_needs_resize) bar_manager_resize(bar_manager);
 
+  bool drawn = false;
   for (int i = 0; i < bar_manager->bar_count; ++i) {
     if (forced
         || bar_manager_bar_needs_redraw(bar_manager, bar_manager->bars[i])) {
       bar_calculate_bounds(bar_manager->bars[i]);
       bar_draw(bar_manager->bars[i], false, threaded);
+      drawn = true;
       if (bar_manager->needs_ordering) {
         bar_order_item_windows(bar_manager->bars[i]);
       }
     }
   }
 
+  watch_list_flush(&bar_manager->watch_list, bar_manager->bar_items,
+                                             bar_manager->bar_item_count);
   bar_manager_clear_needs_update(bar_manager);
   if (threaded) join_render_threads();
+  if (drawn) startup_frame(&g_startup);
 }
 
 void bar_manager_resize(struct bar_manager* bar_manager) {
@@ -527,14 +540,16 @@ void bar_manager_update_space_components(struct bar_manager* bar_manager, bool f
 }
 
 void bar_manager_animator_refresh(struct bar_manager* bar_manager, uint64_t time) {
+  uint64_t start = animator_get_time(&bar_manager->animator);
   bar_manager_freeze(bar_manager);
-  if (animator_update(&bar_manager->animator, time)) {
-    bar_manager_unfreeze(bar_manager);
-
+  bool needs_refresh = animator_update(&bar_manager->animator, time);
+  bar_manager_unfreeze(bar_manager);
+  if (needs_refresh) {
     if (bar_manager->bar_needs_resize) bar_manager_resize(bar_manager);
     bar_manager_refresh(bar_manager, false, true);
   }
-  bar_manager_unfreeze(bar_manager);
+  animator_record_frame(&bar_manager->animator, start, needs_refresh);
+  animator_frame_done(&bar_manager->animator);
 }
 
 void bar_manager_update(struct bar_manager* bar_manager, bool forced) {
@@ -565,6 +580,8 @@ void bar_manager_update(struct bar_manager* bar_manager, bool forced) {
   }
 
   if (needs_refresh || forced) bar_manager_refresh(bar_manager, forced, false);
+  else watch_list_flush(&bar_manager->watch_list, bar_manager->bar_items,
+                                                  bar_manager->bar_item_count);
 }
 
 void bar_manager_reset(struct bar_manager* bar_manager) {
@@ -780,7 +797,7 @@ void bar_manager_display_changed(struct bar_manager* bar_manager) {
 
   bar_manager_handle_display_change(bar_manager);
   bar_manager_handle_space_change(bar_manager, true);
-  animator_renew_display_link(&bar_manager->animator);
+  animator_renew_frame_source(&bar_manager->animator);
 }
 
 void bar_manager_cancel_drag(struct bar_manager* bar_manager) {
@@ -921,6 +938,18 @@ void bar_manager_handle_media_cover_change(struct bar_manager* bar_manager, CGIm
   if (needs_refresh) bar_manager_refresh(bar_manager, false, false);
 }
 
+void bar_manager_handle_image_loaded(struct bar_manager* bar_manager, struct image_request* request) {
+  // Requests of removed items are cancelled, hence the owner is still valid
+  // if the request completes
+  struct bar_item* owner = request->owner;
+  struct image* image = image_request_complete(request, NULL);
+  if (!image) return;
+
+  if (owner) bar_item_needs_update(owner);
+  else bar_manager->bar_needs_update = true;
+  bar_manager_refresh(bar_manager, false, false);
+}
+
 void bar_manager_handle_front_app_switch(struct bar_manager* bar_manager, char* info) {
   struct env_vars env_vars;
   env_vars_init(&env_vars);
@@ -1020,7 +1049,7 @@ void bar_manager_handle_system_will_sleep(struct bar_manager* bar_manager) {
   bar_manager_custom_events_trigger(bar_manager,
                                     COMMAND_SUBSCRIBE_SYSTEM_WILL_SLEEP,
                                     NULL                                );
-  animator_destroy_display_link(&bar_manager->animator);
+  animator_stop_frame_source(&bar_manager->animator);
   bar_manager->sleeps = true;
 }
 
@@ -1072,6 +1101,10 @@ void bar_manager_destroy(struct bar_manager* bar_manager) {
   }
 
   animator_destroy(&bar_manager->animator);
+  watch_list_destroy(&bar_manager->watch_list);
+  snapshot_destroy(&bar_manager->snapshot);
+  snapshot_destroy(&bar_manager->config);
+  snapshot_destroy(&bar_manager->shadow);
 
   while (bar_manager->bar_item_count > 0) {
     bar_manager_remove_item(bar_manager, bar_manager->bar_items[0]);
@@ -1096,35 +1129,28 @@ void bar_manager_destroy(struct bar_manager* bar_manager) {
   image_destroy(&bar_manager->current_artwork);
 }
 
-void bar_manager_serialize(struct bar_manager* bar_manager, FILE* rsp) {
-  char indent[] = { "\t" };
-  fprintf(rsp, "{\n"
-               "%s\"position\": \"%s\",\n"
-               "%s\"topmost\": \"%s\",\n"
-               "%s\"sticky\": \"%s\",\n"
-               "%s\"hidden\": \"%s\",\n"
-               "%s\"shadow\": \"%s\",\n"
-               "%s\"font_smoothing\": \"%s\",\n"
-               "%s\"show_in_fullscreen\": \"%s\",\n"
-               "%s\"blur_radius\": %u,\n"
-               "%s\"margin\": %d,\n",
-               indent, bar_manager->position == POSITION_BOTTOM
-                                              ? "bottom" : "top",
-               indent, format_bool(bar_manager->topmost),
-               indent, format_bool(bar_manager->sticky),
-               indent, format_bool(bar_manager->any_bar_hidden),
-               indent, format_bool(bar_manager->shadow),
-               indent, format_bool(bar_manager->font_smoothing),
-               indent, format_bool(bar_manager->show_in_fullscreen),
-               indent, bar_manager->blur_radius,
-               indent, bar_manager->margin         );
-
-  background_serialize(&bar_manager->background, indent, rsp, false);
-
-  fprintf(rsp, ",\n%s\"items\": [\n", indent);
+void bar_manager_serialize(struct bar_manager* bar_manager, struct json* json) {
+  json_object_begin(json, NULL);
+  json_string(json, "position", bar_manager->position == POSITION_BOTTOM
+                                ? "bottom" : "top"                     );
+  json_string(json, "topmost", format_bool(bar_manager->topmost));
+  json_string(json, "sticky", format_bool(bar_manager->sticky));
+  json_string(json, "hidden", format_bool(bar_manager->any_bar_hidden));
+  json_string(json, "shadow", format_bool(bar_manager->shadow));
+  json_string(json, "font_smoothing", format_bool(bar_manager->font_smoothing));
+  json_string(json, "show_in_fullscreen",
+                    format_bool(bar_manager->show_in_fullscreen));
+  json_uint(json, "blur_radius", bar_manager->blur_radius);
+  json_uint(json, "animation_fps", bar_manager->animator.max_fps);
+  json_uint(json, "animation_clock", bar_manager->animator.virtual_rate);
+  json_int(json, "margin", bar_manager->margin);
+
+  background_serialize(&bar_manager->background, json, false);
+
+  json_array_begin(json, "items");
   for (int i = 0; i < bar_manager->bar_item_count; i++) {
-    fprintf(rsp, "%s\t \"%s\"", indent, bar_manager->bar_items[i]->name);
-    if (i < bar_manager->bar_item_count - 1) fprintf(rsp, ",\n");
+    json_string(json, NULL, bar_manager->bar_items[i]->name);
   }
-  fprintf(rsp, "\n%s]\n}\n", indent);
+  json_array_end(json);
+  json_object_end(json);
 }
@@ -2,6 +2,8 @@
 #include "bar.h"
 #include "bar_item.h"
 #include "animation.h"
+#include "watch.h"
+#include "snapshot.h"
 
 #define CLOCK_CALLBACK(name) void name(CFRunLoopTimerRef timer, void *context)
 typedef CLOCK_CALLBACK(clock_callback);
@@ -15,7 +17,8 @@ typedef CLOCK_CALLBACK(clock_callback);
 struct bar_manager {
   CFRunLoopTimerRef clock;
 
-  bool frozen;
+  // Nesting depth of freezes, batches can be loaded from within a batch
+  uint32_t frozen;
   bool sleeps;
   bool shadow;
   bool topmost;
@@ -51,6 +54,16 @@ struct bar_manager {
   struct custom_events custom_events;
 
   struct animator animator;
+  struct watch_list watch_list;
+  struct snapshot snapshot;
+
+  // Commands of the last config run and of a config run being reconciled
+  struct snapshot config;
+  struct snapshot shadow;
+  bool reconciling;
+
+  // Set while the snapshot is replayed, the items it creates are provisional
+  bool restoring;
   struct image current_artwork;
 };
 
@@ -125,8 +138,9 @@ void bar_manager_handle_power_source_change(struct bar_manager* bar_manager, cha
 void bar_manager_handle_media_change(struct bar_manager* bar_manager, char* info);
 void bar_manager_handle_media_cover_change(struct bar_manager* bar_manager, CGImageRef image);
 void bar_manager_handle_space_windows_change(struct bar_manager* bar_manager, char* info);
+void bar_manager_handle_image_loaded(struct bar_manager* bar_manager, struct image_request* request);
 void bar_manager_custom_events_trigger(struct bar_manager* bar_manager, char* name, struct env_vars* env_vars);
 
 void bar_manager_destroy(struct bar_manager* bar_manager);
 
-void bar_manager_serialize(struct bar_manager* bar_manager, FILE* rsp);
+void bar_manager_serialize(struct bar_manager* bar_manager, struct json* json);
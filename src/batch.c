@@ -0,0 +1,283 @@
+#include "batch.h"
+#include "snapshot.h"
+#include "misc/tokens.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern char g_name[256];
+
+// A declarative config is a list of commands in the syntax of the command
+// line, e.g.
+//   PLUGIN_DIR="$CONFIG_DIR/plugins"
+//   --add item clock right
+//   --set clock update_freq=10 script="$PLUGIN_DIR/clock.sh"
+// Lines may start with the program name and are continued by a trailing
+// backslash, # starts a comment and variables are expanded outside of single
+// quotes. A snapshot file is accepted as its compiled form.
+
+struct batch_buffer {
+  char* data;
+  uint32_t length;
+  uint32_t capacity;
+};
+
+static void batch_append(struct batch_buffer* buffer, const char* data, uint32_t length) {
+  if (buffer->length + length + 2 > buffer->capacity) {
+    buffer->capacity = (buffer->length + length + 2) * 2;
+    buffer->data = realloc(buffer->data, buffer->capacity);
+  }
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+}
+
+// Variables assigned by the config, they shadow the environment of the bar
+// but are never exported to it
+struct batch_variables {
+  char** names;
+  char** values;
+  uint32_t count;
+};
+
+static char* batch_variable(struct batch_variables* variables, char* name) {
+  for (uint32_t i = variables->count; i > 0; i--) {
+    if (strcmp(variables->names[i - 1], name) == 0)
+      return variables->values[i - 1];
+  }
+  return getenv(name);
+}
+
+static void batch_assign(struct batch_variables* variables, char* name, char* value) {
+  variables->names = realloc(variables->names,
+                             sizeof(char*) * (variables->count + 1));
+  variables->values = realloc(variables->values,
+                              sizeof(char*) * (variables->count + 1));
+  variables->names[variables->count] = string_copy(name);
+  variables->values[variables->count] = string_copy(value);
+  variables->count++;
+}
+
+static void batch_variables_destroy(struct batch_variables* variables) {
+  for (uint32_t i = 0; i < variables->count; i++) {
+    free(variables->names[i]);
+    free(variables->values[i]);
+  }
+  if (variables->names) free(variables->names);
+  if (variables->values) free(variables->values);
+}
+
+static bool batch_is_identifier(char c, bool first) {
+  return c == '_' || isalpha((unsigned char)c)
+                  || (!first && isdigit((unsigned char)c));
+}
+
+// Expands $NAME or ${NAME} at the cursor
+static char* batch_expand(char* cursor, struct batch_buffer* token, struct batch_variables* variables) {
+  bool braced = cursor[1] == '{';
+  char* name = cursor + (braced ? 2 : 1);
+  char* end = name;
+  while (batch_is_identifier(*end, end == name)) end++;
+
+  if (end == name || (braced && *end != '}')) {
+    batch_append(token, "$", 1);
+    return cursor + 1;
+  }
+
+  char variable[256];
+  uint32_t length = end - name < sizeof(variable) ? end - name
+                                                  : sizeof(variable) - 1;
+  memcpy(variable, name, length);
+  variable[length] = '\0';
+
+  char* value = batch_variable(variables, variable);
+  if (value) batch_append(token, value, strlen(value));
+  return braced ? end + 1 : end;
+}
+
+// Splits a logical line into NUL terminated words, returns false on an
+// unterminated quote
+static bool batch_split(char* line, struct batch_buffer* words, uint32_t* count, struct batch_variables* variables) {
+  struct batch_buffer token = { 0 };
+  char* cursor = line;
+  bool success = true;
+  *count = 0;
+
+  while (*cursor) {
+    while (*cursor == ' ' || *cursor == '\t') cursor++;
+    if (!*cursor || *cursor == '#') break;
+
+    token.length = 0;
+    while (*cursor && *cursor != ' ' && *cursor != '\t') {
+      if (*cursor == '\'') {
+        char* end = strchr(cursor + 1, '\'');
+        if (!end) {
+          success = false;
+          break;
+        }
+        batch_append(&token, cursor + 1, end - cursor - 1);
+        cursor = end + 1;
+      } else if (*cursor == '"') {
+        cursor++;
+        while (*cursor && *cursor != '"') {
+          if (*cursor == '\\' && cursor[1] && strchr("\"\\$", cursor[1])) {
+            batch_append(&token, cursor + 1, 1);
+            cursor += 2;
+          } else if (*cursor == '$') {
+            cursor = batch_expand(cursor, &token, variables);
+          } else {
+            batch_append(&token, cursor++, 1);
+          }
+        }
+        if (!*cursor) {
+          success = false;
+          break;
+        }
+        cursor++;
+      } else if (*cursor == '\\' && cursor[1]) {
+        batch_append(&token, cursor + 1, 1);
+        cursor += 2;
+      } else if (*cursor == '$') {
+        cursor = batch_expand(cursor, &token, variables);
+      } else {
+        batch_append(&token, cursor++, 1);
+      }
+    }
+    if (!success) break;
+
+    // Empty words would terminate the batch early
+    if (token.length == 0) continue;
+    batch_append(words, token.data, token.length);
+    batch_append(words, "", 1);
+    (*count)++;
+  }
+
+  if (token.data) free(token.data);
+  return success;
+}
+
+static bool batch_is_assignment(char* word) {
+  char* cursor = word;
+  while (batch_is_identifier(*cursor, cursor == word)) cursor++;
+  return cursor != word && *cursor == '=';
+}
+
+static char* batch_parse(char* text, uint32_t* error_line) {
+  struct batch_buffer batch = { 0 };
+  struct batch_buffer line = { 0 };
+  struct batch_buffer words = { 0 };
+  struct batch_variables variables = { 0 };
+  uint32_t line_number = 0;
+  uint32_t first_line = 1;
+  char* cursor = text;
+
+  while (*cursor) {
+    char* end = strchr(cursor, '\n');
+    if (!end) end = cursor + strlen(cursor);
+    uint32_t length = end - cursor;
+    if (length > 0 && cursor[length - 1] == '\r') length--;
+    line_number++;
+
+    // A trailing backslash continues the command on the next line
+    bool continued = length > 0 && cursor[length - 1] == '\\';
+    if (line.length == 0) first_line = line_number;
+    batch_append(&line, cursor, continued ? length - 1 : length);
+    cursor = *end ? end + 1 : end;
+    if (continued && *cursor) continue;
+
+    batch_append(&line, "", 1);
+    words.length = 0;
+    uint32_t count;
+    if (!batch_split(line.data, &words, &count, &variables)) {
+      *error_line = first_line;
+      free(line.data);
+      if (words.data) free(words.data);
+      if (batch.data) free(batch.data);
+      batch_variables_destroy(&variables);
+      return NULL;
+    }
+    line.length = 0;
+
+    char* word = words.data;
+    char* words_end = words.data + words.length;
+    if (count > 0 && (strcmp(word, g_name) == 0
+                      || strcmp(word, "sketchybar") == 0)) {
+      word += strlen(word) + 1;
+      if (word < words_end && (strcmp(word, "-m") == 0
+                               || strcmp(word, "--message") == 0)) {
+        word += strlen(word) + 1;
+      }
+    } else if (count == 1 && batch_is_assignment(word)) {
+      char* value = strchr(word, '=');
+      *value++ = '\0';
+      batch_assign(&variables, word, value);
+      continue;
+    }
+
+    if (word < words_end) batch_append(&batch, word, words_end - word);
+  }
+
+  if (line.data) free(line.data);
+  if (words.data) free(words.data);
+  batch_variables_destroy(&variables);
+  batch_append(&batch, "\0", 2);
+  return batch.data;
+}
+
+static bool batch_is_compiled(FILE* file) {
+  uint32_t magic = 0;
+  bool compiled = fread(&magic, sizeof(uint32_t), 1, file) == 1
+                  && magic == SNAPSHOT_MAGIC;
+  rewind(file);
+  return compiled;
+}
+
+bool batch_is_config(char* path) {
+  uint32_t length = strlen(path);
+  uint32_t extension = strlen(BATCH_EXTENSION);
+  if (length > extension
+      && strcmp(path + length - extension, BATCH_EXTENSION) == 0) {
+    return true;
+  }
+
+  FILE* file = fopen(path, "rb");
+  if (!file) return false;
+  bool compiled = batch_is_compiled(file);
+  fclose(file);
+  return compiled;
+}
+
+// Reads a declarative or compiled config into a single batch message.
+// Returns NULL if the file can not be read or, with the line number set,
+// if it contains a syntax error.
+char* batch_read(char* path, uint32_t* error_line) {
+  *error_line = 0;
+  FILE* file = fopen(path, "rb");
+  if (!file) return NULL;
+
+  if (batch_is_compiled(file)) {
+    fclose(file);
+    return snapshot_read(path, NULL);
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size < 0) {
+    fclose(file);
+    return NULL;
+  }
+
+  char* text = malloc(size + 1);
+  if (fread(text, 1, size, file) != size) {
+    fclose(file);
+    free(text);
+    return NULL;
+  }
+  fclose(file);
+  text[size] = '\0';
+
+  char* batch = batch_parse(text, error_line);
+  free(text);
+  return batch;
+}
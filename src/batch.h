@@ -0,0 +1,11 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BATCH_EXTENSION ".batch"
+
+// Batches may --load further batches up to this nesting depth
+#define BATCH_MAX_DEPTH 8
+
+bool batch_is_config(char* path);
+char* batch_read(char* path, uint32_t* error_line);
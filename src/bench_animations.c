@@ -0,0 +1,93 @@
+#include "bar_manager.h"
+#include "event.h"
+#include "message.h"
+#include "text_cache.h"
+#include "image_cache.h"
+#include "startup.h"
+#include <libgen.h>
+
+// Replays a batch script (e.g. a sequence of --animate ... --set ...
+// commands) against a headless bar and steps the animator on a stepped
+// clock until all animations have finished, or for max_frames when they
+// repeat forever. Every frame prints its time and cost followed by the
+// applied values, such that trajectories can be diffed between runs:
+//   bench_animations <script> [rate] [max_frames]
+
+#define BENCH_DEFAULT_RATE       60
+#define BENCH_DEFAULT_MAX_FRAMES 100000
+
+extern int SLSMainConnectionID(void);
+extern int SLSGetSpaceManagementMode(int cid);
+
+int g_connection;
+CFTypeRef g_transaction;
+int g_space_management_mode;
+
+struct bar_manager g_bar_manager;
+struct text_cache g_text_cache;
+struct image_cache g_image_cache;
+struct startup g_startup;
+struct mach_server g_mach_server;
+void *g_workspace_context;
+
+char g_name[256];
+char g_config_file[4096];
+char g_lock_file[MAXLEN];
+bool g_volume_events;
+bool g_brightness_events;
+int64_t g_disable_capture = 0;
+pid_t g_pid = 0;
+
+int main(int argc, char **argv) {
+  snprintf(g_name, sizeof(g_name), "%s", basename(argv[0]));
+  if (argc < 2) {
+    printf("Usage: %s <script> [rate] [max_frames]\n", g_name);
+    return EXIT_FAILURE;
+  }
+
+  uint32_t rate = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_RATE;
+  uint32_t max_frames = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_MAX_FRAMES;
+  if (!rate) {
+    printf("[!] Error: Invalid rate '%s'.\n", argv[2]);
+    return EXIT_FAILURE;
+  }
+
+  g_connection = SLSMainConnectionID();
+  g_space_management_mode = SLSGetSpaceManagementMode(g_connection);
+  startup_init(&g_startup);
+
+  struct event init = { NULL, INIT_MUTEX };
+  event_post(&init);
+
+  text_cache_init(&g_text_cache);
+  image_cache_init(&g_image_cache);
+  bar_manager_init(&g_bar_manager);
+
+  struct animator* animator = &g_bar_manager.animator;
+  animator_set_stepped_clock(animator, rate);
+  if (!handle_batch_file(argv[1], 0, stderr)) return EXIT_FAILURE;
+
+  animator->trace = stdout;
+  uint32_t frame = 0;
+  while (animator->animation_count > 0 && frame < max_frames) {
+    printf("frame\t%u\t%.3f\n", frame++,
+                                1000.0 * (animator->virtual_time
+                                          + NSEC_PER_SEC / rate)
+                                / NSEC_PER_SEC                    );
+    uint64_t start = animator_get_time(animator);
+    animator_advance(animator, 1);
+    printf("cost_us\t%.3f\n", 1e6 * (animator_get_time(animator) - start)
+                                  / animator->clock                      );
+  }
+  animator->trace = NULL;
+
+  struct json json;
+  json_init(&json);
+  json_object_begin(&json, NULL);
+  animator_serialize(animator, &json);
+  json_object_end(&json);
+  json_flush(&json, stdout);
+  json_destroy(&json);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+#define _POSIX_C_SOURCE 200809L
+#include "gradient_fill.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Fills a bar sized buffer with a multi-stop gradient through the lookup
+// table kernel and through a per-pixel reference that searches the stops
+// and interpolates for every pixel, and reports the cost per fill and the
+// largest channel difference between both:
+//   bench_gradient [width] [height] [stops] [fills]
+// The defaults match a 1800pt bar of 32pt on a 2x display with the
+// 8 stop gradient of a typical sketchybarrc.
+
+#define BENCH_DEFAULT_WIDTH  3600
+#define BENCH_DEFAULT_HEIGHT 64
+#define BENCH_DEFAULT_STOPS  8
+#define BENCH_DEFAULT_FILLS  200
+
+static uint64_t bench_now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+static uint32_t bench_reference_color(struct gradient_lut_stop* stops, uint32_t count, float t) {
+  t = t < 0.f ? 0.f : (t > 1.f ? 1.f : t);
+  uint32_t next = 0;
+  while (next < count && stops[next].position <= t) next++;
+
+  uint32_t from = next > 0 ? stops[next - 1].color : stops[0].color;
+  uint32_t to = next < count ? stops[next].color : from;
+  float fraction = 0.f;
+  if (next > 0 && next < count) {
+    fraction = (t - stops[next - 1].position)
+               / (stops[next].position - stops[next - 1].position);
+  }
+
+  float channels[4];
+  for (uint32_t c = 0; c < 4; c++) {
+    float a = (from >> (24 - 8 * c)) & 0xff;
+    float b = (to >> (24 - 8 * c)) & 0xff;
+    channels[c] = a + fraction * (b - a);
+  }
+  float alpha = channels[0] / 255.f;
+  return ((uint32_t)(channels[0] + .5f) << 24)
+         | ((uint32_t)(channels[1] * alpha + .5f) << 16)
+         | ((uint32_t)(channels[2] * alpha + .5f) << 8)
+         | (uint32_t)(channels[3] * alpha + .5f);
+}
+
+static void bench_reference_linear(struct gradient_lut_stop* stops, uint32_t count, uint32_t* pixels, uint32_t width, uint32_t height, float start_x, float start_y, float end_x, float end_y) {
+  float dx = end_x - start_x;
+  float dy = end_y - start_y;
+  float length = dx * dx + dy * dy;
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t x = 0; x < width; x++) {
+      float t = ((x + .5f - start_x) * dx + (y + .5f - start_y) * dy) / length;
+      pixels[(size_t)y * width + x] = bench_reference_color(stops, count, t);
+    }
+  }
+}
+
+static void bench_reference_radial(struct gradient_lut_stop* stops, uint32_t count, uint32_t* pixels, uint32_t width, uint32_t height, float center_x, float center_y, float radius_h, float radius_v) {
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t x = 0; x < width; x++) {
+      float u = (x + .5f - center_x) / radius_h;
+      float v = (y + .5f - center_y) / radius_v;
+      pixels[(size_t)y * width + x] = bench_reference_color(stops,
+                                                            count,
+                                                            sqrtf(u*u + v*v));
+    }
+  }
+}
+
+static uint32_t bench_max_difference(uint32_t* a, uint32_t* b, size_t count) {
+  uint32_t difference = 0;
+  for (size_t i = 0; i < count; i++) {
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+      int channel = (int)((a[i] >> shift) & 0xff) - (int)((b[i] >> shift) & 0xff);
+      if ((uint32_t)abs(channel) > difference) difference = abs(channel);
+    }
+  }
+  return difference;
+}
+
+int main(int argc, char **argv) {
+  uint32_t width = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_WIDTH;
+  uint32_t height = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_HEIGHT;
+  uint32_t count = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_STOPS;
+  uint32_t fills = argc > 4 ? atoi(argv[4]) : BENCH_DEFAULT_FILLS;
+  if (!width || !height || count < 2 || !fills) {
+    printf("Usage: %s [width] [height] [stops >= 2] [fills]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct gradient_lut_stop* stops = malloc(sizeof(struct gradient_lut_stop)
+                                           * count                         );
+  for (uint32_t i = 0; i < count; i++) {
+    stops[i].position = (float)i / (count - 1);
+    stops[i].color = (0x80u + i * 0x7f / (count - 1)) << 24
+                     | (i * 2654435761u >> 8 & 0xffffff);
+  }
+
+  size_t size = (size_t)width * height;
+  uint32_t* pixels = malloc(sizeof(uint32_t) * size);
+  uint32_t* reference = malloc(sizeof(uint32_t) * size);
+
+  struct gradient_lut lut;
+  uint64_t start = bench_now();
+  for (uint32_t i = 0; i < fills; i++) gradient_lut_build(&lut, stops, count);
+  uint64_t lut_cost = bench_now() - start;
+
+  // A shallow diagonal, as the angle of a bar gradient produces
+  float start_x = 0.f, start_y = 0.f, end_x = width, end_y = height;
+  start = bench_now();
+  for (uint32_t i = 0; i < fills; i++) {
+    gradient_fill_linear(&lut, pixels, width, height, width,
+                         start_x, start_y, end_x, end_y     );
+  }
+  uint64_t linear_cost = bench_now() - start;
+
+  start = bench_now();
+  bench_reference_linear(stops, count, reference, width, height,
+                         start_x, start_y, end_x, end_y         );
+  uint64_t linear_reference = bench_now() - start;
+  uint32_t linear_error = bench_max_difference(pixels, reference, size);
+
+  float center_x = width / 2.f, center_y = height / 2.f;
+  start = bench_now();
+  for (uint32_t i = 0; i < fills; i++) {
+    gradient_fill_radial(&lut, pixels, width, height, width,
+                         center_x, center_y, center_x, center_y);
+  }
+  uint64_t radial_cost = bench_now() - start;
+
+  start = bench_now();
+  bench_reference_radial(stops, count, reference, width, height,
+                         center_x, center_y, center_x, center_y );
+  uint64_t radial_reference = bench_now() - start;
+  uint32_t radial_error = bench_max_difference(pixels, reference, size);
+
+  printf("pixels\t%zu\tstops\t%u\n", size, count);
+  printf("lut_us\t%.3f\n", lut_cost / 1e3 / fills);
+  printf("linear_us\t%.3f\treference_us\t%.3f\tmax_error\t%u\n",
+         linear_cost / 1e3 / fills,
+         linear_reference / 1e3,
+         linear_error                                            );
+  printf("radial_us\t%.3f\treference_us\t%.3f\tmax_error\t%u\n",
+         radial_cost / 1e3 / fills,
+         radial_reference / 1e3,
+         radial_error                                            );
+
+  free(reference);
+  free(pixels);
+  free(stops);
+  return EXIT_SUCCESS;
+}
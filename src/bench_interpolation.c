@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L
+#include "interpolation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Steps a virtual clock at a fixed rate over a batch of animations of every
+// value kind and evaluates each frame with the interpolation kernel of the
+// animator. Every frame prints its time and cost followed by the values of
+// the first animation of each kind, such that trajectories can be diffed
+// between runs and rates:
+//   bench_interpolation <curve> [rate] [count] [duration_ms]
+// Without arguments the per-frame cost of 10, 100 and 1000 concurrent
+// animations spread over several curves and kinds is reported instead.
+
+#define BENCH_DEFAULT_RATE     60
+#define BENCH_DEFAULT_COUNT    100
+#define BENCH_DEFAULT_DURATION 1000
+#define BENCH_SWEEP_FRAMES     2000
+
+static uint64_t bench_now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+// Spreads count animations evenly over one group per (curve, kind), the
+// integer ones move by a few hundred pixels, the floats from 0 to 1 and the
+// colors between opaque black and transparent white. Returns the number of
+// groups.
+static uint32_t bench_setup(struct animation_batch* batch, struct animation_curve** curves, uint32_t curve_count, uint32_t count) {
+  memset(batch, 0, sizeof(struct animation_batch));
+  animation_batch_reserve(batch, count);
+
+  uint32_t kinds[] = { ANIMATION_KIND_INT,
+                       ANIMATION_KIND_FLOAT,
+                       ANIMATION_KIND_BYTES };
+
+  uint32_t group_count = 3 * curve_count;
+  for (uint32_t g = 0, offset = 0; g < group_count; g++) {
+    animation_batch_add_group(batch, g, curves[g / 3], kinds[g % 3]);
+    struct animation_group* group = &batch->groups[g];
+    group->offset = offset;
+    group->count = count / group_count + (g < count % group_count);
+    offset += group->count;
+
+    for (uint32_t i = 0; i < group->count; i++) {
+      uint32_t position = group->offset + i;
+      if (group->kind == ANIMATION_KIND_INT) {
+        batch->from[position] = i;
+        batch->to[position] = i + 300;
+      } else if (group->kind == ANIMATION_KIND_FLOAT) {
+        float from = 0.f, to = 1.f;
+        memcpy(&batch->from[position], &from, sizeof(float));
+        memcpy(&batch->to[position], &to, sizeof(float));
+      } else {
+        batch->from[position] = 0xff000000;
+        batch->to[position] = 0x00ffffff;
+      }
+    }
+  }
+  return group_count;
+}
+
+// Evaluates one frame of all groups, returns its cost in nanoseconds. The
+// animations are staggered by spread, a fraction of their duration.
+static uint64_t bench_frame(struct animation_batch* batch, uint32_t group_count, double progress, double spread) {
+  uint64_t start = bench_now();
+  for (uint32_t g = 0; g < group_count; g++) {
+    struct animation_group* group = &batch->groups[g];
+    for (uint32_t i = 0; i < group->count; i++) {
+      double t = progress - spread * i / group->count;
+      batch->progress[group->offset + i] = t < 0.0 ? 0.0 : t;
+    }
+    animation_batch_evaluate(batch, group);
+  }
+  return bench_now() - start;
+}
+
+// Reports mean and worst per-frame cost of the kernel for growing numbers of
+// concurrent animations, each run repeats a one second animation at 60Hz
+static int bench_sweep() {
+  char* names[] = { "linear", "tanh", "overshoot", "spring(170,26)" };
+  struct animation_curve* curves[4];
+  for (uint32_t i = 0; i < 4; i++) curves[i] = animation_curve_parse(names[i]);
+
+  uint32_t counts[] = { 10, 100, 1000 };
+  printf("animations\tgroups\tmean_us\tmax_us\n");
+  for (uint32_t c = 0; c < 3; c++) {
+    struct animation_batch batch;
+    uint32_t group_count = bench_setup(&batch, curves, 4, counts[c]);
+
+    uint64_t total = 0;
+    uint64_t worst = 0;
+    for (uint32_t frame = 0; frame < BENCH_SWEEP_FRAMES; frame++) {
+      double progress = (frame % 61) / 60.0;
+      uint64_t cost = bench_frame(&batch, group_count, progress, 0.5);
+      total += cost;
+      if (cost > worst) worst = cost;
+    }
+
+    printf("%u\t%u\t%.3f\t%.3f\n", counts[c],
+                                    group_count,
+                                    total / 1e3 / BENCH_SWEEP_FRAMES,
+                                    worst / 1e3                     );
+    animation_batch_destroy(&batch);
+  }
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) return bench_sweep();
+
+  struct animation_curve* curve = animation_curve_parse(argv[1]);
+  uint32_t rate = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_RATE;
+  uint32_t count = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_COUNT;
+  uint32_t duration = argc > 4 ? atoi(argv[4]) : BENCH_DEFAULT_DURATION;
+  if (!curve || !rate || !count || !duration) {
+    printf("[!] Error: Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  struct animation_batch batch;
+  bench_setup(&batch, &curve, 1, 3 * count);
+
+  // The clock advances by exactly one period per frame
+  uint32_t frames = (uint64_t)duration * rate / 1000 + 1;
+  uint64_t total = 0;
+  for (uint32_t frame = 1; frame <= frames; frame++) {
+    double time = (double)frame / rate;
+    double progress = 1000.0 * time / duration;
+    if (progress > 1.0) progress = 1.0;
+
+    uint64_t cost = bench_frame(&batch, 3, progress, 0.0);
+    total += cost;
+
+    float value;
+    memcpy(&value, &batch.values[count], sizeof(float));
+    printf("frame\t%u\t%.3f\n", frame, 1000.0 * time);
+    printf("cost_us\t%.3f\n", cost / 1e3);
+    printf("int\t%d\n", batch.values[0]);
+    printf("float\t%g\n", value);
+    printf("bytes\t0x%08x\n", (uint32_t)batch.values[2 * count]);
+  }
+  printf("mean_cost_us\t%.3f\n", total / 1e3 / frames);
+
+  animation_batch_destroy(&batch);
+  return EXIT_SUCCESS;
+}
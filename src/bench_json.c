@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L
+#include "json.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Serializes a synthetic bar of items shaped like the --query output of
+// bar_item_serialize, once through the JSON writer and once through the
+// fprintf based serializers it replaced, and reports the cost per query:
+//   bench_json [items] [queries] [fields]
+// Every fourth label contains quotes and a newline, such that the escaping
+// path is exercised next to the verbatim one. The optional fields are
+// passed to json_set_fields as in --query <item> --fields.
+
+#define BENCH_DEFAULT_ITEMS   300
+#define BENCH_DEFAULT_QUERIES 200
+
+struct bench_text {
+  char value[64];
+  char font[64];
+  uint32_t color;
+  int padding_left;
+  int padding_right;
+};
+
+struct bench_item {
+  char name[32];
+  char script[128];
+  uint32_t space_mask;
+  int y_offset;
+  int width;
+  uint32_t background_color;
+  struct bench_text icon;
+  struct bench_text label;
+};
+
+static uint64_t bench_now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+static void bench_setup(struct bench_item* items, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    struct bench_item* item = &items[i];
+    snprintf(item->name, sizeof(item->name), "space.%u", i);
+    snprintf(item->script, sizeof(item->script),
+             "$CONFIG_DIR/plugins/space.sh %u", i);
+    item->space_mask = 1u << (i % 16);
+    item->y_offset = i % 5;
+    item->width = -1;
+    item->background_color = 0x44000000 | (i * 2654435761u >> 8);
+
+    snprintf(item->icon.value, sizeof(item->icon.value), "%u", i % 10);
+    snprintf(item->icon.font, sizeof(item->icon.font),
+             "Hack Nerd Font:Bold:17.00");
+    item->icon.color = 0xffffffff;
+    item->icon.padding_left = 10;
+    item->icon.padding_right = 4;
+
+    if (i % 4 == 0) {
+      snprintf(item->label.value, sizeof(item->label.value),
+               "\"Terminal\" %u\nzsh", i);
+    } else {
+      snprintf(item->label.value, sizeof(item->label.value),
+               "Window title of item %u", i);
+    }
+    snprintf(item->label.font, sizeof(item->label.font),
+             "Hack Nerd Font:Regular:14.00");
+    item->label.color = 0xffcad3f5;
+    item->label.padding_left = 4;
+    item->label.padding_right = 10;
+  }
+}
+
+static void bench_text_json(struct bench_text* text, struct json* json) {
+  json_string(json, "value", text->value);
+  json_string(json, "drawing", "on");
+  json_color(json, "color", text->color);
+  json_int(json, "padding_left", text->padding_left);
+  json_int(json, "padding_right", text->padding_right);
+  json_string(json, "font", text->font);
+}
+
+static void bench_item_json(struct bench_item* item, struct json* json) {
+  json_object_begin(json, NULL);
+  json_string(json, "name", item->name);
+  json_string(json, "type", "item");
+
+  if (json_object_begin(json, "geometry")) {
+    json_string(json, "drawing", "on");
+    json_string(json, "position", "left");
+    json_uint(json, "associated_space_mask", item->space_mask);
+    json_int(json, "y_offset", item->y_offset);
+    json_int(json, "width", item->width);
+    if (json_object_begin(json, "background")) {
+      json_string(json, "drawing", "on");
+      json_color(json, "color", item->background_color);
+      json_int(json, "height", 26);
+      json_int(json, "corner_radius", 5);
+    }
+    json_object_end(json);
+  }
+  json_object_end(json);
+
+  if (json_object_begin(json, "icon")) bench_text_json(&item->icon, json);
+  json_object_end(json);
+  if (json_object_begin(json, "label")) bench_text_json(&item->label, json);
+  json_object_end(json);
+
+  if (json_object_begin(json, "scripting")) {
+    json_string(json, "script", item->script);
+    json_int(json, "update_freq", 0);
+  }
+  json_object_end(json);
+  json_object_end(json);
+}
+
+// The escaper the fprintf serializers used: one allocation per string
+static char* bench_escape_string(char* string) {
+  int length = strlen(string);
+  char* buffer = malloc(2 * length + 1);
+  int cursor = 0;
+  for (int i = 0; i < length; i++) {
+    if (string[i] == '"') {
+      buffer[cursor++] = '\\';
+      buffer[cursor++] = '"';
+    } else if (string[i] == '\n') {
+      buffer[cursor++] = '\\';
+      buffer[cursor++] = 'n';
+    } else {
+      buffer[cursor++] = string[i];
+    }
+  }
+  buffer[cursor] = '\0';
+  return buffer;
+}
+
+static void bench_text_fprintf(struct bench_text* text, FILE* rsp, char* indent) {
+  char* escaped = bench_escape_string(text->value);
+  fprintf(rsp, "%s\"value\": \"%s\",\n"
+               "%s\"drawing\": \"on\",\n"
+               "%s\"color\": \"0x%x\",\n"
+               "%s\"padding_left\": %d,\n"
+               "%s\"padding_right\": %d,\n"
+               "%s\"font\": \"%s\"\n",
+               indent, escaped,
+               indent,
+               indent, text->color,
+               indent, text->padding_left,
+               indent, text->padding_right,
+               indent, text->font           );
+  free(escaped);
+}
+
+static void bench_item_fprintf(struct bench_item* item, FILE* rsp, bool first) {
+  char* escaped_script = bench_escape_string(item->script);
+  fprintf(rsp, "%s\t{\n"
+               "\t\t\"name\": \"%s\",\n"
+               "\t\t\"type\": \"item\",\n"
+               "\t\t\"geometry\": {\n"
+               "\t\t\t\"drawing\": \"on\",\n"
+               "\t\t\t\"position\": \"left\",\n"
+               "\t\t\t\"associated_space_mask\": %u,\n"
+               "\t\t\t\"y_offset\": %d,\n"
+               "\t\t\t\"width\": %d,\n"
+               "\t\t\t\"background\": {\n"
+               "\t\t\t\t\"drawing\": \"on\",\n"
+               "\t\t\t\t\"color\": \"0x%x\",\n"
+               "\t\t\t\t\"height\": 26,\n"
+               "\t\t\t\t\"corner_radius\": 5\n"
+               "\t\t\t}\n"
+               "\t\t},\n"
+               "\t\t\"icon\": {\n",
+               first ? "" : ",\n",
+               item->name,
+               item->space_mask,
+               item->y_offset,
+               item->width,
+               item->background_color  );
+  bench_text_fprintf(&item->icon, rsp, "\t\t\t");
+  fprintf(rsp, "\t\t},\n\t\t\"label\": {\n");
+  bench_text_fprintf(&item->label, rsp, "\t\t\t");
+  fprintf(rsp, "\t\t},\n"
+               "\t\t\"scripting\": {\n"
+               "\t\t\t\"script\": \"%s\",\n"
+               "\t\t\t\"update_freq\": 0\n"
+               "\t\t}\n"
+               "\t}",
+               escaped_script            );
+  free(escaped_script);
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_ITEMS;
+  uint32_t queries = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_QUERIES;
+  if (!count || !queries) {
+    printf("Usage: %s [items] [queries] [fields]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct bench_item* items = malloc(sizeof(struct bench_item) * count);
+  bench_setup(items, count);
+
+  struct json json;
+  json_init(&json);
+  if (argc > 3 && !json_set_fields(&json, argv[3])) {
+    printf("[!] Error: Invalid fields '%s'\n", argv[3]);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t start = bench_now();
+  for (uint32_t q = 0; q < queries; q++) {
+    json_reset(&json);
+    json_array_begin(&json, NULL);
+    for (uint32_t i = 0; i < count; i++) bench_item_json(&items[i], &json);
+    json_array_end(&json);
+  }
+  uint64_t writer = bench_now() - start;
+  size_t writer_bytes = json.length;
+
+  size_t fprintf_bytes = 0;
+  start = bench_now();
+  for (uint32_t q = 0; q < queries; q++) {
+    char* response = NULL;
+    size_t length = 0;
+    FILE* rsp = open_memstream(&response, &length);
+    fprintf(rsp, "[\n");
+    for (uint32_t i = 0; i < count; i++) {
+      bench_item_fprintf(&items[i], rsp, i == 0);
+    }
+    fprintf(rsp, "\n]\n");
+    fclose(rsp);
+    fprintf_bytes = length;
+    free(response);
+  }
+  uint64_t baseline = bench_now() - start;
+
+  printf("items\t%u\n", count);
+  printf("writer_us\t%.3f\t%zu bytes\n", writer / 1e3 / queries,
+                                         writer_bytes           );
+  printf("fprintf_us\t%.3f\t%zu bytes\n", baseline / 1e3 / queries,
+                                          fprintf_bytes            );
+
+  json_destroy(&json);
+  free(items);
+  return EXIT_SUCCESS;
+}
@@ -84,16 +84,13 @@ void custom_events_destroy(struct custom_events* custom_events) {
   free(custom_events->events);
 }
 
-void custom_events_serialize(struct custom_events* custom_events, FILE* rsp) {
-  fprintf(rsp, "{\n");
+void custom_events_serialize(struct custom_events* custom_events, struct json* json) {
+  json_object_begin(json, NULL);
   for (int i = 0; i < custom_events->count; i++) {
-    fprintf(rsp, "\t\"%s\": {\n"
-                 "\t\t\"bit\": %llu,\n"
-                 "\t\t\"notification\": \"%s\"\n",
-                 custom_events->events[i]->name,
-                 1ULL << i,
-                 custom_events->events[i]->notification);
-    if (i < custom_events->count - 1) fprintf(rsp, "\t},\n");
+    json_object_begin(json, custom_events->events[i]->name);
+    json_uint(json, "bit", 1ULL << i);
+    json_string(json, "notification", custom_events->events[i]->notification);
+    json_object_end(json);
   }
-  fprintf(rsp, "\t}\n}\n");
+  json_object_end(json);
 }
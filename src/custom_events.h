@@ -1,5 +1,6 @@
 #pragma once
 #include "misc/helpers.h"
+#include "json.h"
 
 #define UPDATE_FRONT_APP_SWITCHED   1ULL
 #define UPDATE_SPACE_CHANGE         (1ULL << 1)
@@ -41,4 +42,4 @@ uint64_t custom_events_get_flag_for_name(struct custom_events* custom_events, ch
 char* custom_events_get_name_for_notification(struct custom_events* custom_events, char* notification);
 void custom_events_destroy(struct custom_events* custom_events);
 
-void custom_events_serialize(struct custom_events* custom_events, FILE* rsp);
+void custom_events_serialize(struct custom_events* custom_events, struct json* json);
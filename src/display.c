@@ -302,15 +302,13 @@ void begin_receiving_brightness_events() {
   }
 }
 
-void display_serialize(FILE* rsp) {
+void display_serialize(struct json* json) {
   uint32_t count = 0;
   uint32_t* display_ids = display_active_display_list(&count);
   if (!display_ids) return;
 
-  fprintf(rsp, "[\n");
+  json_array_begin(json, NULL);
   for (int i = 0; i < count; i++) {
-    fprintf(rsp, "\t{\n");
-
     uint32_t did = display_arrangement_display_id(i + 1);
     CFStringRef uuid_ref = display_uuid(did);
     CGRect frame = CGDisplayBounds(did);
@@ -320,18 +318,20 @@ void display_serialize(FILE* rsp) {
       CFRelease(uuid_ref);
     }
 
-    fprintf(rsp, "\t\t\"arrangement-id\":%d,\n", display_arrangement(did));
-    fprintf(rsp, "\t\t\"DirectDisplayID\":%d,\n", did);
-    fprintf(rsp, "\t\t\"UUID\":\"%s\",\n", uuid ? uuid : "<unknown>");
-    fprintf(rsp, "\t\t\"frame\":{\n\t\t\"x\":%.4f,\n\t\t\"y\":%.4f,\n\t\t\"w\":%.4f,\n\t\t\"h\":%.4f\n\t\t}\n", frame.origin.x, frame.origin.y, frame.size.width, frame.size.height);
-
-    if (i == count - 1)
-      fprintf(rsp, "\t}\n");
-    else
-      fprintf(rsp, "\t},\n");
+    json_object_begin(json, NULL);
+    json_int(json, "arrangement-id", display_arrangement(did));
+    json_int(json, "DirectDisplayID", did);
+    json_string(json, "UUID", uuid ? uuid : "<unknown>");
+    json_object_begin(json, "frame");
+    json_float(json, "x", frame.origin.x, 4);
+    json_float(json, "y", frame.origin.y, 4);
+    json_float(json, "w", frame.size.width, 4);
+    json_float(json, "h", frame.size.height, 4);
+    json_object_end(json);
+    json_object_end(json);
 
     if (uuid) free(uuid);
   }
-  fprintf(rsp, "]\n");
+  json_array_end(json);
   free(display_ids);
 }
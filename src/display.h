@@ -1,6 +1,7 @@
 #pragma once
 #include "event.h"
 #include "misc/helpers.h"
+#include "json.h"
 
 #define DISPLAY_EVENT_HANDLER(name) void name(uint32_t did, CGDisplayChangeSummaryFlags flags, void *context)
 typedef DISPLAY_EVENT_HANDLER(display_callback);
@@ -25,4 +26,4 @@ int display_arrangement(uint32_t did);
 void forced_brightness_event();
 void begin_receiving_brightness_events();
 
-void display_serialize(FILE* rsp);
+void display_serialize(struct json* json);
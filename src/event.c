@@ -336,11 +336,14 @@ static void event_space_windows_changed(void* context) {
   bar_manager_handle_space_windows_change(&g_bar_manager, (char*)context);
 }
 
+static void event_image_loaded(void* context) {
+  bar_manager_handle_image_loaded(&g_bar_manager,
+                                  (struct image_request*)context);
+}
+
 static void event_hotload(void* context) {
-  bar_manager_destroy(&g_bar_manager);
-  bar_manager_init(&g_bar_manager);
-  bar_manager_begin(&g_bar_manager);
-  exec_config_file();
+  if (hotload_get_state() == HOTLOAD_STATE_RECONCILE) reconcile_config();
+  else reload_config();
 }
 
 typedef void callback_type(void*);
@@ -371,6 +374,7 @@ static callback_type* event_handler[] = {
   [ANIMATOR_REFRESH]           = event_animator_refresh,
   [MACH_MESSAGE]               = event_mach_message,
   [HOTLOAD]                    = event_hotload,
+  [IMAGE_LOADED]               = event_image_loaded,
   [SPACE_WINDOWS_CHANGED]      = event_space_windows_changed,
 };
 
@@ -391,20 +395,11 @@ void event_post(struct event *event) {
     error("Trying to reinitialize the event mutex! abort..\n");
   } else if (!initialized) error("The event mutex is not ready! abort..\n");
 
-  if (event->type == ANIMATOR_REFRESH) {
-    // We try to lock the mutex up to 1ms and then concede (skip the frame) to
-    // avoid deadlocking occuring due to the CVDisplayLink.
-    int locked;
-    for (int i = 0; i < 10; i++) {
-      if ((locked = pthread_mutex_trylock(&event_mutex)) == 0) break;
-      usleep(100);
-    }
-    if (locked != 0) return;
-  } else {
-    pthread_mutex_lock(&event_mutex);
-    if (g_space_management_mode != 1) {
-      bar_manager_poll_active_display(&g_bar_manager);
-    }
+  // Animator frames are posted from the main queue, never from the display
+  // link thread, hence they can wait for the mutex like any other event.
+  pthread_mutex_lock(&event_mutex);
+  if (event->type != ANIMATOR_REFRESH && g_space_management_mode != 1) {
+    bar_manager_poll_active_display(&g_bar_manager);
   }
 
   event_handler[event->type](event->context);
@@ -31,6 +31,7 @@ enum event_type {
   SPACE_WINDOWS_CHANGED,
   DISTRIBUTED_NOTIFICATION,
   HOTLOAD,
+  IMAGE_LOADED,
 
   INIT_MUTEX,
   EVENT_TYPE_COUNT
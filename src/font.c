@@ -75,7 +75,7 @@ void font_register(char* font_path) {
   free(font_path);
 }
 
-void font_create_ctfont(struct font* font) {
+static CTFontRef font_build_ctfont(struct font* font) {
 
   CFStringRef family_ref = CFStringCreateWithCString(NULL,
                                                      font->family,
@@ -103,8 +103,6 @@ void font_create_ctfont(struct font* font) {
 
   CTFontDescriptorRef descriptor = CTFontDescriptorCreateWithAttributes(attr);
 
-  if (font->ct_font) CFRelease(font->ct_font);
-
   if (font->features) {
     char* features_copy = string_copy(font->features);
     char* feature = strtok(features_copy, ",");
@@ -143,13 +141,90 @@ void font_create_ctfont(struct font* font) {
     free(features_copy);
   }
 
-  font->ct_font = CTFontCreateWithFontDescriptor(descriptor, 0.0, NULL);
+  CTFontRef ct_font = CTFontCreateWithFontDescriptor(descriptor, 0.0, NULL);
 
   CFRelease(descriptor);
   CFRelease(attr);
   CFRelease(size_ref);
   CFRelease(style_ref);
   CFRelease(family_ref);
+  return ct_font;
+}
+
+// Fonts are interned by (family, style, size, features), such that all texts
+// using the same font share a single CTFont handle.
+struct font_entry {
+  CTFontRef ct_font;
+  uint32_t refcount;
+
+  float size;
+  char* family;
+  char* style;
+  char* features;
+};
+
+static struct font_entry** g_font_entries = NULL;
+static uint32_t g_font_entry_count = 0;
+
+static bool font_entry_matches(struct font_entry* entry, struct font* font) {
+  return entry->size == font->size
+         && string_equals(entry->family, font->family)
+         && string_equals(entry->style, font->style)
+         && ((!entry->features && !font->features)
+             || (entry->features && font->features
+                 && string_equals(entry->features, font->features)));
+}
+
+static CTFontRef font_registry_acquire(struct font* font) {
+  for (int i = 0; i < g_font_entry_count; i++) {
+    struct font_entry* entry = g_font_entries[i];
+    if (font_entry_matches(entry, font)) {
+      entry->refcount++;
+      return entry->ct_font;
+    }
+  }
+
+  struct font_entry* entry = malloc(sizeof(struct font_entry));
+  entry->ct_font = font_build_ctfont(font);
+  entry->refcount = 1;
+  entry->size = font->size;
+  entry->family = string_copy(font->family);
+  entry->style = string_copy(font->style);
+  entry->features = font->features ? string_copy(font->features) : NULL;
+
+  g_font_entries = realloc(g_font_entries,
+                           sizeof(struct font_entry*)*(g_font_entry_count + 1));
+  g_font_entries[g_font_entry_count++] = entry;
+  return entry->ct_font;
+}
+
+static void font_registry_release(CTFontRef ct_font) {
+  if (!ct_font) return;
+  for (int i = 0; i < g_font_entry_count; i++) {
+    struct font_entry* entry = g_font_entries[i];
+    if (entry->ct_font != ct_font) continue;
+    if (--entry->refcount > 0) return;
+
+    CFRelease(entry->ct_font);
+    free(entry->family);
+    free(entry->style);
+    if (entry->features) free(entry->features);
+    free(entry);
+
+    g_font_entries[i] = g_font_entries[--g_font_entry_count];
+    if (g_font_entry_count == 0) {
+      free(g_font_entries);
+      g_font_entries = NULL;
+    }
+    return;
+  }
+}
+
+void font_create_ctfont(struct font* font) {
+  if (!font->family || !font->style) return;
+  CTFontRef ct_font = font_registry_acquire(font);
+  font_registry_release(font->ct_font);
+  font->ct_font = ct_font;
 }
 
 void font_init(struct font* font) {
@@ -238,7 +313,7 @@ void font_destroy(struct font* font) {
   if (font->style) free(font->style);
   if (font->family) free(font->family);
   if (font->features) free(font->features);
-  if (font->ct_font) CFRelease(font->ct_font);
+  font_registry_release(font->ct_font);
   font_clear_pointers(font);
 }
 
@@ -13,20 +13,103 @@ void gradient_init(struct gradient* gradient) {
   gradient->stops = NULL;
   gradient->stops_count = 0;
   gradient->stops_capacity = 0;
+  gradient->cg_gradient = NULL;
+  gradient->cg_gradient_key = 0;
+}
+
+void gradient_clear_pointers(struct gradient* gradient) {
+  gradient->stops = NULL;
+  gradient->stops_count = 0;
+  gradient->stops_capacity = 0;
+  gradient->cg_gradient = NULL;
+  gradient->cg_gradient_key = 0;
 }
 
 void gradient_destroy(struct gradient* gradient) {
-  if (gradient->stops) {
-    free(gradient->stops);
-    gradient->stops = NULL;
-    gradient->stops_count = 0;
-    gradient->stops_capacity = 0;
+  if (gradient->stops) free(gradient->stops);
+  if (gradient->cg_gradient) CGGradientRelease(gradient->cg_gradient);
+  gradient_clear_pointers(gradient);
+}
+
+uint64_t gradient_get_key(struct gradient* gradient) {
+  uint64_t key = 0xcbf29ce484222325ULL ^ gradient->stops_count;
+  if (gradient->stops_count > 0) {
+    for (uint32_t i = 0; i < gradient->stops_count; i++) {
+      uint32_t position;
+      memcpy(&position, &gradient->stops[i].position, sizeof(uint32_t));
+      key = (key ^ gradient->stops[i].color.hex) * 0x100000001b3ULL;
+      key = (key ^ position) * 0x100000001b3ULL;
+    }
+  } else {
+    key = (key ^ gradient->color_start.hex) * 0x100000001b3ULL;
+    key = (key ^ gradient->color_end.hex) * 0x100000001b3ULL;
   }
+  return key;
+}
+
+static CGGradientRef gradient_create_cg_gradient(struct gradient* gradient) {
+  CGColorSpaceRef color_space = CGColorSpaceCreateDeviceRGB();
+  CGGradientRef cg_gradient;
+
+  if (gradient->stops_count > 0) {
+    // Power user: arbitrary stops
+    CGFloat components[gradient->stops_count * 4];
+    CGFloat locations[gradient->stops_count];
+
+    for (uint32_t i = 0; i < gradient->stops_count; i++) {
+      components[i * 4 + 0] = gradient->stops[i].color.r;
+      components[i * 4 + 1] = gradient->stops[i].color.g;
+      components[i * 4 + 2] = gradient->stops[i].color.b;
+      components[i * 4 + 3] = gradient->stops[i].color.a;
+      locations[i] = gradient->stops[i].position;
+    }
+
+    cg_gradient = CGGradientCreateWithColorComponents(
+        color_space, components, locations, gradient->stops_count);
+  } else {
+    // Legacy: 2-color gradient
+    CGFloat components[8] = {
+      gradient->color_start.r, gradient->color_start.g,
+      gradient->color_start.b, gradient->color_start.a,
+      gradient->color_end.r,   gradient->color_end.g,
+      gradient->color_end.b,   gradient->color_end.a
+    };
+    cg_gradient = CGGradientCreateWithColorComponents(
+        color_space, components, NULL, 2);
+  }
+  CFRelease(color_space);
+  return cg_gradient;
+}
+
+// Rebuilds the cached CGGradient if the colors or stops changed. This must
+// only be called from the main thread, since items are drawn from shallow
+// copies on the render threads, which only ever read the cached gradient.
+void gradient_prepare(struct gradient* gradient) {
+  if (!gradient->enabled) return;
+  uint64_t key = gradient_get_key(gradient);
+  if (gradient->cg_gradient && gradient->cg_gradient_key == key) return;
+
+  if (gradient->cg_gradient) CGGradientRelease(gradient->cg_gradient);
+  gradient->cg_gradient = gradient_create_cg_gradient(gradient);
+  gradient->cg_gradient_key = key;
+}
+
+void gradient_copy(struct gradient* gradient, struct gradient* source) {
+  if (source->stops_count > 0) {
+    gradient->stops = malloc(source->stops_count * sizeof(struct gradient_stop));
+    memcpy(gradient->stops,
+           source->stops,
+           source->stops_count * sizeof(struct gradient_stop));
+    gradient->stops_count = source->stops_count;
+    gradient->stops_capacity = source->stops_count;
+  }
+  gradient_prepare(gradient);
 }
 
 static bool gradient_set_enabled(struct gradient* gradient, bool enabled) {
   if (gradient->enabled == enabled) return false;
   gradient->enabled = enabled;
+  gradient_prepare(gradient);
   return true;
 }
 
@@ -56,12 +139,16 @@ static bool gradient_set_radius_v(struct gradient* gradient, float radius) {
 
 static bool gradient_set_color_start(struct gradient* gradient, uint32_t color) {
   bool changed = gradient_set_enabled(gradient, true);
-  return color_set_hex(&gradient->color_start, color) || changed;
+  changed |= color_set_hex(&gradient->color_start, color);
+  if (changed) gradient_prepare(gradient);
+  return changed;
 }
 
 static bool gradient_set_color_end(struct gradient* gradient, uint32_t color) {
   bool changed = gradient_set_enabled(gradient, true);
-  return color_set_hex(&gradient->color_end, color) || changed;
+  changed |= color_set_hex(&gradient->color_end, color);
+  if (changed) gradient_prepare(gradient);
+  return changed;
 }
 
 static void gradient_ensure_stop_capacity(struct gradient* gradient, uint32_t index) {
@@ -92,6 +179,7 @@ static bool gradient_set_stop_position(struct gradient* gradient, uint32_t index
   if (gradient->stops[index].position == clamped) return false;
   gradient->stops[index].position = clamped;
   gradient_set_enabled(gradient, true);
+  gradient_prepare(gradient);
   return true;
 }
 
@@ -99,6 +187,7 @@ static bool gradient_set_stop_color(struct gradient* gradient, uint32_t index, u
   gradient_ensure_stop_capacity(gradient, index);
   bool changed = color_set_hex(&gradient->stops[index].color, color);
   gradient_set_enabled(gradient, true);
+  if (changed) gradient_prepare(gradient);
   return changed;
 }
 
@@ -121,50 +210,18 @@ static void gradient_get_points(uint32_t angle, CGRect region, CGPoint* start, C
   end->y   = cy + dy * extent;
 }
 
-static void gradient_draw_linear(struct gradient* gradient, CGContextRef context, CGRect region, struct corner_radii* corner_radii) {
+static void gradient_draw_linear(struct gradient* gradient, CGContextRef context, CGRect region, CGPathRef clip_path) {
   CGContextSaveGState(context);
 
-  CGMutablePathRef path = CGPathCreateMutable();
-  add_rounded_rect_path(path, region,
-                       corner_radii->top_left, corner_radii->top_right,
-                       corner_radii->bottom_left, corner_radii->bottom_right);
-  CGContextAddPath(context, path);
+  CGContextAddPath(context, clip_path);
   CGContextClip(context);
-  CFRelease(path);
-
-  CGColorSpaceRef color_space = CGColorSpaceCreateDeviceRGB();
-  CGGradientRef cg_gradient;
-
-  if (gradient->stops_count > 0) {
-    // Power user: arbitrary stops
-    CGFloat* components = malloc(gradient->stops_count * 4 * sizeof(CGFloat));
-    CGFloat* locations = malloc(gradient->stops_count * sizeof(CGFloat));
-
-    for (uint32_t i = 0; i < gradient->stops_count; i++) {
-      components[i * 4 + 0] = gradient->stops[i].color.r;
-      components[i * 4 + 1] = gradient->stops[i].color.g;
-      components[i * 4 + 2] = gradient->stops[i].color.b;
-      components[i * 4 + 3] = gradient->stops[i].color.a;
-      locations[i] = gradient->stops[i].position;
-    }
 
-    cg_gradient = CGGradientCreateWithColorComponents(
-        color_space, components, locations, gradient->stops_count);
-
-    free(components);
-    free(locations);
-  } else {
-    // Legacy: 2-color gradient
-    CGFloat components[8] = {
-      gradient->color_start.r, gradient->color_start.g,
-      gradient->color_start.b, gradient->color_start.a,
-      gradient->color_end.r,   gradient->color_end.g,
-      gradient->color_end.b,   gradient->color_end.a
-    };
-    cg_gradient = CGGradientCreateWithColorComponents(
-        color_space, components, NULL, 2);
-  }
-  CFRelease(color_space);
+  // Colors can also change through the color sub domain or its animations,
+  // in which case the cache is stale until the next gradient_prepare.
+  CGGradientRef cg_gradient = gradient->cg_gradient;
+  bool cached = cg_gradient
+                && gradient->cg_gradient_key == gradient_get_key(gradient);
+  if (!cached) cg_gradient = gradient_create_cg_gradient(gradient);
 
   CGPoint start_point, end_point;
   gradient_get_points(gradient->angle, region, &start_point, &end_point);
@@ -173,55 +230,23 @@ static void gradient_draw_linear(struct gradient* gradient, CGContextRef context
                               start_point, end_point,
                               kCGGradientDrawsBeforeStartLocation
                               | kCGGradientDrawsAfterEndLocation);
-  CFRelease(cg_gradient);
+  if (!cached) CGGradientRelease(cg_gradient);
 
   CGContextRestoreGState(context);
 }
 
-static void gradient_draw_radial(struct gradient* gradient, CGContextRef context, CGRect region, struct corner_radii* corner_radii) {
+static void gradient_draw_radial(struct gradient* gradient, CGContextRef context, CGRect region, CGPathRef clip_path) {
   CGContextSaveGState(context);
 
-  CGMutablePathRef path = CGPathCreateMutable();
-  add_rounded_rect_path(path, region,
-                       corner_radii->top_left, corner_radii->top_right,
-                       corner_radii->bottom_left, corner_radii->bottom_right);
-  CGContextAddPath(context, path);
+  CGContextAddPath(context, clip_path);
   CGContextClip(context);
-  CFRelease(path);
-
-  CGColorSpaceRef color_space = CGColorSpaceCreateDeviceRGB();
-  CGGradientRef cg_gradient;
 
-  if (gradient->stops_count > 0) {
-    // Power user: arbitrary stops
-    CGFloat* components = malloc(gradient->stops_count * 4 * sizeof(CGFloat));
-    CGFloat* locations = malloc(gradient->stops_count * sizeof(CGFloat));
-
-    for (uint32_t i = 0; i < gradient->stops_count; i++) {
-      components[i * 4 + 0] = gradient->stops[i].color.r;
-      components[i * 4 + 1] = gradient->stops[i].color.g;
-      components[i * 4 + 2] = gradient->stops[i].color.b;
-      components[i * 4 + 3] = gradient->stops[i].color.a;
-      locations[i] = gradient->stops[i].position;
-    }
-
-    cg_gradient = CGGradientCreateWithColorComponents(
-        color_space, components, locations, gradient->stops_count);
-
-    free(components);
-    free(locations);
-  } else {
-    // Legacy: 2-color gradient
-    CGFloat components[8] = {
-      gradient->color_start.r, gradient->color_start.g,
-      gradient->color_start.b, gradient->color_start.a,
-      gradient->color_end.r,   gradient->color_end.g,
-      gradient->color_end.b,   gradient->color_end.a
-    };
-    cg_gradient = CGGradientCreateWithColorComponents(
-        color_space, components, NULL, 2);
-  }
-  CFRelease(color_space);
+  // Colors can also change through the color sub domain or its animations,
+  // in which case the cache is stale until the next gradient_prepare.
+  CGGradientRef cg_gradient = gradient->cg_gradient;
+  bool cached = cg_gradient
+                && gradient->cg_gradient_key == gradient_get_key(gradient);
+  if (!cached) cg_gradient = gradient_create_cg_gradient(gradient);
 
   CGPoint center = {
     region.origin.x + region.size.width / 2.0,
@@ -267,47 +292,38 @@ static void gradient_draw_radial(struct gradient* gradient, CGContextRef context
                                 | kCGGradientDrawsAfterEndLocation);
   }
 
-  CFRelease(cg_gradient);
+  if (!cached) CGGradientRelease(cg_gradient);
 
   CGContextRestoreGState(context);
 }
 
-void gradient_draw(struct gradient* gradient, CGContextRef context, CGRect region, struct corner_radii* corner_radii) {
+void gradient_draw(struct gradient* gradient, CGContextRef context, CGRect region, CGPathRef clip_path) {
   if (gradient->type == 1) {
-    gradient_draw_radial(gradient, context, region, corner_radii);
+    gradient_draw_radial(gradient, context, region, clip_path);
   } else {
-    gradient_draw_linear(gradient, context, region, corner_radii);
+    gradient_draw_linear(gradient, context, region, clip_path);
   }
 }
 
-void gradient_serialize(struct gradient* gradient, char* indent, FILE* rsp) {
-  fprintf(rsp, "%s\"drawing\": \"%s\",\n"
-               "%s\"type\": \"%s\",\n"
-               "%s\"angle\": %u,\n"
-               "%s\"radius_h\": %.2f,\n"
-               "%s\"radius_v\": %.2f,\n"
-               "%s\"color_start\": \"0x%x\",\n"
-               "%s\"color_end\": \"0x%x\",\n"
-               "%s\"stops_count\": %u",
-               indent, format_bool(gradient->enabled),
-               indent, gradient->type == 1 ? "radial" : "linear",
-               indent, gradient->angle,
-               indent, gradient->radius_h,
-               indent, gradient->radius_v,
-               indent, gradient->color_start.hex,
-               indent, gradient->color_end.hex,
-               indent, gradient->stops_count);
+void gradient_serialize(struct gradient* gradient, struct json* json) {
+  json_string(json, "drawing", format_bool(gradient->enabled));
+  json_string(json, "type", gradient->type == 1 ? "radial" : "linear");
+  json_uint(json, "angle", gradient->angle);
+  json_float(json, "radius_h", gradient->radius_h, 2);
+  json_float(json, "radius_v", gradient->radius_v, 2);
+  json_color(json, "color_start", gradient->color_start.hex);
+  json_color(json, "color_end", gradient->color_end.hex);
+  json_uint(json, "stops_count", gradient->stops_count);
 
   if (gradient->stops_count > 0) {
-    fprintf(rsp, ",\n%s\"stops\": [\n", indent);
+    json_array_begin(json, "stops");
     for (uint32_t i = 0; i < gradient->stops_count; i++) {
-      fprintf(rsp, "%s  {\"position\": %.2f, \"color\": \"0x%x\"}",
-              indent,
-              gradient->stops[i].position,
-              gradient->stops[i].color.hex);
-      if (i < gradient->stops_count - 1) fprintf(rsp, ",\n");
+      json_object_begin(json, NULL);
+      json_float(json, "position", gradient->stops[i].position, 2);
+      json_color(json, "color", gradient->stops[i].color.hex);
+      json_object_end(json);
     }
-    fprintf(rsp, "\n%s]", indent);
+    json_array_end(json);
   }
 }
 
@@ -375,10 +391,20 @@ bool gradient_parse_sub_domain(struct gradient* gradient, FILE* rsp, struct toke
       struct token subdom = {key_value_pair.key, strlen(key_value_pair.key)};
       struct token entry = {key_value_pair.value, strlen(key_value_pair.value)};
       if (token_equals(subdom, SUB_DOMAIN_COLOR_START)) {
-        return color_parse_sub_domain(&gradient->color_start, rsp, entry, message);
+        needs_refresh = color_parse_sub_domain(&gradient->color_start,
+                                               rsp,
+                                               entry,
+                                               message               );
+        gradient_prepare(gradient);
+        return needs_refresh;
       }
       else if (token_equals(subdom, SUB_DOMAIN_COLOR_END)) {
-        return color_parse_sub_domain(&gradient->color_end, rsp, entry, message);
+        needs_refresh = color_parse_sub_domain(&gradient->color_end,
+                                               rsp,
+                                               entry,
+                                               message             );
+        gradient_prepare(gradient);
+        return needs_refresh;
       }
       else if (token_equals(subdom, "stops")) {
         // Parse stops.INDEX.PROPERTY or stops.INDEX.color.PROPERTY
@@ -395,7 +421,12 @@ bool gradient_parse_sub_domain(struct gradient* gradient, FILE* rsp, struct toke
             struct token color_entry = {color_pair.value, strlen(color_pair.value)};
             if (token_equals(color_subdom, "color")) {
               gradient_ensure_stop_capacity(gradient, index);
-              return color_parse_sub_domain(&gradient->stops[index].color, rsp, color_entry, message);
+              needs_refresh = color_parse_sub_domain(&gradient->stops[index].color,
+                                                     rsp,
+                                                     color_entry,
+                                                     message                      );
+              gradient_prepare(gradient);
+              return needs_refresh;
             }
           } else {
             // stops.INDEX.PROPERTY (direct property)
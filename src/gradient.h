@@ -1,5 +1,6 @@
 #pragma once
 #include "misc/helpers.h"
+#include "json.h"
 #include "color.h"
 
 struct gradient_stop {
@@ -23,11 +24,19 @@ struct gradient {
   struct gradient_stop* stops;
   uint32_t stops_count;
   uint32_t stops_capacity;
+
+  // Cached CoreGraphics gradient, valid while the color key matches
+  CGGradientRef cg_gradient;
+  uint64_t cg_gradient_key;
 };
 
 void gradient_init(struct gradient* gradient);
 void gradient_destroy(struct gradient* gradient);
-void gradient_draw(struct gradient* gradient, CGContextRef context, CGRect region, struct corner_radii* corner_radii);
+void gradient_clear_pointers(struct gradient* gradient);
+void gradient_copy(struct gradient* gradient, struct gradient* source);
+void gradient_prepare(struct gradient* gradient);
+uint64_t gradient_get_key(struct gradient* gradient);
+void gradient_draw(struct gradient* gradient, CGContextRef context, CGRect region, CGPathRef clip_path);
 
-void gradient_serialize(struct gradient* gradient, char* indent, FILE* rsp);
+void gradient_serialize(struct gradient* gradient, struct json* json);
 bool gradient_parse_sub_domain(struct gradient* gradient, FILE* rsp, struct token property, char* message);
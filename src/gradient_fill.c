@@ -0,0 +1,171 @@
+#include "gradient_fill.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Portable four lane vectors, lowered to SSE/AVX or NEON by the compiler
+typedef int gradient_int4 __attribute__((vector_size(16)));
+typedef float gradient_float4 __attribute__((vector_size(16)));
+
+static const gradient_float4 g_lanes = { 0.f, 1.f, 2.f, 3.f };
+
+static uint32_t gradient_premultiply(float a, float r, float g, float b) {
+  float alpha = a / 255.f;
+  return ((uint32_t)(a + .5f) << 24)
+         | ((uint32_t)(r * alpha + .5f) << 16)
+         | ((uint32_t)(g * alpha + .5f) << 8)
+         | (uint32_t)(b * alpha + .5f);
+}
+
+static float gradient_channel(uint32_t color, uint32_t shift) {
+  return (color >> shift) & 0xff;
+}
+
+// Stops are interpolated unpremultiplied, as CGGradient does, and may be
+// given in any order. The color of the outermost stops extends to the ends.
+void gradient_lut_build(struct gradient_lut* lut, struct gradient_lut_stop* stops, uint32_t count) {
+  if (count == 0) {
+    memset(lut->color, 0, sizeof(lut->color));
+    return;
+  }
+
+  struct gradient_lut_stop* sorted = malloc(sizeof(struct gradient_lut_stop)
+                                            * count                         );
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t j = i;
+    while (j > 0 && sorted[j - 1].position > stops[i].position) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = stops[i];
+  }
+
+  uint32_t next = 0;
+  for (uint32_t i = 0; i < GRADIENT_LUT_SIZE; i++) {
+    float t = (float)i / (GRADIENT_LUT_SIZE - 1);
+    while (next < count && sorted[next].position <= t) next++;
+
+    uint32_t from = next > 0 ? sorted[next - 1].color : sorted[0].color;
+    uint32_t to = next < count ? sorted[next].color : from;
+    float fraction = 0.f;
+    if (next > 0 && next < count) {
+      float span = sorted[next].position - sorted[next - 1].position;
+      fraction = (t - sorted[next - 1].position) / span;
+    }
+
+    float channels[4];
+    for (uint32_t c = 0; c < 4; c++) {
+      float a = gradient_channel(from, 24 - 8 * c);
+      float b = gradient_channel(to, 24 - 8 * c);
+      channels[c] = a + fraction * (b - a);
+    }
+    lut->color[i] = gradient_premultiply(channels[0],
+                                         channels[1],
+                                         channels[2],
+                                         channels[3] );
+  }
+  free(sorted);
+}
+
+// Maps four gradient positions to table indices, positions outside of
+// [0, 1] are clamped by masking their bits, the vectors have no min/max.
+static inline gradient_int4 gradient_index(gradient_float4 t) {
+  const gradient_float4 one = { 1.f, 1.f, 1.f, 1.f };
+  gradient_int4 below = t < 0.f;
+  gradient_int4 above = t > 1.f;
+  gradient_int4 bits = ((gradient_int4)t & ~(below | above))
+                       | ((gradient_int4)one & above);
+
+  return __builtin_convertvector((gradient_float4)bits
+                                 * (float)(GRADIENT_LUT_SIZE - 1) + .5f,
+                                 gradient_int4                          );
+}
+
+static inline float gradient_clamp(float t) {
+  return t < 0.f ? 0.f : (t > 1.f ? 1.f : t);
+}
+
+static void gradient_fill_row(uint32_t* row, uint32_t width, uint32_t color) {
+  for (uint32_t x = 0; x < width; x++) row[x] = color;
+}
+
+// The position along the gradient is linear in x, rows are filled four
+// pixels at a time. Gradients without a horizontal component fill every
+// row with a single color.
+void gradient_fill_linear(struct gradient_lut* lut, uint32_t* pixels, uint32_t width, uint32_t height, uint32_t stride, float start_x, float start_y, float end_x, float end_y) {
+  float dx = end_x - start_x;
+  float dy = end_y - start_y;
+  float length = dx * dx + dy * dy;
+  if (length <= 0.f) {
+    for (uint32_t y = 0; y < height; y++) {
+      gradient_fill_row(pixels + (size_t)y * stride,
+                        width,
+                        lut->color[GRADIENT_LUT_SIZE - 1]);
+    }
+    return;
+  }
+
+  float step = dx / length;
+  uint32_t vector_width = width & ~3u;
+  for (uint32_t y = 0; y < height; y++) {
+    uint32_t* row = pixels + (size_t)y * stride;
+    float origin = ((.5f - start_x) * dx + (y + .5f - start_y) * dy) / length;
+
+    if (step == 0.f) {
+      uint32_t index = gradient_clamp(origin) * (GRADIENT_LUT_SIZE - 1) + .5f;
+      gradient_fill_row(row, width, lut->color[index]);
+      continue;
+    }
+
+    for (uint32_t x = 0; x < vector_width; x += 4) {
+      gradient_float4 t = origin + ((float)x + g_lanes) * step;
+      gradient_int4 index = gradient_index(t);
+      for (uint32_t lane = 0; lane < 4; lane++) {
+        row[x + lane] = lut->color[index[lane]];
+      }
+    }
+    for (uint32_t x = vector_width; x < width; x++) {
+      float t = gradient_clamp(origin + x * step);
+      row[x] = lut->color[(uint32_t)(t * (GRADIENT_LUT_SIZE - 1) + .5f)];
+    }
+  }
+}
+
+// The position is the elliptical distance from the center, scaled such
+// that the radii map to the end of the gradient.
+void gradient_fill_radial(struct gradient_lut* lut, uint32_t* pixels, uint32_t width, uint32_t height, uint32_t stride, float center_x, float center_y, float radius_h, float radius_v) {
+  if (radius_h <= 0.f || radius_v <= 0.f) {
+    for (uint32_t y = 0; y < height; y++) {
+      gradient_fill_row(pixels + (size_t)y * stride,
+                        width,
+                        lut->color[GRADIENT_LUT_SIZE - 1]);
+    }
+    return;
+  }
+
+  float scale_x = 1.f / radius_h;
+  float scale_y = 1.f / radius_v;
+  uint32_t vector_width = width & ~3u;
+  for (uint32_t y = 0; y < height; y++) {
+    uint32_t* row = pixels + (size_t)y * stride;
+    float v = (y + .5f - center_y) * scale_y;
+    float origin = (.5f - center_x) * scale_x;
+
+    for (uint32_t x = 0; x < vector_width; x += 4) {
+      gradient_float4 u = origin + ((float)x + g_lanes) * scale_x;
+      gradient_float4 squared = u * u + v * v;
+      gradient_float4 t;
+      for (uint32_t lane = 0; lane < 4; lane++) t[lane] = sqrtf(squared[lane]);
+
+      gradient_int4 index = gradient_index(t);
+      for (uint32_t lane = 0; lane < 4; lane++) {
+        row[x + lane] = lut->color[index[lane]];
+      }
+    }
+    for (uint32_t x = vector_width; x < width; x++) {
+      float u = origin + x * scale_x;
+      float t = gradient_clamp(sqrtf(u * u + v * v));
+      row[x] = lut->color[(uint32_t)(t * (GRADIENT_LUT_SIZE - 1) + .5f)];
+    }
+  }
+}
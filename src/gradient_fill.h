@@ -0,0 +1,30 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Software gradient fill for drawing without CoreGraphics, e.g. headless
+// rendering and benchmarks. A gradient is sampled once into a color lookup
+// table, the fill then only maps every pixel to a table index. Pixels are
+// premultiplied ARGB words, i.e. the layout of the bitmap contexts the bar
+// renders into (kCGImageAlphaPremultipliedFirst, 32 bit host order). This
+// unit has no framework dependencies, it builds and benchmarks on any host.
+
+#define GRADIENT_LUT_SIZE 256
+
+struct gradient_lut_stop {
+  float position;
+  uint32_t color;
+};
+
+struct gradient_lut {
+  uint32_t color[GRADIENT_LUT_SIZE];
+};
+
+void gradient_lut_build(struct gradient_lut* lut, struct gradient_lut_stop* stops, uint32_t count);
+
+// The stride is given in pixels. Positions are in pixel units with the
+// origin at the top left corner of the first pixel; pixels are sampled at
+// their centers. Both fills extend the first and last color beyond the
+// gradient, as the CoreGraphics path does.
+void gradient_fill_linear(struct gradient_lut* lut, uint32_t* pixels, uint32_t width, uint32_t height, uint32_t stride, float start_x, float start_y, float end_x, float end_y);
+void gradient_fill_radial(struct gradient_lut* lut, uint32_t* pixels, uint32_t width, uint32_t height, uint32_t stride, float center_x, float center_y, float radius_h, float radius_v);
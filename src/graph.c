@@ -1,35 +1,309 @@
 #include "graph.h"
+#include "workspace.h"
 
 void graph_init(struct graph* graph) {
+  graph->y = NULL;
   graph->width = 0;
+  graph->samples = 0;
+  graph->bucket = 1;
   graph->cursor = 0;
+  graph->sequence = 0;
+  graph->series = NULL;
+  graph->series_count = 0;
 
   graph->line_width = 0.5;
   graph->fill = true;
+  graph->autoscale = false;
   graph->overrides_fill_color = false;
   graph->enabled = true;
 
+  graph_clear_pointers(graph);
   color_init(&graph->line_color, 0xffcccccc);
   color_init(&graph->fill_color, 0xffcccccc);
 }
 
+static void graph_window_push(struct graph_window* window, uint32_t capacity, uint64_t sequence, float value, bool maximum) {
+  uint64_t oldest = sequence + 1 >= capacity ? sequence + 1 - capacity : 0;
+  while (window->count > 0 && window->sequence[window->head] < oldest) {
+    if (++window->head == capacity) window->head = 0;
+    window->count--;
+  }
+
+  while (window->count > 0) {
+    uint32_t back = window->head + window->count - 1;
+    if (back >= capacity) back -= capacity;
+    if (maximum ? window->value[back] > value
+                : window->value[back] < value) {
+      break;
+    }
+    window->count--;
+  }
+
+  uint32_t tail = window->head + window->count;
+  if (tail >= capacity) tail -= capacity;
+  window->value[tail] = value;
+  window->sequence[tail] = sequence;
+  window->count++;
+}
+
+static void graph_window_destroy(struct graph_window* window) {
+  if (window->value) free(window->value);
+  if (window->sequence) free(window->sequence);
+  memset(window, 0, sizeof(struct graph_window));
+}
+
+static void graph_window_reset(struct graph_window* window, uint32_t capacity) {
+  graph_window_destroy(window);
+  window->value = malloc(sizeof(float) * capacity);
+  window->sequence = malloc(sizeof(uint64_t) * capacity);
+}
+
+// The extremum windows are only maintained while autoscaling is enabled and
+// are rebuilt from the ring buffer whenever its layout changes.
+static void graph_rebuild_windows(struct graph* graph) {
+  for (uint32_t s = 0; s < graph->series_count; s++) {
+    struct graph_series* series = &graph->series[s];
+    if (!graph->autoscale || !graph->y) {
+      graph_window_destroy(&series->low);
+      graph_window_destroy(&series->high);
+      continue;
+    }
+
+    graph_window_reset(&series->low, graph->samples);
+    graph_window_reset(&series->high, graph->samples);
+    uint64_t sequence = graph->sequence - graph->samples;
+    for (uint32_t i = 0; i < graph->samples; i++, sequence++) {
+      float y = graph_get_series_y(graph, s, i);
+      graph_window_push(&series->low, graph->samples, sequence, y, false);
+      graph_window_push(&series->high, graph->samples, sequence, y, true);
+    }
+  }
+}
+
+static void graph_series_init(struct graph* graph, struct graph_series* series) {
+  memset(series, 0, sizeof(struct graph_series));
+  series->overrides_fill_color = graph->overrides_fill_color;
+  series->line_color = graph->line_color;
+  series->fill_color = graph->fill_color;
+}
+
+static void graph_sync_primary_series(struct graph* graph) {
+  if (!graph->series) return;
+  graph->series[0].overrides_fill_color = graph->overrides_fill_color;
+  graph->series[0].line_color = graph->line_color;
+  graph->series[0].fill_color = graph->fill_color;
+}
+
 void graph_setup(struct graph* graph, uint32_t width) {
   graph->width = width;
+  graph->samples = width;
+  graph->bucket = 1;
+  graph->bucket_fill = 1;
+  graph->sequence = width;
   graph->y = malloc(sizeof(float) * width);
   memset(graph->y, 0, sizeof(float) * width);
+
+  graph->series_count = 1;
+  graph->series = malloc(sizeof(struct graph_series));
+  graph_series_init(graph, &graph->series[0]);
+  graph_rebuild_windows(graph);
+}
+
+// Keeps the newest samples when the buffer is resized. Each pixel column
+// then summarizes graph->bucket samples by their min/max envelope.
+bool graph_set_samples(struct graph* graph, uint32_t samples) {
+  if (graph->width == 0 || samples == 0) return false;
+  uint32_t bucket = (samples + graph->width - 1) / graph->width;
+  uint32_t capacity = bucket * graph->width;
+  if (capacity == graph->samples) return false;
+
+  float* y = malloc(sizeof(float) * capacity * graph->series_count);
+  memset(y, 0, sizeof(float) * capacity * graph->series_count);
+  uint32_t count = min(capacity, graph->samples);
+  for (uint32_t s = 0; s < graph->series_count; s++) {
+    float* series_y = y + (size_t)s * capacity;
+    for (uint32_t i = 0; i < count; i++) {
+      series_y[capacity - count + i] = graph_get_series_y(graph,
+                                                          s,
+                                                          graph->samples
+                                                          - count + i   );
+    }
+  }
+
+  if (graph->y) free(graph->y);
+  graph->y = y;
+  graph->samples = capacity;
+  graph->bucket = bucket;
+  graph->bucket_fill = bucket;
+  graph->cursor = 0;
+  graph->sequence = max(graph->sequence, capacity);
+  graph->raster_key = 0;
+  graph_rebuild_windows(graph);
+  return true;
+}
+
+bool graph_set_series_count(struct graph* graph, uint32_t count) {
+  if (!graph->y || count == 0 || count > GRAPH_MAX_SERIES) return false;
+  if (count == graph->series_count) return false;
+
+  uint32_t kept = min(count, graph->series_count);
+  float* y = malloc(sizeof(float) * graph->samples * count);
+  memset(y, 0, sizeof(float) * graph->samples * count);
+  memcpy(y, graph->y, sizeof(float) * graph->samples * kept);
+  free(graph->y);
+  graph->y = y;
+
+  for (uint32_t s = count; s < graph->series_count; s++) {
+    graph_window_destroy(&graph->series[s].low);
+    graph_window_destroy(&graph->series[s].high);
+  }
+
+  graph->series = realloc(graph->series,
+                          sizeof(struct graph_series) * count);
+  for (uint32_t s = graph->series_count; s < count; s++) {
+    graph_series_init(graph, &graph->series[s]);
+  }
+  graph->series_count = count;
+  graph->raster_key = 0;
+  graph_rebuild_windows(graph);
+  return true;
+}
+
+static bool graph_set_autoscale(struct graph* graph, bool autoscale) {
+  if (graph->autoscale == autoscale) return false;
+  graph->autoscale = autoscale;
+  graph_rebuild_windows(graph);
+  return true;
+}
+
+float graph_get_series_y(struct graph* graph, uint32_t series, uint32_t i) {
+  if (!graph->enabled || !graph->y) return 0.f;
+  uint32_t index = graph->cursor + i;
+  if (index >= graph->samples) index -= graph->samples;
+  return graph->y[(size_t)series * graph->samples + index];
 }
 
 float graph_get_y(struct graph* graph, uint32_t i) {
-  if (!graph->enabled) return 0.f;
-  return graph->y[ (graph->cursor + i)%graph->width ];
+  return graph_get_series_y(graph, 0, i);
+}
+
+// Pushes one sample per series; series whose bit is not set in present
+// repeat their newest sample so that all series stay aligned on the shared
+// cursor.
+static void graph_push_step(struct graph* graph, float* values, uint64_t present) {
+  uint32_t newest = graph->cursor > 0 ? graph->cursor - 1
+                                      : graph->samples - 1;
+
+  for (uint32_t s = 0; s < graph->series_count; s++) {
+    float* y = graph->y + (size_t)s * graph->samples;
+    float value = (present & (1ULL << s)) ? values[s] : y[newest];
+    y[graph->cursor] = value;
+
+    if (graph->autoscale) {
+      struct graph_series* series = &graph->series[s];
+      graph_window_push(&series->low,
+                        graph->samples,
+                        graph->sequence,
+                        value,
+                        false          );
+      graph_window_push(&series->high,
+                        graph->samples,
+                        graph->sequence,
+                        value,
+                        true           );
+    }
+  }
+  graph->sequence++;
+  if (++graph->cursor == graph->samples) graph->cursor = 0;
+
+  if (graph->bucket_fill < graph->bucket) {
+    graph->bucket_fill++;
+    graph->raster_pending = max(graph->raster_pending, 1);
+  } else {
+    // A new column starts; the previous one only needs a redraw if it was
+    // last rendered before its bucket was complete, i.e. if it is pending.
+    graph->bucket_fill = 1;
+    if (++graph->raster_cursor == graph->width) graph->raster_cursor = 0;
+    graph->raster_pending = min(graph->raster_pending + 1, graph->width);
+  }
 }
 
 void graph_push_back(struct graph* graph, float y) {
-  if (!graph->enabled) return;
-  graph->y[graph->cursor] = y;
+  if (!graph->enabled || !graph->y) return;
+  graph_push_step(graph, &y, 1);
+}
+
+// isfinite() is folded to true under -ffast-math, the exponent bits are
+// checked directly instead.
+static bool graph_is_finite(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return ((bits >> 23) & 0xff) != 0xff;
+}
+
+// Parses "v v v" (series 0) and "s0:v,v,v s1:v,v" in a single pass. The
+// n-th value of every series is pushed in the same step, series with fewer
+// values hold their newest sample.
+bool graph_push(struct graph* graph, FILE* rsp, char* message) {
+  if (!graph->enabled || !graph->y) return false;
+  uint32_t count = graph->series_count;
+  uint32_t next[GRAPH_MAX_SERIES] = { 0 };
+  float* steps = NULL;
+  uint32_t step_count = 0;
+  uint32_t step_capacity = 0;
+
+  struct token token = get_token(&message);
+  while (token.text && token.length > 0) {
+    char* cursor = token.text;
+    uint32_t series = 0;
+    if (cursor[0] == 's') {
+      char* end;
+      series = strtoul(cursor + 1, &end, 10);
+      if (end == cursor + 1 || *end != ':') {
+        respond(rsp, "[!] Push: Invalid series '%s'\n", token.text);
+        token = get_token(&message);
+        continue;
+      }
+      cursor = end + 1;
+    }
+
+    if (series >= count) {
+      respond(rsp, "[!] Push: Graph has no series 's%u'\n", series);
+      token = get_token(&message);
+      continue;
+    }
+
+    while (*cursor) {
+      char* end;
+      float value = strtof(cursor, &end);
+      if (end == cursor || (*end && *end != ',') || !graph_is_finite(value)) {
+        respond(rsp, "[!] Push: Invalid value in '%s'\n", token.text);
+        break;
+      }
+
+      if (next[series] == step_count) {
+        if (step_count == step_capacity) {
+          step_capacity = step_capacity ? 2 * step_capacity : 16;
+          steps = realloc(steps, sizeof(float) * count * step_capacity);
+        }
+        step_count++;
+      }
+      steps[(size_t)next[series]++ * count + series] = value;
+      cursor = *end ? end + 1 : end;
+    }
+    token = get_token(&message);
+  }
 
-  ++graph->cursor;
-  graph->cursor %= graph->width;
+  // Step i holds a value of every series that got more than i values
+  for (uint32_t i = 0; i < step_count; i++) {
+    uint64_t present = 0;
+    for (uint32_t s = 0; s < count; s++) {
+      if (next[s] > i) present |= 1ULL << s;
+    }
+    graph_push_step(graph, steps + (size_t)i * count, present);
+  }
+  if (steps) free(steps);
+  return step_count > 0;
 }
 
 uint32_t graph_get_length(struct graph* graph) {
@@ -37,111 +311,450 @@ uint32_t graph_get_length(struct graph* graph) {
   return 0;
 }
 
-void graph_calculate_bounds(struct graph* graph, uint32_t x, uint32_t y, uint32_t height) {
-  graph->bounds.size.height = height;
-  graph->bounds.origin.x = x;
-  graph->bounds.origin.y = y - graph->bounds.size.height / 2
-                           + graph->line_width;
+static float graph_normalize(struct graph* graph, float y) {
+  if (!graph->autoscale) return y;
+  float range = graph->scale_high - graph->scale_low;
+  if (range <= 0.f) return 0.f;
+  return (y - graph->scale_low) / range;
 }
 
-void graph_draw(struct graph* graph, CGContextRef context) {
-  uint32_t x =  graph->bounds.origin.x + (graph->rtl ? graph->width : 0);
-  uint32_t y = graph->bounds.origin.y;
-  uint32_t height = graph->bounds.size.height;
+static uint64_t graph_get_raster_key(struct graph* graph, float scale) {
+  uint64_t hash = hash_combine(0xcbf29ce484222325ULL, graph->width);
+  hash = hash_combine(hash, graph->bucket);
+  hash = hash_combine(hash, graph->fill);
+  hash = hash_float(hash, graph->line_width);
+  hash = hash_float(hash, graph->bounds.size.height);
+  hash = hash_float(hash, scale);
+
+  hash = hash_combine(hash, graph->series_count);
+  for (uint32_t s = 0; s < graph->series_count; s++) {
+    hash = hash_combine(hash, graph->series[s].overrides_fill_color);
+    hash = hash_combine(hash, graph->series[s].line_color.hex);
+    hash = hash_combine(hash, graph->series[s].fill_color.hex);
+  }
+
+  hash = hash_combine(hash, graph->autoscale);
+  if (graph->autoscale) {
+    hash = hash_float(hash, graph->scale_low);
+    hash = hash_float(hash, graph->scale_high);
+  }
+  return hash;
+}
+
+static void graph_draw_series_column(struct graph* graph, uint32_t series_index, uint32_t slot, int64_t start, int64_t end) {
+  CGContextRef context = graph->raster;
+  struct graph_series* series = &graph->series[series_index];
+  float height = graph->bounds.size.height;
+
+  float low = graph_get_series_y(graph, series_index, start);
+  float high = low;
+  float last = low;
+  for (int64_t i = start + 1; i < end; i++) {
+    last = graph_get_series_y(graph, series_index, i);
+    if (last < low) low = last;
+    if (last > high) high = last;
+  }
+  float previous = start > 0
+                   ? graph_get_series_y(graph, series_index, start - 1)
+                   : low;
+
+  low = graph_normalize(graph, low) * height;
+  high = graph_normalize(graph, high) * height;
+  last = graph_normalize(graph, last) * height;
+  previous = graph_normalize(graph, previous) * height;
 
-  uint32_t sample_width = 1;
-  bool fill = graph->fill;
-  CGContextSaveGState(context);
   CGContextSetRGBStrokeColor(context,
-                             graph->line_color.r,
-                             graph->line_color.g,
-                             graph->line_color.b,
-                             graph->line_color.a );
+                             series->line_color.r,
+                             series->line_color.g,
+                             series->line_color.b,
+                             series->line_color.a );
 
-  if (graph->overrides_fill_color)
+  if (series->overrides_fill_color)
     CGContextSetRGBFillColor(context,
-                             graph->fill_color.r,
-                             graph->fill_color.g,
-                             graph->fill_color.b,
-                             graph->fill_color.a );
+                             series->fill_color.r,
+                             series->fill_color.g,
+                             series->fill_color.b,
+                             series->fill_color.a );
   else
     CGContextSetRGBFillColor(context,
-                             graph->line_color.r,
-                             graph->line_color.g,
-                             graph->line_color.b,
-                             0.2 * graph->line_color.a);
+                             series->line_color.r,
+                             series->line_color.g,
+                             series->line_color.b,
+                             0.2 * series->line_color.a);
 
-  CGContextSetLineWidth(context, graph->line_width);
   CGMutablePathRef p = CGPathCreateMutable();
-  uint32_t start_x = x;
-  if (graph->rtl) {
-    CGPathMoveToPoint(p,
-                      NULL,
-                      x,
-                      y + graph_get_y(graph, graph->width - 1) * height);
-
-    for (int i = graph->width - 1; i > 0; --i, x -= sample_width) {
-      CGPathAddLineToPoint(p, NULL, x, y + graph_get_y(graph, i) * height);
-    }
-  }
-  else {
-    CGPathMoveToPoint(p, NULL, x, y + graph_get_y(graph, 0) * height);
-    for (int i = graph->width - 1; i > 0; --i, x += sample_width) {
-      CGPathAddLineToPoint(p, NULL, x, y + graph_get_y(graph, i) * height);
-    }
+  CGPathMoveToPoint(p, NULL, slot, previous);
+  if (low != high) {
+    CGPathAddLineToPoint(p, NULL, slot + 0.5f, low);
+    CGPathAddLineToPoint(p, NULL, slot + 0.5f, high);
   }
+  CGPathAddLineToPoint(p, NULL, slot + 1.f, last);
   CGContextAddPath(context, p);
   CGContextStrokePath(context);
-  if (fill) {
-    if (graph->rtl) {
-      CGPathAddLineToPoint(p, NULL, x + sample_width, y);
-    }
-    else {
-      CGPathAddLineToPoint(p, NULL, x - sample_width, y);
-    }
-    CGPathAddLineToPoint(p, NULL, start_x, y);
-    CGPathCloseSubpath(p);
-    CGContextAddPath(context, p);
+
+  if (graph->fill) {
+    CGMutablePathRef f = CGPathCreateMutable();
+    CGPathMoveToPoint(f, NULL, slot, 0);
+    CGPathAddLineToPoint(f, NULL, slot, previous);
+    if (low != high) CGPathAddLineToPoint(f, NULL, slot + 0.5f, high);
+    CGPathAddLineToPoint(f, NULL, slot + 1.f, last);
+    CGPathAddLineToPoint(f, NULL, slot + 1.f, 0);
+    CGPathCloseSubpath(f);
+    CGContextAddPath(context, f);
     CGContextFillPath(context);
+    CGPathRelease(f);
   }
   CGPathRelease(p);
+}
+
+// Draws the logical column (0 being the newest) into its slot of the ring
+// raster. The raster is always laid out right-to-left; graph_draw mirrors it
+// for left-to-right graphs.
+static void graph_draw_column(struct graph* graph, uint32_t column) {
+  CGContextRef context = graph->raster;
+  uint32_t slot = graph->raster_cursor >= column
+                  ? graph->raster_cursor - column
+                  : graph->raster_cursor + graph->width - column;
+
+  CGRect rect = {{slot, 0}, {1, graph->bounds.size.height}};
+  CGContextSaveGState(context);
+  CGContextClipToRect(context, rect);
+  CGContextClearRect(context, rect);
+
+  int64_t end = (int64_t)graph->samples - graph->bucket_fill;
+  if (column > 0) end -= (int64_t)(column - 1) * graph->bucket;
+  int64_t start = column > 0 ? end - graph->bucket : end;
+  if (column == 0) end = graph->samples;
+  if (start < 0) start = 0;
+
+  if (end > 0) {
+    for (uint32_t s = 0; s < graph->series_count; s++) {
+      graph_draw_series_column(graph, s, slot, start, end);
+    }
+  }
+  CGContextRestoreGState(context);
+}
+
+static void graph_release_raster_data(void* info, const void* data, size_t size) {
+  free((void*)data);
+}
+
+static void graph_release_raster(struct graph* graph) {
+  if (graph->raster) CGContextRelease(graph->raster);
+  if (graph->raster_image) CGImageRelease(graph->raster_image);
+  if (graph->raster_provider) CGDataProviderRelease(graph->raster_provider);
+  graph->raster_image = NULL;
+  graph->raster_provider = NULL;
+  graph->raster = NULL;
+}
+
+// A new image is wrapped around the unchanged pixels after every update,
+// such that nothing cached for the previous image is drawn.
+static void graph_update_raster_image(struct graph* graph) {
+  if (graph->raster_image) CGImageRelease(graph->raster_image);
+  CGColorSpaceRef color_space = CGColorSpaceCreateDeviceRGB();
+  graph->raster_image = CGImageCreate(CGBitmapContextGetWidth(graph->raster),
+                                      CGBitmapContextGetHeight(graph->raster),
+                                      8,
+                                      32,
+                                      CGBitmapContextGetBytesPerRow(graph->raster),
+                                      color_space,
+                                      kCGImageAlphaPremultipliedFirst
+                                      | kCGBitmapByteOrder32Host,
+                                      graph->raster_provider,
+                                      NULL,
+                                      false,
+                                      kCGRenderingIntentDefault      );
+  CGColorSpaceRelease(color_space);
+}
+
+static bool graph_create_raster(struct graph* graph, float scale) {
+  graph_release_raster(graph);
+
+  uint32_t width = (uint32_t)ceilf(graph->width * scale);
+  uint32_t height = (uint32_t)ceilf(graph->bounds.size.height * scale);
+  if (width == 0 || height == 0) return false;
+
+  size_t bytes_per_row = (size_t)width * 4;
+  void* data = calloc(height, bytes_per_row);
+  if (!data) return false;
+
+  CGColorSpaceRef color_space = CGColorSpaceCreateDeviceRGB();
+  graph->raster = CGBitmapContextCreate(data,
+                                        width,
+                                        height,
+                                        8,
+                                        bytes_per_row,
+                                        color_space,
+                                        kCGImageAlphaPremultipliedFirst
+                                        | kCGBitmapByteOrder32Host    );
+  CGColorSpaceRelease(color_space);
+  if (!graph->raster) {
+    free(data);
+    return false;
+  }
+
+  graph->raster_provider = CGDataProviderCreateWithData(NULL,
+                                                        data,
+                                                        height*bytes_per_row,
+                                                        graph_release_raster_data);
+
+  CGContextScaleCTM(graph->raster, scale, scale);
+  CGContextSetLineWidth(graph->raster, graph->line_width);
+  return true;
+}
+
+// The autoscale range snaps to multiples of a power of two step of about
+// an eighth of the data range. It is only recomputed once the data leaves
+// it or fills less than half of it, such that the raster is not rebuilt on
+// every push.
+static void graph_update_scale(struct graph* graph) {
+  float low = graph->series[0].low.value[graph->series[0].low.head];
+  float high = graph->series[0].high.value[graph->series[0].high.head];
+  for (uint32_t s = 1; s < graph->series_count; s++) {
+    struct graph_series* series = &graph->series[s];
+    low = min(low, series->low.value[series->low.head]);
+    high = max(high, series->high.value[series->high.head]);
+  }
+
+  float range = graph->scale_high - graph->scale_low;
+  if (low >= graph->scale_low && high <= graph->scale_high
+      && high - low >= 0.5f * range && range > 0.f) {
+    return;
+  }
+
+  float extent = high - low;
+  if (extent <= 0.f) extent = max(fabsf(high), 1.f);
+  float step = exp2f(ceilf(log2f(extent))) / 8.f;
+  graph->scale_low = floorf(low / step) * step;
+  graph->scale_high = ceilf(high / step) * step;
+  if (graph->scale_high <= graph->scale_low) graph->scale_high += step;
+}
+
+// Runs on the main thread before the (possibly threaded) draw: only pending
+// columns are re-rasterized, a full rebuild happens when the appearance or
+// the autoscale range changes. The render threads blit the backing store
+// of the raster directly, the threads are joined before the next update.
+static void graph_update_raster(struct graph* graph) {
+  if (!graph->enabled || !graph->y || graph->width == 0) return;
+
+  if (graph->autoscale) graph_update_scale(graph);
+
+  float scale = workspace_get_scale();
+  uint64_t key = graph_get_raster_key(graph, scale);
+
+  if (key != graph->raster_key || !graph->raster) {
+    if (!graph_create_raster(graph, scale)) return;
+    graph->raster_key = key;
+    graph->raster_pending = graph->width;
+  }
+
+  if (graph->raster_pending == 0 && graph->raster_image) return;
+  for (uint32_t i = 0; i < graph->raster_pending; i++) {
+    graph_draw_column(graph, i);
+  }
+  graph->raster_pending = 0;
+  graph_update_raster_image(graph);
+}
+
+void graph_calculate_bounds(struct graph* graph, uint32_t x, uint32_t y, uint32_t height) {
+  graph->bounds.size.height = height;
+  graph->bounds.origin.x = x;
+  graph->bounds.origin.y = y - graph->bounds.size.height / 2
+                           + graph->line_width;
+
+  graph_update_raster(graph);
+}
+
+void graph_draw(struct graph* graph, CGContextRef context) {
+  if (!graph->enabled || !graph->raster_image) return;
+  CGRect frame = {graph->bounds.origin,
+                  {graph->width, graph->bounds.size.height}};
+
+  CGContextSaveGState(context);
+  CGContextClipToRect(context, frame);
+  CGContextTranslateCTM(context, frame.origin.x, frame.origin.y);
+  if (!graph->rtl) {
+    CGContextTranslateCTM(context, frame.size.width, 0);
+    CGContextScaleCTM(context, -1, 1);
+  }
+
+  // The oldest column sits right after the newest one in the ring raster,
+  // so the image is blitted twice to unroll it.
+  float shift = graph->raster_cursor + 1;
+  CGRect image_rect = {{-shift, 0}, frame.size};
+  CGContextDrawImage(context, image_rect, graph->raster_image);
+  image_rect.origin.x += frame.size.width;
+  CGContextDrawImage(context, image_rect, graph->raster_image);
   CGContextRestoreGState(context);
 }
 
-void graph_serialize(struct graph* graph, char* indent, FILE* rsp) {
-    fprintf(rsp, "%s\"color\": \"0x%x\",\n"
-                 "%s\"fill_color\": \"0x%x\",\n"
-                 "%s\"line_width\": \"%f\",\n"
-                 "%s\"data\": [\n",
-                 indent, graph->line_color.hex,
-                 indent, graph->fill_color.hex,
-                 indent, graph->line_width, indent);
-    int counter = 0;
-    for (int i = 0; i < graph->width; i++) {
-      if (counter++ > 0) fprintf(rsp, ",\n");
-      fprintf(rsp, "%s\t\"%f\"", indent, graph->y[i]);
+void graph_clear_pointers(struct graph* graph) {
+  graph->raster = NULL;
+  graph->raster_provider = NULL;
+  graph->raster_image = NULL;
+  graph->raster_key = 0;
+  graph->raster_cursor = 0;
+  graph->raster_pending = 0;
+  graph->bucket_fill = graph->bucket;
+}
+
+void graph_copy(struct graph* graph, struct graph* source) {
+  graph_clear_pointers(graph);
+  graph->y = NULL;
+  graph->series = NULL;
+  if (!source->y) return;
+
+  size_t count = (size_t)source->samples * source->series_count;
+  graph->y = malloc(sizeof(float) * count);
+  memcpy(graph->y, source->y, sizeof(float) * count);
+
+  graph->series = malloc(sizeof(struct graph_series)
+                         * source->series_count);
+  for (uint32_t s = 0; s < source->series_count; s++) {
+    graph->series[s] = source->series[s];
+    memset(&graph->series[s].low, 0, sizeof(struct graph_window));
+    memset(&graph->series[s].high, 0, sizeof(struct graph_window));
+  }
+
+  graph->raster_cursor = source->raster_cursor;
+  graph->bucket_fill = source->bucket_fill;
+  graph_rebuild_windows(graph);
+}
+
+static void graph_serialize_data(struct graph* graph, uint32_t series, struct json* json) {
+  if (json_array_begin(json, "data")) {
+    float* y = graph->y + (size_t)series * graph->samples;
+    for (int i = 0; i < graph->samples; i++) {
+      char value[32];
+      snprintf(value, 32, "%f", y[i]);
+      json_string(json, NULL, value);
+    }
+  }
+  json_array_end(json);
+}
+
+void graph_serialize(struct graph* graph, struct json* json) {
+    char line_width[32];
+    snprintf(line_width, 32, "%f", graph->line_width);
+
+    json_color(json, "color", graph->line_color.hex);
+    json_color(json, "fill_color", graph->fill_color.hex);
+    json_string(json, "line_width", line_width);
+    json_uint(json, "samples", graph->samples);
+    json_string(json, "autoscale", format_bool(graph->autoscale));
+
+    if (!graph->y) {
+      json_array_begin(json, "data");
+      json_array_end(json);
+      return;
     }
-    fprintf(rsp, "\n%s]", indent);
+    graph_serialize_data(graph, 0, json);
+    if (graph->series_count < 2) return;
+
+    json_array_begin(json, "series");
+    for (uint32_t s = 0; s < graph->series_count; s++) {
+      json_object_begin(json, NULL);
+      json_color(json, "color", graph->series[s].line_color.hex);
+      json_color(json, "fill_color", graph->series[s].fill_color.hex);
+      graph_serialize_data(graph, s, json);
+      json_object_end(json);
+    }
+    json_array_end(json);
 }
 
 void graph_destroy(struct graph* graph) {
-  if (!graph->enabled) return;
+  graph_release_raster(graph);
+  graph_clear_pointers(graph);
+
+  for (uint32_t s = 0; s < graph->series_count; s++) {
+    graph_window_destroy(&graph->series[s].low);
+    graph_window_destroy(&graph->series[s].high);
+  }
+  if (graph->series) free(graph->series);
+  graph->series = NULL;
+  graph->series_count = 0;
+
   if (graph->y) free(graph->y);
   graph->y = NULL;
 }
 
+static bool graph_parse_series(struct graph* graph, FILE* rsp, struct token series_token, struct token property, char* message) {
+  char* end;
+  uint32_t index = strtoul(series_token.text + 1, &end, 10);
+  if (end == series_token.text + 1 || *end
+      || index >= graph->series_count) {
+    respond(rsp, "[!] Graph: Invalid series '%s'\n", series_token.text);
+    return false;
+  }
+
+  struct graph_series* series = &graph->series[index];
+  bool needs_refresh = false;
+  if (token_equals(property, PROPERTY_COLOR)) {
+    needs_refresh = color_set_hex(&series->line_color,
+                                  token_to_uint32t(get_token(&message)));
+  } else if (token_equals(property, PROPERTY_FILL_COLOR)) {
+    series->overrides_fill_color = true;
+    needs_refresh = color_set_hex(&series->fill_color,
+                                  token_to_uint32t(get_token(&message)));
+  } else {
+    struct key_value_pair key_value_pair = get_key_value_pair(property.text,
+                                                              '.'           );
+    if (key_value_pair.key && key_value_pair.value) {
+      struct token subdom = {key_value_pair.key,strlen(key_value_pair.key)};
+      struct token entry = {key_value_pair.value,strlen(key_value_pair.value)};
+      if (token_equals(subdom, SUB_DOMAIN_COLOR)) {
+        needs_refresh = color_parse_sub_domain(&series->line_color,
+                                               rsp,
+                                               entry,
+                                               message             );
+      }
+      else if (token_equals(subdom, SUB_DOMAIN_FILL_COLOR)) {
+        series->overrides_fill_color = true;
+        needs_refresh = color_parse_sub_domain(&series->fill_color,
+                                               rsp,
+                                               entry,
+                                               message             );
+      }
+      else {
+        respond(rsp, "[!] Graph: Invalid subdomain '%s'\n", subdom.text);
+      }
+    }
+    else {
+      respond(rsp, "[!] Graph: Invalid property '%s'\n", property.text);
+    }
+  }
+
+  if (index == 0) {
+    graph->overrides_fill_color = series->overrides_fill_color;
+    graph->line_color = series->line_color;
+    graph->fill_color = series->fill_color;
+  }
+  return needs_refresh;
+}
+
 bool graph_parse_sub_domain(struct graph* graph, FILE* rsp, struct token property, char* message) {
+  bool needs_refresh = false;
   if (token_equals(property, PROPERTY_COLOR)) {
-    return color_set_hex(&graph->line_color,
-                         token_to_uint32t(get_token(&message)));
+    needs_refresh = color_set_hex(&graph->line_color,
+                                  token_to_uint32t(get_token(&message)));
   } else if (token_equals(property, PROPERTY_FILL_COLOR)) {
     graph->overrides_fill_color = true;
-    return color_set_hex(&graph->fill_color,
-                         token_to_uint32t(get_token(&message)));
+    needs_refresh = color_set_hex(&graph->fill_color,
+                                  token_to_uint32t(get_token(&message)));
   } else if (token_equals(property, PROPERTY_LINE_WIDTH)) {
     graph->line_width = token_to_float(get_token(&message));
     return true;
-  } 
+  } else if (token_equals(property, PROPERTY_SAMPLES)) {
+    return graph_set_samples(graph, token_to_uint32t(get_token(&message)));
+  } else if (token_equals(property, PROPERTY_SERIES)) {
+    return graph_set_series_count(graph,
+                                  token_to_uint32t(get_token(&message)));
+  } else if (token_equals(property, PROPERTY_AUTOSCALE)) {
+    return graph_set_autoscale(graph,
+                               evaluate_boolean_state(get_token(&message),
+                                                      graph->autoscale    ));
+  }
   else {
     struct key_value_pair key_value_pair = get_key_value_pair(property.text,
                                                               '.'           );
@@ -149,10 +762,19 @@ bool graph_parse_sub_domain(struct graph* graph, FILE* rsp, struct token propert
       struct token subdom = {key_value_pair.key,strlen(key_value_pair.key)};
       struct token entry = {key_value_pair.value,strlen(key_value_pair.value)};
       if (token_equals(subdom, SUB_DOMAIN_COLOR)) {
-        return color_parse_sub_domain(&graph->line_color, rsp, entry, message);
+        needs_refresh = color_parse_sub_domain(&graph->line_color,
+                                               rsp,
+                                               entry,
+                                               message           );
       }
       else if (token_equals(subdom, SUB_DOMAIN_FILL_COLOR)) {
-        return color_parse_sub_domain(&graph->fill_color, rsp, entry, message);
+        needs_refresh = color_parse_sub_domain(&graph->fill_color,
+                                               rsp,
+                                               entry,
+                                               message           );
+      }
+      else if (subdom.text[0] == 's' && graph->series) {
+        return graph_parse_series(graph, rsp, subdom, entry, message);
       }
       else {
         respond(rsp, "[!] Graph: Invalid subdomain '%s'\n", subdom.text);
@@ -162,5 +784,7 @@ bool graph_parse_sub_domain(struct graph* graph, FILE* rsp, struct token propert
       respond(rsp, "[!] Graph: Invalid property '%s'\n", property.text);
     }
   }
-  return false;
+
+  graph_sync_primary_series(graph);
+  return needs_refresh;
 }
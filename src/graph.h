@@ -1,18 +1,62 @@
 #pragma once
 #include "misc/helpers.h"
+#include "json.h"
 #include "color.h"
 
+#define GRAPH_MAX_SERIES 64
+
+// Monotonic queue of (sequence, value) pairs yielding the extremum of the
+// samples currently held in the ring buffer in amortized O(1) per push.
+struct graph_window {
+  float* value;
+  uint64_t* sequence;
+  uint32_t head;
+  uint32_t count;
+};
+
+struct graph_series {
+  bool overrides_fill_color;
+  struct color line_color;
+  struct color fill_color;
+
+  struct graph_window low;
+  struct graph_window high;
+};
+
 struct graph {
   bool rtl;
   bool fill;
   bool enabled;
+  bool autoscale;
   bool overrides_fill_color;
 
+  // Samples are stored series-major: series s occupies
+  // y[s * samples, (s + 1) * samples) and all series share the cursor.
   float* y;
   uint32_t width;
+  uint32_t samples;
+  uint32_t bucket;
   uint32_t cursor;
+  uint64_t sequence;
   float line_width;
 
+  struct graph_series* series;
+  uint32_t series_count;
+
+  // Columns are rendered incrementally into a ring raster: the newest column
+  // lives at raster_cursor and only pending columns are redrawn on update.
+  // The image wraps the backing store of the raster without copying it,
+  // the provider frees the pixels once the last image is released.
+  CGContextRef raster;
+  CGDataProviderRef raster_provider;
+  CGImageRef raster_image;
+  uint64_t raster_key;
+  uint32_t raster_cursor;
+  uint32_t raster_pending;
+  uint32_t bucket_fill;
+  float scale_low;
+  float scale_high;
+
   CGRect bounds;
   struct color line_color;
   struct color fill_color;
@@ -20,13 +64,19 @@ struct graph {
 
 void graph_init(struct graph* graph);
 void graph_setup(struct graph* graph, uint32_t width);
+bool graph_set_samples(struct graph* graph, uint32_t samples);
+bool graph_set_series_count(struct graph* graph, uint32_t count);
 void graph_push_back(struct graph* graph, float y);
+bool graph_push(struct graph* graph, FILE* rsp, char* message);
 float graph_get_y(struct graph* graph, uint32_t i);
+float graph_get_series_y(struct graph* graph, uint32_t series, uint32_t i);
 uint32_t graph_get_length(struct graph* graph);
 
 void graph_calculate_bounds(struct graph* graph, uint32_t x, uint32_t y, uint32_t height);
 void graph_draw(struct graph* graph, CGContextRef context);
+void graph_copy(struct graph* graph, struct graph* source);
+void graph_clear_pointers(struct graph* graph);
 void graph_destroy(struct graph* graph);
 
-void graph_serialize(struct graph* graph, char* indent, FILE* rsp);
+void graph_serialize(struct graph* graph, struct json* json);
 bool graph_parse_sub_domain(struct graph* graph, FILE* rsp, struct token property, char* message);
@@ -137,12 +137,10 @@ void group_calculate_bounds(struct group* group, struct bar* bar, uint32_t y) {
                               group->members[0]->background.bounds.size.height);
 }
 
-void group_serialize(struct group* group, char* indent, FILE* rsp) {
-    int counter = 0;
-    for (int i = 1; i < group->num_members; i++) {
-      if (!group->members[i]) continue;
-      if (counter++ > 0) fprintf(rsp, ",\n");
-      fprintf(rsp, "%s\"%s\"", indent, group->members[i]->name);
-    }
+void group_serialize(struct group* group, struct json* json) {
+  for (int i = 1; i < group->num_members; i++) {
+    if (!group->members[i]) continue;
+    json_string(json, NULL, group->members[i]->name);
+  }
 }
 
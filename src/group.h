@@ -26,4 +26,4 @@ uint32_t group_get_length(struct group* group, struct bar* bar);
 void group_calculate_bounds(struct group* group, struct bar* bar, uint32_t y);
 void group_destroy(struct group* group);
 
-void group_serialize(struct group* group, char* indent, FILE* rsp);
+void group_serialize(struct group* group, struct json* json);
@@ -1,13 +1,27 @@
 #include "bar_manager.h"
+#include "hotload.h"
 #include "event.h"
+#include "reconcile.h"
+#include "batch.h"
+#include "startup.h"
 #include <ApplicationServices/ApplicationServices.h>
 #include <libgen.h>
+#include <errno.h>
 
 extern char g_config_file[4096];
 extern char g_name[256];
-bool g_hotload = false;
+int g_hotload = false;
 int64_t g_last_hotload = 0;
 
+// Number of config executions, and the one currently running
+static uint32_t g_config_runs = 0;
+static uint32_t g_config_run = 0;
+
+struct config_run {
+  dispatch_source_t source;
+  uint32_t run;
+};
+
 void hotload_set_state(int state) {
   g_hotload = state;
 }
@@ -43,10 +57,111 @@ static bool get_config_file(char *restrict filename, char *restrict buffer, int
   return file_exists(buffer);
 }
 
+static void reconcile_finish() {
+  g_bar_manager.reconciling = false;
+  struct snapshot shadow = g_bar_manager.shadow;
+  snapshot_init(&g_bar_manager.shadow);
+
+  struct reconcile_stats stats;
+  char* delta = reconcile_diff(&g_bar_manager.config, &shadow, &stats);
+  if (delta) {
+    handle_message(delta, MACH_PORT_NULL, NULL);
+    free(delta);
+    printf("reconciled config: %u added, %u removed, %u recreated, "
+           "%u properties changed\n", stats.added,
+                                       stats.removed,
+                                       stats.recreated,
+                                       stats.changed   );
+  } else {
+    char* batch = snapshot_batch(&shadow);
+    bar_manager_destroy(&g_bar_manager);
+    bar_manager_init(&g_bar_manager);
+    bar_manager_begin(&g_bar_manager);
+    handle_message(batch, MACH_PORT_NULL, NULL);
+    free(batch);
+    printf("reconciled config: rebuilt all items\n");
+  }
+
+  snapshot_destroy(&g_bar_manager.config);
+  g_bar_manager.config = shadow;
+
+  // Restored items the config still adds are now owned by it
+  for (uint32_t i = 0; i < g_bar_manager.bar_item_count; i++)
+    g_bar_manager.bar_items[i]->restored = false;
+}
+
+static void reconcile_timeout(void* context) {
+  uint32_t run = (uint32_t)(uintptr_t)context;
+  if (run != g_config_run || !g_bar_manager.reconciling) return;
+  printf("config still running after %us, reconciling its commands so far\n",
+         RECONCILE_TIMEOUT                                                    );
+  reconcile_finish();
+}
+
+static void config_exited(uint32_t run) {
+  if (run != g_config_run) return;
+  g_config_run = 0;
+  startup_config_exited(&g_startup);
+  if (g_bar_manager.reconciling) reconcile_finish();
+}
+
+static void config_exit_handler(void* context) {
+  struct config_run* config_run = context;
+  uint32_t run = config_run->run;
+  dispatch_source_cancel(config_run->source);
+  dispatch_release(config_run->source);
+  free(config_run);
+  config_exited(run);
+}
+
+static void config_exited_async(void* context) {
+  config_exited((uint32_t)(uintptr_t)context);
+}
+
+static void watch_config_exit(pid_t pid, uint32_t run) {
+  struct config_run* config_run = malloc(sizeof(struct config_run));
+  config_run->run = run;
+  config_run->source = dispatch_source_create(DISPATCH_SOURCE_TYPE_PROC,
+                                              pid,
+                                              DISPATCH_PROC_EXIT,
+                                              dispatch_get_main_queue());
+  if (!config_run->source) {
+    free(config_run);
+    g_config_run = 0;
+    return;
+  }
+
+  dispatch_set_context(config_run->source, config_run);
+  dispatch_source_set_event_handler_f(config_run->source,
+                                      config_exit_handler);
+  dispatch_resume(config_run->source);
+
+  // The config might have exited (and been reaped) before the source was
+  // armed, in which case it never fires
+  if (kill(pid, 0) == -1 && errno == ESRCH) {
+    dispatch_source_cancel(config_run->source);
+    dispatch_release(config_run->source);
+    free(config_run);
+    dispatch_async_f(dispatch_get_main_queue(), (void*)(uintptr_t)run,
+                                                config_exited_async     );
+  }
+}
+
+// Declarative configs are applied in-process as a single batch, tagged as
+// a config run such that they are journaled and reconciled like a script
+static void load_config_batch() {
+  g_config_run = ++g_config_runs;
+  handle_batch_file(g_config_file, g_config_run, NULL);
+  config_exited(g_config_run);
+}
+
 void exec_config_file() {
   if (!*g_config_file
-    && !get_config_file("sketchybarrc", g_config_file, sizeof(g_config_file))) {
+    && !get_config_file("sketchybarrc", g_config_file, sizeof(g_config_file))
+    && !get_config_file("sketchybarrc" BATCH_EXTENSION, g_config_file,
+                                                         sizeof(g_config_file))) {
     printf("could not locate config file..\n");
+    startup_config_exited(&g_startup);
     return;
   }
 
@@ -58,15 +173,65 @@ void exec_config_file() {
   setenv("CONFIG_DIR", dirname(g_config_file), 1);
   chdir(dirname(g_config_file));
 
+  if (batch_is_config(g_config_file)) {
+    load_config_batch();
+    return;
+  }
+
   if (!ensure_executable_permission(g_config_file)) {
     printf("could not set the executable permission bit for '%s'\n", g_config_file);
+    startup_config_exited(&g_startup);
     return;
   }
 
-  if (!fork_exec(g_config_file, NULL)) {
+  // A new run supersedes the previous one, even if it has not exited yet
+  g_config_run = 0;
+  char run[16];
+  snprintf(run, sizeof(run), "%u", ++g_config_runs);
+  setenv(CONFIG_RUN_ENV, run, 1);
+  pid_t pid = fork_exec_pid(g_config_file, NULL);
+  unsetenv(CONFIG_RUN_ENV);
+
+  if (pid == -1) {
     printf("failed to execute file '%s'\n", g_config_file);
+    startup_config_exited(&g_startup);
     return;
   }
+
+  g_config_run = g_config_runs;
+  watch_config_exit(pid, g_config_run);
+}
+
+bool is_config_run(uint32_t run) {
+  return run != 0 && run == g_config_run;
+}
+
+void reload_config() {
+  bar_manager_destroy(&g_bar_manager);
+  bar_manager_init(&g_bar_manager);
+  bar_manager_begin(&g_bar_manager);
+  if (restore_snapshot()) reconcile_config();
+  else exec_config_file();
+}
+
+// The config is executed against the shadow journal and only the difference
+// to the last config run is applied once the config process exited
+void reconcile_config() {
+  snapshot_destroy(&g_bar_manager.shadow);
+  g_bar_manager.reconciling = true;
+  exec_config_file();
+  if (!g_config_run) {
+    g_bar_manager.reconciling = false;
+    return;
+  }
+
+  // A config which never exits is reconciled after the timeout, its later
+  // messages are applied directly
+  dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW,
+                                 RECONCILE_TIMEOUT * NSEC_PER_SEC),
+                   dispatch_get_main_queue(),
+                   (void*)(uintptr_t)g_config_run,
+                   reconcile_timeout                               );
 }
 
 static void handler(ConstFSEventStreamRef stream, void* context, size_t count, void* paths, const FSEventStreamEventFlags* flags, const FSEventStreamEventId* ids) {
@@ -2,8 +2,19 @@
 
 #define HOTLOAD_STATE_ENABLED true
 #define HOTLOAD_STATE_DISABLED false
+#define HOTLOAD_STATE_RECONCILE 2
+
+// Set for the config process, its messages are tagged with the run
+#define CONFIG_RUN_ENV "BAR_CONFIG_RUN"
+
+// Seconds a reconciled config may run before the commands it sent so far are
+// applied, configs which never exit are reconciled at this point
+#define RECONCILE_TIMEOUT 10
 
 void exec_config_file();
+void reload_config();
+void reconcile_config();
+bool is_config_run(uint32_t run);
 void begin_receiving_config_change_events();
 void hotload_set_state(int state);
 int hotload_get_state();
@@ -3,11 +3,16 @@
 #include "shadow.h"
 #include "workspace.h"
 #include "media.h"
+#include "image_cache.h"
+#include "event.h"
 
 void image_init(struct image* image) {
   image->enabled = false;
   image->image_ref = NULL;
-  image->data_ref = NULL;
+  image->hash = 0;
+  image->generation = 0;
+  image->variant_ref = NULL;
+  image->variant_scale = 0.f;
   image->bounds = CGRectNull;
   image->size = CGSizeZero;
   image->scale = 1.0;
@@ -16,6 +21,7 @@ void image_init(struct image* image) {
   image->corner_radii.top_right = 0;
   image->corner_radii.bottom_left = 0;
   image->corner_radii.bottom_right = 0;
+  image->shape.path = NULL;
   image->border_width = 0;
   image->y_offset = 0;
   image->padding_left = 0;
@@ -39,63 +45,246 @@ bool image_set_link(struct image* image, struct image* link) {
   return true;
 }
 
+static bool image_set_image_with_hash(struct image* image, CGImageRef new_image_ref, CGRect bounds, uint64_t hash, bool forced);
+
+static struct image_request** g_image_requests = NULL;
+static uint32_t g_image_request_count = 0;
+
+static struct image_request* image_request_create(struct image* image, char type, char* source) {
+  struct image_request* request = malloc(sizeof(struct image_request));
+  memset(request, 0, sizeof(struct image_request));
+  request->image = image;
+  request->owner = g_bar_manager.animator.owner;
+  request->type = type;
+  request->source = source ? string_copy(source) : NULL;
+  request->scale = 1.f;
+  return request;
+}
+
+static void image_request_destroy(struct image_request* request) {
+  if (request->image_ref) {
+    image_cache_release(&g_image_cache, request->image_ref);
+    CGImageRelease(request->image_ref);
+  }
+  if (request->source_ref) CGImageRelease(request->source_ref);
+  if (request->source) free(request->source);
+  free(request);
+}
+
+static CGImageRef image_create_scaled_copy(CGImageRef source, CGSize size) {
+  CGColorSpaceRef color_space = CGColorSpaceCreateDeviceRGB();
+  CGContextRef context = CGBitmapContextCreate(NULL,
+                                               size.width,
+                                               size.height,
+                                               8,
+                                               0,
+                                               color_space,
+                                               kCGImageAlphaPremultipliedFirst
+                                               | kCGBitmapByteOrder32Host    );
+  CGColorSpaceRelease(color_space);
+  if (!context) return NULL;
+
+  CGContextSetInterpolationQuality(context, kCGInterpolationHigh);
+  CGContextDrawImage(context,
+                     (CGRect){{0, 0}, {size.width, size.height}},
+                     source                                      );
+
+  CGImageRef image_ref = CGBitmapContextCreateImage(context);
+  CGContextRelease(context);
+  return image_ref;
+}
+
+// Runs on any thread and only touches the request itself, never the image.
+// App icons are resolved through NSWorkspace and hence only on the main
+// thread.
+static void image_request_load(struct image_request* request) {
+  if (request->cancelled) return;
+
+  if (request->type == IMAGE_REQUEST_APP) {
+    request->image_ref = image_cache_load_app(&g_image_cache,
+                                              request->source,
+                                              request->scale,
+                                              &request->hash  );
+  } else if (request->type == IMAGE_REQUEST_SPACE) {
+    request->image_ref = space_capture(atoi(request->source));
+    request->hash = 0;
+  } else if (request->type == IMAGE_REQUEST_FILE) {
+    request->image_ref = image_cache_load_file(&g_image_cache,
+                                               request->source,
+                                               &request->hash  );
+  } else if (request->type == IMAGE_REQUEST_VARIANT) {
+    request->image_ref = image_create_scaled_copy(request->source_ref,
+                                                  request->target_size);
+  }
+}
+
+static void image_request_finished(void* context) {
+  struct event event = { context, IMAGE_LOADED };
+  event_post(&event);
+}
+
+static void image_request_process(void* context) {
+  image_request_load(context);
+  dispatch_async_f(dispatch_get_main_queue(), context, image_request_finished);
+}
+
+static void image_enqueue_request(struct image_request* request) {
+  g_image_requests = realloc(g_image_requests,
+                        sizeof(struct image_request*)*(g_image_request_count + 1));
+  g_image_requests[g_image_request_count++] = request;
+  dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+                   request,
+                   image_request_process                                        );
+}
+
+void image_cancel_requests(struct image* image, bool variants_only) {
+  for (int i = 0; i < g_image_request_count; i++) {
+    if (g_image_requests[i]->image == image
+        && (!variants_only
+            || g_image_requests[i]->type == IMAGE_REQUEST_VARIANT)) {
+      g_image_requests[i]->cancelled = true;
+    }
+  }
+}
+
+static uint64_t g_image_generation = 0;
+
+static void image_touch(struct image* image) {
+  image->generation = ++g_image_generation;
+}
+
+static void image_release_variant(struct image* image) {
+  if (image->variant_ref) CGImageRelease(image->variant_ref);
+  image->variant_ref = NULL;
+  image->variant_scale = 0.f;
+  image_touch(image);
+}
+
+// Large sources (e.g. 1024px app icons drawn at 16pt) are downsampled once to
+// the pixel size they are drawn at, such that drawing them is a plain blit.
+static void image_request_variant(struct image* image) {
+  image_cancel_requests(image, true);
+  if (!image->image_ref || image->link) {
+    image_release_variant(image);
+    return;
+  }
+
+  float scale = workspace_get_scale();
+  CGSize target = { roundf(image->bounds.size.width * scale),
+                    roundf(image->bounds.size.height * scale) };
+
+  if (image->variant_ref
+      && image->variant_scale == scale
+      && CGImageGetWidth(image->variant_ref) == target.width
+      && CGImageGetHeight(image->variant_ref) == target.height) {
+    return;
+  }
+
+  image_release_variant(image);
+  if (target.width < 1.f || target.height < 1.f) return;
+  if (CGImageGetWidth(image->image_ref) <= 1.25f * target.width
+      && CGImageGetHeight(image->image_ref) <= 1.25f * target.height) {
+    return;
+  }
+
+  struct image_request* request = image_request_create(image,
+                                                       IMAGE_REQUEST_VARIANT,
+                                                       NULL                 );
+  request->source_ref = CGImageRetain(image->image_ref);
+  request->target_size = target;
+  request->scale = scale;
+  image_enqueue_request(request);
+}
+
+// The defaults are copied into new items right away, hence images of the
+// default item are not loaded asynchronously.
+static bool image_loads_async(struct image* image) {
+  return !((void*)image >= (void*)&g_bar_manager.default_item
+           && (void*)image < ((void*)&g_bar_manager.default_item
+                              + sizeof(struct bar_item)         ));
+}
+
+struct image* image_request_complete(struct image_request* request, FILE* rsp) {
+  for (int i = 0; i < g_image_request_count; i++) {
+    if (g_image_requests[i] != request) continue;
+    g_image_requests[i] = g_image_requests[--g_image_request_count];
+    break;
+  }
+
+  struct image* image = NULL;
+  if (request->cancelled) {
+    image_request_destroy(request);
+    return NULL;
+  }
+
+  if (request->type == IMAGE_REQUEST_VARIANT) {
+    if (request->image_ref && request->image->image_ref == request->source_ref) {
+      image = request->image;
+      image_release_variant(image);
+      image->variant_ref = request->image_ref;
+      image->variant_scale = request->scale;
+      image_touch(image);
+      request->image_ref = NULL;
+    }
+    image_request_destroy(request);
+    return image;
+  }
+
+  if (!request->image_ref) {
+    if (request->type == IMAGE_REQUEST_APP)
+      respond(rsp, "[!] Image: Invalid application name: '%s'\n", request->source);
+    else if (request->type == IMAGE_REQUEST_SPACE)
+      respond(rsp, "[!] Image: Invalid Space ID: '%s'\n", request->source);
+    else
+      respond(rsp, "[!] Image: Invalid Image Format: '%s'\n", request->source);
+    image_request_destroy(request);
+    return NULL;
+  }
+
+  float scale = request->type == IMAGE_REQUEST_APP
+                ? request->scale * request->scale
+                : 1.f;
+
+  // Variants requested while the image is set belong to the same item
+  struct bar_item* owner = g_bar_manager.animator.owner;
+  g_bar_manager.animator.owner = request->owner;
+  bool changed = image_set_image_with_hash(request->image,
+                                request->image_ref,
+                                (CGRect){{0,0},
+                                  {CGImageGetWidth(request->image_ref) / scale,
+                                   CGImageGetHeight(request->image_ref) / scale}},
+                                request->hash,
+                                true                                             );
+  g_bar_manager.animator.owner = owner;
+  if (changed) image = request->image;
+
+  request->image_ref = NULL;
+  image_request_destroy(request);
+  return image;
+}
+
 bool image_load(struct image* image, char* path, FILE* rsp) {
   if (!path) return false;
   char* app = string_copy(path);
   if (image->path) free(image->path);
   image->path = string_copy(path);
   char* res_path = resolve_path(path);
-  CGImageRef new_image_ref = NULL;
-  float scale = 1.f;
+  struct image_request* request = NULL;
 
   struct key_value_pair app_kv = get_key_value_pair(app, '.');
   if (app_kv.key && app_kv.value && strcmp(app_kv.key, "app") == 0) {
-    CGImageRef app_icon = workspace_icon_for_app(app_kv.value);
-    scale = workspace_get_scale();
-    scale *= scale;
-    if (app_icon) new_image_ref = app_icon;
-    else {
-      respond(rsp, "[!] Image: Invalid application name: '%s'\n", app_kv.value);
-      free(res_path);
-      free(app);
-      return false;
-    }
+    request = image_request_create(image, IMAGE_REQUEST_APP, app_kv.value);
+    request->scale = workspace_get_scale();
   } else if (app_kv.key && app_kv.value && strcmp(app_kv.key, "space") == 0) {
-    uint32_t sid = atoi(app_kv.value);
-    CGImageRef space_img = space_capture(sid);
-    if (space_img) new_image_ref = space_img;
-    else {
-      respond(rsp, "[!] Image: Invalid Space ID: '%s'\n", app_kv.value);
-      free(res_path);
-      free(app);
-      return false;
-    }
+    request = image_request_create(image, IMAGE_REQUEST_SPACE, app_kv.value);
   } else if (strcmp(path, "media.artwork") == 0) {
     free(res_path);
     free(app);
+    image_cancel_requests(image, false);
     begin_receiving_media_events();
     return image_set_link(image, &g_bar_manager.current_artwork);
   } else if (file_exists(res_path)) {
-    CGDataProviderRef data_provider = CGDataProviderCreateWithFilename(res_path);
-    if (data_provider) {
-      if (strlen(res_path) > 3 && string_equals(&res_path[strlen(res_path) - 4], ".png"))
-        new_image_ref = CGImageCreateWithPNGDataProvider(data_provider,
-                                                         NULL,
-                                                         false,
-                                                         kCGRenderingIntentDefault);
-      else {
-        new_image_ref = CGImageCreateWithJPEGDataProvider(data_provider,
-                                                          NULL,
-                                                          false,
-                                                          kCGRenderingIntentDefault);
-      }
-      CFRelease(data_provider);
-    } else {
-      respond(rsp, "[!] Image: Invalid Image Format: '%s'\n", app_kv.value);
-      free(res_path);
-      free(app);
-      return false;
-    }
+    request = image_request_create(image, IMAGE_REQUEST_FILE, res_path);
   }
   else if (strlen(res_path) == 0) {
     image_destroy(image);
@@ -109,64 +298,61 @@ bool image_load(struct image* image, char* path, FILE* rsp) {
     return false;
   }
 
-  if (new_image_ref) {
-    image_set_image(image,
-                    new_image_ref,
-                    (CGRect){{0,0},
-                             {CGImageGetWidth(new_image_ref) / scale,
-                              CGImageGetHeight(new_image_ref) / scale }},
-                    true                                        );
-  }
-  else {
-    if (new_image_ref) CFRelease(new_image_ref);
-    printf("Could not open image file at: %s\n", res_path);
-    fprintf(rsp, "Could not open image file at: %s\n", res_path);
-  }
-
   free(res_path);
   free(app);
-  return true;
-}
 
-static bool image_data_equals(struct image* image, CFDataRef new_data_ref) {
-  bool equals = false;
-  if (image->image_ref && image->data_ref) {
-    uint32_t old_len = CFDataGetLength(image->data_ref);
-    uint32_t new_len = CFDataGetLength(new_data_ref);
-    if (old_len == new_len)
-      equals = memcmp(CFDataGetBytePtr(image->data_ref),
-                      CFDataGetBytePtr(new_data_ref),
-                      old_len                           )
-               == 0;
+  // A newer request supersedes all pending requests for this image, the
+  // previous image stays visible until the new one is decoded.
+  image_cancel_requests(image, false);
+  if (!image_loads_async(image) || request->type == IMAGE_REQUEST_APP) {
+    image_request_load(request);
+    return image_request_complete(request, rsp) != NULL;
   }
 
-  return equals;
+  image_enqueue_request(request);
+  return false;
+}
+
+static void image_release_ref(struct image* image) {
+  image_release_variant(image);
+  if (!image->image_ref) return;
+  image_cache_release(&g_image_cache, image->image_ref);
+  CGImageRelease(image->image_ref);
+  image->image_ref = NULL;
+  image->hash = 0;
+  image_touch(image);
 }
 
 void image_copy(struct image* image, CGImageRef source) {
-  if (source) image->image_ref = CGImageCreateCopy(source);
+  if (!source) return;
+  image_cache_retain(&g_image_cache, source);
+  image->image_ref = CGImageRetain(source);
+  image_touch(image);
+  image_request_variant(image);
 }
 
-bool image_set_image(struct image* image, CGImageRef new_image_ref, CGRect bounds, bool forced) {
+static bool image_source_equals(CGImageRef a, CGImageRef b) {
+  return a == b || CGImageGetDataProvider(a) == CGImageGetDataProvider(b);
+}
+
+static bool image_set_image_with_hash(struct image* image, CGImageRef new_image_ref, CGRect bounds, uint64_t hash, bool forced) {
   if (!new_image_ref) {
-    if (image->image_ref) CGImageRelease(image->image_ref);
-    if (image->data_ref) CFRelease(image->data_ref);
-    image->image_ref = NULL;
-    image->data_ref = NULL;
+    image_release_ref(image);
     return false;
   }
   if (image->link) image_set_link(image, NULL);
-  CFDataRef new_data_ref = CGDataProviderCopyData(CGImageGetDataProvider(new_image_ref));
 
-  if (!forced && image_data_equals(image, new_data_ref)
-      && CGSizeEqualToSize(image->size, bounds.size)   ) {
-    CFRelease(new_data_ref);
+  // A hash of zero is unknown and never matches
+  if (!forced && image->image_ref
+      && (image_source_equals(image->image_ref, new_image_ref)
+          || (hash && image->hash == hash)                    )
+      && CGSizeEqualToSize(image->size, bounds.size)           ) {
+    image_cache_release(&g_image_cache, new_image_ref);
     CGImageRelease(new_image_ref);
     return false;
   }
 
-  if (image->image_ref) CGImageRelease(image->image_ref);
-  if (image->data_ref) CFRelease(image->data_ref);
+  image_release_ref(image);
 
   image->size = bounds.size;
   image->bounds = (CGRect){{0, 0},
@@ -174,17 +360,26 @@ bool image_set_image(struct image* image, CGImageRef new_image_ref, CGRect bound
                             bounds.size.height * image->scale}};
 
   image->image_ref = new_image_ref;
-  image->data_ref = new_data_ref;
+  image->hash = hash;
   image->enabled = true;
+  image_touch(image);
+  image_request_variant(image);
   return true;
 }
 
+// Images without a cache entry (captures, artwork) are compared by their
+// source only, their pixels are never copied for comparison
+bool image_set_image(struct image* image, CGImageRef new_image_ref, CGRect bounds, bool forced) {
+  return image_set_image_with_hash(image, new_image_ref, bounds, 0, forced);
+}
+
 bool image_set_scale(struct image* image, float scale) {
   if (scale == image->scale) return false;
   image->scale = scale;
   image->bounds = (CGRect){{image->bounds.origin.x, image->bounds.origin.y},
                            {image->size.width * image->scale,
                             image->size.height * image->scale}};
+  image_request_variant(image);
   return true;
 }
 
@@ -311,24 +506,24 @@ void image_calculate_bounds(struct image* image, uint32_t x, uint32_t y) {
 
   image->bounds.origin.x = x + image->padding_left;
   image->bounds.origin.y = y - image->bounds.size.height / 2 + image->y_offset;
+  rounded_rect_path_update(&image->shape, image->bounds, &image->corner_radii);
 }
 
 void image_draw(struct image* image, CGContextRef context) {
   if ((!image->link && !image->image_ref)
       || (image->link && !image->link->image_ref)) return;
 
+  CGPathRef path = rounded_rect_path_get(&image->shape,
+                                         image->bounds,
+                                         &image->corner_radii);
+
   if (image->shadow.enabled) {
     CGContextSaveGState(context);
-    CGRect sbounds = shadow_get_bounds(&image->shadow, image->bounds);
+    CGContextTranslateCTM(context, image->shadow.offset.x,
+                                   image->shadow.offset.y );
     CGContextSetRGBFillColor(context, image->shadow.color.r, image->shadow.color.g, image->shadow.color.b, image->shadow.color.a);
-    CGMutablePathRef path = CGPathCreateMutable();
-    add_rounded_rect_path(path, sbounds,
-                         image->corner_radii.top_left, image->corner_radii.top_right,
-                         image->corner_radii.bottom_left, image->corner_radii.bottom_right);
-
     CGContextAddPath(context, path);
     CGContextDrawPath(context, kCGPathFillStroke);
-    CFRelease(path);
     CGContextRestoreGState(context);
   } 
 
@@ -340,19 +535,23 @@ void image_draw(struct image* image, CGContextRef context) {
 
   if (image->bounds.size.height > 2*max_corner
       && image->bounds.size.width > 2*max_corner) {
-    CGMutablePathRef path = CGPathCreateMutable();
-    add_rounded_rect_path(path, image->bounds,
-                         image->corner_radii.top_left, image->corner_radii.top_right,
-                         image->corner_radii.bottom_left, image->corner_radii.bottom_right);
-
     CGContextAddPath(context, path);
     CGContextClip(context);
-    CFRelease(path);
   }
 
-  CGContextDrawImage(context,
-                     image->bounds,
-                     image->link ? image->link->image_ref : image->image_ref);
+  CGImageRef image_ref = image->link ? image->link->image_ref
+                                     : image->image_ref;
+  if (!image->link && image->variant_ref) {
+    CGSize device_size = CGContextConvertSizeToDeviceSpace(context,
+                                                           image->bounds.size);
+    if (roundf(fabs(device_size.width)) == CGImageGetWidth(image->variant_ref)
+        && roundf(fabs(device_size.height))
+           == CGImageGetHeight(image->variant_ref)) {
+      image_ref = image->variant_ref;
+    }
+  }
+
+  CGContextDrawImage(context, image->bounds, image_ref);
 
   if (image->bounds.size.height > 2*max_corner
       && image->bounds.size.width > 2*max_corner) {
@@ -364,41 +563,54 @@ void image_draw(struct image* image, CGContextRef context) {
                                image->border_color.a);
 
     CGContextSetRGBFillColor(context, 0, 0, 0, 0);
-    CGMutablePathRef path = CGPathCreateMutable();
-    add_rounded_rect_path(path, image->bounds,
-                         image->corner_radii.top_left, image->corner_radii.top_right,
-                         image->corner_radii.bottom_left, image->corner_radii.bottom_right);
-
     CGContextAddPath(context, path);
     CGContextDrawPath(context, kCGPathFillStroke);
-    CFRelease(path);
   }
   CGContextRestoreGState(context);
+  CGPathRelease(path);
+}
+
+uint64_t image_get_key(struct image* image, uint64_t hash) {
+  hash = hash_combine(hash, image->enabled);
+  if (!image->enabled) return hash;
+
+  hash = hash_combine(hash, image->image_ref ? image->generation : 0);
+  hash = hash_combine(hash, image->link ? image->link->generation : 0);
+  hash = hash_rect(hash, image->bounds);
+  hash = hash_combine(hash, image->border_color.hex);
+  hash = hash_float(hash, image->border_width);
+  hash = hash_combine(hash, image->corner_radii.top_left);
+  hash = hash_combine(hash, image->corner_radii.top_right);
+  hash = hash_combine(hash, image->corner_radii.bottom_left);
+  hash = hash_combine(hash, image->corner_radii.bottom_right);
+  return shadow_get_key(&image->shadow, hash);
 }
 
 void image_clear_pointers(struct image* image) {
   image->image_ref = NULL;
-  image->data_ref = NULL;
+  image->shape.path = NULL;
+  image->variant_ref = NULL;
   image->path = NULL;
 }
 
 void image_destroy(struct image* image) {
-  CGImageRelease(image->image_ref);
-  if (image->data_ref) CFRelease(image->data_ref);
+  image_cancel_requests(image, false);
+  image_release_ref(image);
+  rounded_rect_path_destroy(&image->shape);
   if (image->path) free(image->path);
   image_clear_pointers(image);
 }
 
-void image_serialize(struct image* image, char* indent, FILE* rsp) {
-  fprintf(rsp, "%s\"value\": \"%s\",\n", indent, image->path);
-  fprintf(rsp, "%s\"drawing\": \"%s\",\n", indent, format_bool(image->enabled));
-  fprintf(rsp, "%s\"scale\": %f,\n", indent, image->scale);
-  fprintf(rsp, "%s\"corner_radius\": {\n", indent);
-  fprintf(rsp, "%s  \"top_left\": %u,\n", indent, image->corner_radii.top_left);
-  fprintf(rsp, "%s  \"top_right\": %u,\n", indent, image->corner_radii.top_right);
-  fprintf(rsp, "%s  \"bottom_left\": %u,\n", indent, image->corner_radii.bottom_left);
-  fprintf(rsp, "%s  \"bottom_right\": %u\n", indent, image->corner_radii.bottom_right);
-  fprintf(rsp, "%s}", indent);
+void image_serialize(struct image* image, struct json* json) {
+  json_string(json, "value", image->path);
+  json_string(json, "drawing", format_bool(image->enabled));
+  json_float(json, "scale", image->scale, 6);
+  json_object_begin(json, "corner_radius");
+  json_uint(json, "top_left", image->corner_radii.top_left);
+  json_uint(json, "top_right", image->corner_radii.top_right);
+  json_uint(json, "bottom_left", image->corner_radii.bottom_left);
+  json_uint(json, "bottom_right", image->corner_radii.bottom_right);
+  json_object_end(json);
 }
 
 bool image_parse_sub_domain(struct image* image, FILE* rsp, struct token property, char* message) {
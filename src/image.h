@@ -2,7 +2,13 @@
 #include "shadow.h"
 #include "misc/defines.h"
 
-extern CGImageRef workspace_icon_for_app(char* app);
+extern CGImageRef workspace_icon_for_app(char* app, float scale);
+struct bar_item;
+
+#define IMAGE_REQUEST_APP     0
+#define IMAGE_REQUEST_SPACE   1
+#define IMAGE_REQUEST_FILE    2
+#define IMAGE_REQUEST_VARIANT 3
 
 struct image {
   bool enabled;
@@ -14,13 +20,21 @@ struct image {
   char* path;
 
   CGImageRef image_ref;
-  CFDataRef data_ref;
+  uint64_t hash;
+
+  // Changes whenever the image or its variant is replaced, such that render
+  // caches never key on (reusable) image addresses
+  uint64_t generation;
+
+  CGImageRef variant_ref;
+  float variant_scale;
 
   struct shadow shadow;
 
   struct color border_color;
   float border_width;
   struct corner_radii corner_radii;
+  struct rounded_rect_path shape;
 
   int padding_left;
   int padding_right;
@@ -29,11 +43,31 @@ struct image {
   struct image* link;
 };
 
+struct image_request {
+  struct image* image;
+  volatile bool cancelled;
+
+  // The item owning the image, NULL for bar level images
+  struct bar_item* owner;
+
+  char type;
+  char* source;
+  float scale;
+
+  CGImageRef source_ref;
+  CGSize target_size;
+
+  CGImageRef image_ref;
+  uint64_t hash;
+};
+
 void image_init(struct image* image);
 bool image_set_enabled(struct image* image, bool enabled);
 void image_copy(struct image* image, CGImageRef source);
 bool image_set_image(struct image* image, CGImageRef new_image_ref, CGRect bounds, bool forced);
 bool image_load(struct image* image, char* path, FILE* rsp);
+struct image* image_request_complete(struct image_request* request, FILE* rsp);
+void image_cancel_requests(struct image* image, bool variants_only);
 bool image_set_scale(struct image* image, float scale);
 
 CGSize image_get_size(struct image* image);
@@ -42,5 +76,7 @@ void image_draw(struct image* image, CGContextRef context);
 void image_clear_pointers(struct image* image);
 void image_destroy(struct image* image);
 
-void image_serialize(struct image* image, char* indent, FILE* rsp);
+uint64_t image_get_key(struct image* image, uint64_t hash);
+
+void image_serialize(struct image* image, struct json* json);
 bool image_parse_sub_domain(struct image* image, FILE* rsp, struct token property, char* message);
@@ -0,0 +1,241 @@
+#include "image_cache.h"
+#include "workspace.h"
+
+// 64 bit multiply-xorshift hash consuming eight bytes per round
+uint64_t image_cache_hash_bytes(const uint8_t* bytes, size_t length) {
+  const uint64_t prime = 0x9e3779b97f4a7c15ULL;
+  uint64_t hash = 0xcbf29ce484222325ULL ^ (length * prime);
+
+  size_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(uint64_t));
+    word *= prime;
+    word ^= word >> 32;
+    hash = (hash ^ word) * prime;
+  }
+
+  for (; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  }
+
+  hash ^= hash >> 29;
+  hash *= prime;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+static struct image_cache_entry* image_cache_find_key(struct image_cache* cache, char* name, struct image_cache_key** key) {
+  for (int i = 0; i < cache->count; i++) {
+    struct image_cache_entry* entry = cache->entries[i];
+    for (int j = 0; j < entry->key_count; j++) {
+      if (!string_equals(entry->keys[j].name, name)) continue;
+      if (key) *key = &entry->keys[j];
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static void image_cache_add_key(struct image_cache_entry* entry, char* name, struct stat* stats) {
+  entry->keys = realloc(entry->keys,
+                        sizeof(struct image_cache_key)*(entry->key_count + 1));
+  struct image_cache_key* key = &entry->keys[entry->key_count++];
+  memset(key, 0, sizeof(struct image_cache_key));
+  key->name = string_copy(name);
+  if (stats) {
+    key->mtime = stats->st_mtimespec;
+    key->file_size = stats->st_size;
+  }
+}
+
+static void image_cache_remove_key(struct image_cache_entry* entry, struct image_cache_key* key) {
+  free(key->name);
+  *key = entry->keys[--entry->key_count];
+}
+
+static struct image_cache_entry* image_cache_find_hash(struct image_cache* cache, uint64_t hash) {
+  for (int i = 0; i < cache->count; i++) {
+    if (cache->entries[i]->hash == hash) return cache->entries[i];
+  }
+  return NULL;
+}
+
+static struct image_cache_entry* image_cache_find_image(struct image_cache* cache, CGImageRef image_ref) {
+  for (int i = 0; i < cache->count; i++) {
+    if (cache->entries[i]->image_ref == image_ref) return cache->entries[i];
+  }
+  return NULL;
+}
+
+static void image_cache_remove(struct image_cache* cache, struct image_cache_entry* entry) {
+  for (int i = 0; i < cache->count; i++) {
+    if (cache->entries[i] != entry) continue;
+    cache->entries[i] = cache->entries[--cache->count];
+    break;
+  }
+
+  CGImageRelease(entry->image_ref);
+  for (int i = 0; i < entry->key_count; i++) free(entry->keys[i].name);
+  if (entry->keys) free(entry->keys);
+  free(entry);
+}
+
+static CGImageRef image_cache_insert(struct image_cache* cache, char* key, struct stat* stats, uint64_t hash, CGImageRef image_ref) {
+  struct image_cache_entry* entry = malloc(sizeof(struct image_cache_entry));
+  memset(entry, 0, sizeof(struct image_cache_entry));
+  image_cache_add_key(entry, key, stats);
+  entry->hash = hash;
+  entry->refcount = 1;
+  entry->image_ref = image_ref;
+
+  cache->entries = realloc(cache->entries,
+                           sizeof(struct image_cache_entry*)*(cache->count + 1));
+  cache->entries[cache->count++] = entry;
+  return CGImageRetain(image_ref);
+}
+
+static CGImageRef image_cache_acquire(struct image_cache* cache, struct image_cache_entry* entry, uint64_t* hash) {
+  entry->refcount++;
+  cache->hits++;
+  if (hash) *hash = entry->hash;
+  return CGImageRetain(entry->image_ref);
+}
+
+void image_cache_init(struct image_cache* cache) {
+  memset(cache, 0, sizeof(struct image_cache));
+  pthread_mutex_init(&cache->mutex, NULL);
+}
+
+// Returns a retained, decoded image for the file at path. Files are keyed by
+// their path and modification time and deduplicated by a hash of their
+// contents, such that each distinct image is only decoded once.
+CGImageRef image_cache_load_file(struct image_cache* cache, char* path, uint64_t* hash) {
+  struct stat stats;
+  if (stat(path, &stats) != 0) return NULL;
+
+  pthread_mutex_lock(&cache->mutex);
+  struct image_cache_key* key = NULL;
+  struct image_cache_entry* entry = image_cache_find_key(cache, path, &key);
+  if (entry) {
+    if (key->file_size == stats.st_size
+        && key->mtime.tv_sec == stats.st_mtimespec.tv_sec
+        && key->mtime.tv_nsec == stats.st_mtimespec.tv_nsec) {
+      CGImageRef image_ref = image_cache_acquire(cache, entry, hash);
+      pthread_mutex_unlock(&cache->mutex);
+      return image_ref;
+    }
+
+    // The file changed on disk: Existing holders keep the old image, new
+    // requests are served from a fresh entry.
+    image_cache_remove_key(entry, key);
+  }
+  cache->misses++;
+  pthread_mutex_unlock(&cache->mutex);
+
+  CGDataProviderRef file_provider = CGDataProviderCreateWithFilename(path);
+  if (!file_provider) return NULL;
+  CFDataRef file_data = CGDataProviderCopyData(file_provider);
+  CFRelease(file_provider);
+  if (!file_data) return NULL;
+
+  uint64_t file_hash = image_cache_hash_bytes(CFDataGetBytePtr(file_data),
+                                              CFDataGetLength(file_data)  );
+
+  pthread_mutex_lock(&cache->mutex);
+  entry = image_cache_find_hash(cache, file_hash);
+  if (entry) {
+    // Later loads of this path are served without reading the file
+    if (!image_cache_find_key(cache, path, NULL)) {
+      image_cache_add_key(entry, path, &stats);
+    }
+    CGImageRef image_ref = image_cache_acquire(cache, entry, hash);
+    pthread_mutex_unlock(&cache->mutex);
+    CFRelease(file_data);
+    return image_ref;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+
+  CGDataProviderRef data_provider = CGDataProviderCreateWithCFData(file_data);
+  CGImageRef image_ref = NULL;
+  if (strlen(path) > 3 && string_equals(&path[strlen(path) - 4], ".png"))
+    image_ref = CGImageCreateWithPNGDataProvider(data_provider,
+                                                 NULL,
+                                                 false,
+                                                 kCGRenderingIntentDefault);
+  else
+    image_ref = CGImageCreateWithJPEGDataProvider(data_provider,
+                                                  NULL,
+                                                  false,
+                                                  kCGRenderingIntentDefault);
+
+  CFRelease(data_provider);
+  CFRelease(file_data);
+  if (!image_ref) return NULL;
+
+  pthread_mutex_lock(&cache->mutex);
+  CGImageRef result = image_cache_insert(cache, path, &stats, file_hash, image_ref);
+  pthread_mutex_unlock(&cache->mutex);
+  if (hash) *hash = file_hash;
+  return result;
+}
+
+// Returns a retained icon for the application, keyed by its name and the
+// display scale the icon was rendered for.
+CGImageRef image_cache_load_app(struct image_cache* cache, char* app, float scale, uint64_t* hash) {
+  char key[strlen(app) + 32];
+  snprintf(key, sizeof(key), "app.%s@%.2f", app, scale);
+
+  pthread_mutex_lock(&cache->mutex);
+  struct image_cache_entry* entry = image_cache_find_key(cache, key, NULL);
+  if (entry) {
+    CGImageRef image_ref = image_cache_acquire(cache, entry, hash);
+    pthread_mutex_unlock(&cache->mutex);
+    return image_ref;
+  }
+  cache->misses++;
+  pthread_mutex_unlock(&cache->mutex);
+
+  CGImageRef image_ref = workspace_icon_for_app(app, scale);
+  if (!image_ref) return NULL;
+
+  // Icons are identified by their source instead of their pixels
+  uint64_t icon_hash = image_cache_hash_bytes((uint8_t*)key, strlen(key));
+
+  pthread_mutex_lock(&cache->mutex);
+  CGImageRef result = image_cache_insert(cache, key, NULL, icon_hash, image_ref);
+  pthread_mutex_unlock(&cache->mutex);
+  if (hash) *hash = icon_hash;
+  return result;
+}
+
+void image_cache_retain(struct image_cache* cache, CGImageRef image_ref) {
+  if (!image_ref) return;
+  pthread_mutex_lock(&cache->mutex);
+  struct image_cache_entry* entry = image_cache_find_image(cache, image_ref);
+  if (entry) entry->refcount++;
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+void image_cache_release(struct image_cache* cache, CGImageRef image_ref) {
+  if (!image_ref) return;
+  pthread_mutex_lock(&cache->mutex);
+  struct image_cache_entry* entry = image_cache_find_image(cache, image_ref);
+  if (entry && --entry->refcount == 0) image_cache_remove(cache, entry);
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+void image_cache_serialize(struct image_cache* cache, struct json* json) {
+  pthread_mutex_lock(&cache->mutex);
+  uint64_t bytes = 0;
+  for (int i = 0; i < cache->count; i++) {
+    CGImageRef image_ref = cache->entries[i]->image_ref;
+    bytes += CGImageGetBytesPerRow(image_ref) * CGImageGetHeight(image_ref);
+  }
+
+  json_uint(json, "entries", cache->count);
+  json_uint(json, "bytes", bytes);
+  json_uint(json, "hits", cache->hits);
+  json_uint(json, "misses", cache->misses);
+  pthread_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <CoreGraphics/CoreGraphics.h>
+#include <pthread.h>
+#include "misc/helpers.h"
+#include "json.h"
+
+// A path (or app key) under which an entry is found, files with identical
+// contents share one entry with one key per path
+struct image_cache_key {
+  char* name;
+  struct timespec mtime;
+  off_t file_size;
+};
+
+struct image_cache_entry {
+  struct image_cache_key* keys;
+  uint32_t key_count;
+
+  uint64_t hash;
+  uint32_t refcount;
+  CGImageRef image_ref;
+};
+
+struct image_cache {
+  pthread_mutex_t mutex;
+
+  struct image_cache_entry** entries;
+  uint32_t count;
+
+  uint64_t hits;
+  uint64_t misses;
+};
+
+void image_cache_init(struct image_cache* cache);
+CGImageRef image_cache_load_file(struct image_cache* cache, char* path, uint64_t* hash);
+CGImageRef image_cache_load_app(struct image_cache* cache, char* app, float scale, uint64_t* hash);
+void image_cache_retain(struct image_cache* cache, CGImageRef image_ref);
+void image_cache_release(struct image_cache* cache, CGImageRef image_ref);
+
+uint64_t image_cache_hash_bytes(const uint8_t* bytes, size_t length);
+
+void image_cache_serialize(struct image_cache* cache, struct json* json);
+
+extern struct image_cache g_image_cache;
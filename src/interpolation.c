@@ -0,0 +1,381 @@
+#include "interpolation.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Portable four lane vectors, lowered to SSE/AVX or NEON by the compiler
+typedef int interp_int4 __attribute__((vector_size(16)));
+typedef float interp_float4 __attribute__((vector_size(16)));
+typedef double interp_double4 __attribute__((vector_size(32)));
+
+typedef double easing_function(double x);
+
+static double function_linear(double x) {
+  return x;
+}
+
+static double function_square(double x) {
+  return x*x;
+}
+
+static double function_tanh(double x) {
+  double a = 0.52;
+  return a * tanh(2. * atanh(1. / (2. * a)) * (x  - 0.5)) + 0.5;
+}
+
+static double function_sin(double x) {
+  return sin(M_PI / 2. * x);
+}
+
+static double function_exp(double x) {
+  return x*exp(x - 1.);
+}
+
+static double function_circ(double x) {
+    return sqrt(1.f - powf(x - 1.f, 2.f));
+}
+
+static double function_bounce(double x) {
+  double n = 7.5625;
+  double d = 2.75;
+  if (x < 1. / d) return n * x * x;
+  else if (x < 2. / d) return n * (x - 1.5 / d) * (x - 1.5 / d) + 0.75;
+  else if (x < 2.5 / d) return n * (x - 2.25 / d) * (x - 2.25 / d) + 0.9375;
+  return n * (x - 2.625 / d) * (x - 2.625 / d) + 0.984375;
+}
+
+static double function_overshoot(double x) {
+  double c1 = 1.70158;
+  double c3 = c1 + 1.;
+  return 1. + c3 * pow(x - 1., 3.) + c1 * pow(x - 1., 2.);
+}
+
+static struct animation_curve g_animation_curves[] = {
+  { INTERP_FUNCTION_LINEAR },
+  { INTERP_FUNCTION_QUADRATIC },
+  { INTERP_FUNCTION_SIN },
+  { INTERP_FUNCTION_TANH },
+  { INTERP_FUNCTION_CIRC },
+  { INTERP_FUNCTION_BOUNCE },
+  { INTERP_FUNCTION_EXP },
+  { INTERP_FUNCTION_OVERSHOOT }
+};
+
+static bool g_animation_curves_ready = false;
+static struct animation_curve** g_custom_curves = NULL;
+static uint32_t g_custom_curve_count = 0;
+
+static void animation_curve_fill(struct animation_curve* curve, easing_function* function) {
+  for (int i = 0; i <= ANIMATION_CURVE_RESOLUTION; i++) {
+    curve->table[i] = function((double)i / ANIMATION_CURVE_RESOLUTION);
+  }
+}
+
+static double animation_curve_bezier_coordinate(double u, double p1, double p2) {
+  double v = 1. - u;
+  return 3. * v * v * u * p1 + 3. * v * u * u * p2 + u * u * u;
+}
+
+// The control points are P0 = (0, 0), P1 = (x1, y1), P2 = (x2, y2) and
+// P3 = (1, 1). x(u) is monotonic for x1, x2 in [0, 1], such that the curve
+// parameter for each table position is found by bisection.
+static void animation_curve_fill_bezier(struct animation_curve* curve) {
+  double x1 = curve->parameters[0];
+  double y1 = curve->parameters[1];
+  double x2 = curve->parameters[2];
+  double y2 = curve->parameters[3];
+
+  for (int i = 0; i <= ANIMATION_CURVE_RESOLUTION; i++) {
+    double x = (double)i / ANIMATION_CURVE_RESOLUTION;
+    double low = 0.;
+    double high = 1.;
+    for (int j = 0; j < 32; j++) {
+      double u = 0.5 * (low + high);
+      if (animation_curve_bezier_coordinate(u, x1, x2) < x) low = u;
+      else high = u;
+    }
+    curve->table[i] = animation_curve_bezier_coordinate(0.5 * (low + high),
+                                                         y1,
+                                                         y2              );
+  }
+}
+
+// Damped harmonic oscillator of unit mass released at 0 and resting at 1.
+// The curve spans the time it takes the envelope to decay to 0.1%.
+static void animation_curve_fill_spring(struct animation_curve* curve) {
+  double omega = sqrt(curve->parameters[0]);
+  double zeta = curve->parameters[1] / (2. * omega);
+  if (zeta < 0.05) zeta = 0.05;
+  double decay = zeta < 1. ? zeta * omega
+                           : omega * (zeta - sqrt(zeta * zeta - 1.));
+  double duration = log(1000.) / decay;
+
+  for (int i = 0; i <= ANIMATION_CURVE_RESOLUTION; i++) {
+    double t = duration * i / ANIMATION_CURVE_RESOLUTION;
+    double y;
+    if (zeta < 1.) {
+      double omega_d = omega * sqrt(1. - zeta * zeta);
+      y = 1. - exp(-zeta * omega * t)
+               * (cos(omega_d * t)
+                  + zeta * omega / omega_d * sin(omega_d * t));
+    } else if (zeta == 1.) {
+      y = 1. - exp(-omega * t) * (1. + omega * t);
+    } else {
+      double root = sqrt(zeta * zeta - 1.);
+      double r1 = -omega * (zeta - root);
+      double r2 = -omega * (zeta + root);
+      y = 1. + (r2 * exp(r1 * t) - r1 * exp(r2 * t)) / (r1 - r2);
+    }
+    curve->table[i] = y;
+  }
+}
+
+static void animation_curves_init() {
+  if (g_animation_curves_ready) return;
+  easing_function* functions[] = { &function_linear,
+                                   &function_square,
+                                   &function_sin,
+                                   &function_tanh,
+                                   &function_circ,
+                                   &function_bounce,
+                                   &function_exp,
+                                   &function_overshoot };
+
+  for (uint32_t i = 0; i < sizeof(g_animation_curves)
+                           / sizeof(struct animation_curve); i++) {
+    animation_curve_fill(&g_animation_curves[i], functions[i]);
+  }
+  g_animation_curves_ready = true;
+}
+
+// Unknown types fall back to the linear curve
+struct animation_curve* animation_curve_builtin(char type) {
+  animation_curves_init();
+  for (uint32_t i = 0; i < sizeof(g_animation_curves)
+                           / sizeof(struct animation_curve); i++) {
+    if (g_animation_curves[i].type == type) return &g_animation_curves[i];
+  }
+  return &g_animation_curves[0];
+}
+
+// Parametrized curves are built once per distinct parameter set
+struct animation_curve* animation_curve_register(char type, float* parameters) {
+  for (uint32_t i = 0; i < g_custom_curve_count; i++) {
+    struct animation_curve* curve = g_custom_curves[i];
+    if (curve->type == type
+        && !memcmp(curve->parameters, parameters, sizeof(float) * 4)) {
+      return curve;
+    }
+  }
+
+  struct animation_curve* curve = malloc(sizeof(struct animation_curve));
+  memset(curve, 0, sizeof(struct animation_curve));
+  curve->type = type;
+  memcpy(curve->parameters, parameters, sizeof(float) * 4);
+  if (type == INTERP_FUNCTION_BEZIER) animation_curve_fill_bezier(curve);
+  else animation_curve_fill_spring(curve);
+
+  g_custom_curves = realloc(g_custom_curves,
+                            sizeof(struct animation_curve*)
+                            * ++g_custom_curve_count);
+  g_custom_curves[g_custom_curve_count - 1] = curve;
+  return curve;
+}
+
+// Accepts the named curves (only the first letter is significant) as well as
+// "cubic_bezier(x1,y1,x2,y2)" and "spring(stiffness,damping)". Returns NULL
+// for malformed parameters.
+struct animation_curve* animation_curve_parse(char* description) {
+  if (!description) return NULL;
+  float parameters[4] = { 0 };
+
+  if (strncmp(description, "cubic_bezier", 12) == 0) {
+    if (sscanf(description, "cubic_bezier(%f,%f,%f,%f)", &parameters[0],
+                                                         &parameters[1],
+                                                         &parameters[2],
+                                                         &parameters[3]) != 4) {
+      return NULL;
+    }
+    for (int i = 0; i < 4; i += 2) {
+      if (parameters[i] < 0.f) parameters[i] = 0.f;
+      else if (parameters[i] > 1.f) parameters[i] = 1.f;
+    }
+    return animation_curve_register(INTERP_FUNCTION_BEZIER, parameters);
+  } else if (strncmp(description, "spring", 6) == 0) {
+    if (sscanf(description, "spring(%f,%f)", &parameters[0],
+                                             &parameters[1]) != 2
+        || parameters[0] <= 0.f || parameters[1] < 0.f) {
+      return NULL;
+    }
+    return animation_curve_register(INTERP_FUNCTION_SPRING, parameters);
+  }
+  return animation_curve_builtin(description[0]);
+}
+
+void animation_curve_get_name(struct animation_curve* curve, char* name, size_t size) {
+  switch (curve->type) {
+    case INTERP_FUNCTION_LINEAR: snprintf(name, size, "linear"); break;
+    case INTERP_FUNCTION_QUADRATIC: snprintf(name, size, "quadratic"); break;
+    case INTERP_FUNCTION_SIN: snprintf(name, size, "sin"); break;
+    case INTERP_FUNCTION_TANH: snprintf(name, size, "tanh"); break;
+    case INTERP_FUNCTION_CIRC: snprintf(name, size, "circ"); break;
+    case INTERP_FUNCTION_BOUNCE: snprintf(name, size, "bounce"); break;
+    case INTERP_FUNCTION_EXP: snprintf(name, size, "exp"); break;
+    case INTERP_FUNCTION_OVERSHOOT: snprintf(name, size, "overshoot"); break;
+    case INTERP_FUNCTION_BEZIER:
+      snprintf(name, size, "cubic_bezier(%g,%g,%g,%g)", curve->parameters[0],
+                                                        curve->parameters[1],
+                                                        curve->parameters[2],
+                                                        curve->parameters[3]);
+      break;
+    case INTERP_FUNCTION_SPRING:
+      snprintf(name, size, "spring(%g,%g)", curve->parameters[0],
+                                            curve->parameters[1]);
+      break;
+    default: snprintf(name, size, "unknown"); break;
+  }
+}
+
+// Evaluates one group of the batch: the easing curve is resolved once for
+// the whole group and the interpolation loops run over contiguous arrays.
+void animation_batch_evaluate(struct animation_batch* batch, struct animation_group* group) {
+  uint32_t count = group->count;
+  double* progress = batch->progress + group->offset;
+  double* slider = batch->slider + group->offset;
+  int* from = batch->from + group->offset;
+  int* to = batch->to + group->offset;
+  int* values = batch->values + group->offset;
+
+  if (group->curve->type == INTERP_FUNCTION_LINEAR) {
+    memcpy(slider, progress, sizeof(double) * count);
+  } else {
+    struct animation_curve* curve = group->curve;
+    for (uint32_t i = 0; i < count; i++) {
+      slider[i] = progress[i] >= 1.0
+                  ? 1.0
+                  : animation_curve_evaluate(curve, progress[i]);
+    }
+  }
+
+  // Integer and float groups are interpolated four animations at a time
+  uint32_t vector_count = count & ~3u;
+  if (group->kind == ANIMATION_KIND_INT) {
+    for (uint32_t i = 0; i < vector_count; i += 4) {
+      interp_int4 from_int, to_int;
+      interp_double4 t;
+      memcpy(&from_int, &from[i], sizeof(interp_int4));
+      memcpy(&to_int, &to[i], sizeof(interp_int4));
+      memcpy(&t, &slider[i], sizeof(interp_double4));
+
+      interp_double4 value
+        = (1. - t) * __builtin_convertvector(from_int, interp_double4)
+          + t * __builtin_convertvector(to_int, interp_double4) + 0.5;
+      interp_int4 result = __builtin_convertvector(value, interp_int4);
+      memcpy(&values[i], &result, sizeof(interp_int4));
+    }
+    for (uint32_t i = vector_count; i < count; i++) {
+      values[i] = (1. - slider[i]) * from[i] + slider[i] * to[i] + 0.5;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      if (progress[i] >= 1.0) values[i] = to[i];
+      else if (progress[i] <= 0.0) values[i] = from[i];
+    }
+  } else if (group->kind == ANIMATION_KIND_FLOAT) {
+    float* from_float = (float*)from;
+    float* to_float = (float*)to;
+    float* values_float = (float*)values;
+    for (uint32_t i = 0; i < vector_count; i += 4) {
+      interp_float4 from_vector, to_vector;
+      interp_double4 t;
+      memcpy(&from_vector, &from_float[i], sizeof(interp_float4));
+      memcpy(&to_vector, &to_float[i], sizeof(interp_float4));
+      memcpy(&t, &slider[i], sizeof(interp_double4));
+
+      interp_double4 value
+        = (1. - t) * __builtin_convertvector(from_vector, interp_double4)
+          + t * __builtin_convertvector(to_vector, interp_double4);
+      interp_float4 result = __builtin_convertvector(value, interp_float4);
+      memcpy(&values_float[i], &result, sizeof(interp_float4));
+    }
+    for (uint32_t i = vector_count; i < count; i++) {
+      values_float[i] = (1. - slider[i]) * from_float[i]
+                        + slider[i] * to_float[i];
+    }
+  } else {
+    // All four channels of a packed color are interpolated at once
+    for (uint32_t i = 0; i < count; i++) {
+      unsigned char from_bytes[4], to_bytes[4], bytes[4];
+      memcpy(from_bytes, &from[i], sizeof(from_bytes));
+      memcpy(to_bytes, &to[i], sizeof(to_bytes));
+
+      interp_float4 from_vector = { from_bytes[0], from_bytes[1],
+                                    from_bytes[2], from_bytes[3] };
+      interp_float4 to_vector = { to_bytes[0], to_bytes[1],
+                                  to_bytes[2], to_bytes[3] };
+
+      float t = slider[i];
+      interp_float4 value = (1.f - t) * from_vector + t * to_vector;
+      // Overshooting curves leave [0, 255], saturate instead of wrapping
+      for (int c = 0; c < 4; c++) {
+        bytes[c] = value[c] <= 0.f
+                   ? 0
+                   : (value[c] >= 255.f ? 255 : value[c] + .5f);
+      }
+      memcpy(&values[i], bytes, sizeof(bytes));
+    }
+  }
+}
+
+void animation_batch_reserve(struct animation_batch* batch, uint32_t count) {
+  if (batch->capacity >= count) return;
+  batch->capacity = count > 2 * batch->capacity ? count : 2 * batch->capacity;
+  batch->animations = realloc(batch->animations,
+                              sizeof(struct animation*) * batch->capacity);
+  batch->group_of = realloc(batch->group_of,
+                            sizeof(uint32_t) * batch->capacity);
+  batch->progress = realloc(batch->progress,
+                            sizeof(double) * batch->capacity);
+  batch->slider = realloc(batch->slider, sizeof(double) * batch->capacity);
+  batch->from = realloc(batch->from, sizeof(int) * batch->capacity);
+  batch->to = realloc(batch->to, sizeof(int) * batch->capacity);
+  batch->values = realloc(batch->values, sizeof(int) * batch->capacity);
+  batch->scratch = realloc(batch->scratch, sizeof(double) * batch->capacity);
+}
+
+// Distinct (curve, kind) pairs are unbounded with custom and per keyframe
+// curves, hence the group table grows on demand.
+uint32_t animation_batch_add_group(struct animation_batch* batch, uint32_t group_count, struct animation_curve* curve, uint32_t kind) {
+  if (group_count == batch->group_capacity) {
+    batch->group_capacity = batch->group_capacity ? 2 * batch->group_capacity
+                                                  : 16;
+    batch->groups = realloc(batch->groups, sizeof(struct animation_group)
+                                           * batch->group_capacity       );
+    batch->group_cursor = realloc(batch->group_cursor,
+                                  sizeof(uint32_t) * batch->group_capacity);
+  }
+
+  struct animation_group* group = &batch->groups[group_count];
+  group->curve = curve;
+  group->kind = kind;
+  group->count = 0;
+  return group_count;
+}
+
+void animation_batch_destroy(struct animation_batch* batch) {
+  if (batch->animations) free(batch->animations);
+  if (batch->group_of) free(batch->group_of);
+  if (batch->progress) free(batch->progress);
+  if (batch->slider) free(batch->slider);
+  if (batch->from) free(batch->from);
+  if (batch->to) free(batch->to);
+  if (batch->values) free(batch->values);
+  if (batch->scratch) free(batch->scratch);
+  if (batch->groups) free(batch->groups);
+  if (batch->group_cursor) free(batch->group_cursor);
+  memset(batch, 0, sizeof(struct animation_batch));
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Easing curves and the batched interpolation kernel of the animator. This
+// unit has no framework dependencies, it builds and benchmarks on any host.
+
+#define INTERP_FUNCTION_LINEAR    'l'
+#define INTERP_FUNCTION_QUADRATIC 'q'
+#define INTERP_FUNCTION_SIN       's'
+#define INTERP_FUNCTION_TANH      't'
+#define INTERP_FUNCTION_CIRC      'c'
+#define INTERP_FUNCTION_BOUNCE    'b'
+#define INTERP_FUNCTION_EXP       'e'
+#define INTERP_FUNCTION_OVERSHOOT 'o'
+#define INTERP_FUNCTION_BEZIER    'z'
+#define INTERP_FUNCTION_SPRING    'k'
+
+// Selects the user defined curve currently held by the animator
+#define INTERP_FUNCTION_CUSTOM    'x'
+
+// Easing curves are sampled once into a lookup table, such that evaluating
+// a curve is a table lookup followed by a linear interpolation.
+#define ANIMATION_CURVE_RESOLUTION 1024
+
+struct animation_curve {
+  char type;
+  float parameters[4];
+  float table[ANIMATION_CURVE_RESOLUTION + 1];
+};
+
+#define ANIMATION_KIND_INT   0
+#define ANIMATION_KIND_FLOAT 1
+#define ANIMATION_KIND_BYTES 2
+
+#define ANIMATION_NO_GROUP UINT32_MAX
+
+struct animation;
+
+struct animation_group {
+  struct animation_curve* curve;
+  uint32_t kind;
+  uint32_t offset;
+  uint32_t count;
+};
+
+// Per frame scratch storage of the animator: the active animations are
+// laid out as structure of arrays, contiguous per animation_group.
+struct animation_batch {
+  uint32_t capacity;
+  struct animation** animations;
+  uint32_t* group_of;
+
+  struct animation_group* groups;
+  uint32_t* group_cursor;
+  uint32_t group_capacity;
+
+  double* progress;
+  double* slider;
+  int* from;
+  int* to;
+  int* values;
+  double* scratch;
+};
+
+struct animation_curve* animation_curve_builtin(char type);
+struct animation_curve* animation_curve_register(char type, float* parameters);
+struct animation_curve* animation_curve_parse(char* description);
+void animation_curve_get_name(struct animation_curve* curve, char* name, size_t size);
+
+static inline double animation_curve_evaluate(struct animation_curve* curve, double x) {
+  double position = x * ANIMATION_CURVE_RESOLUTION;
+  uint32_t index = position;
+  if (index >= ANIMATION_CURVE_RESOLUTION)
+    return curve->table[ANIMATION_CURVE_RESOLUTION];
+
+  double fraction = position - index;
+  return curve->table[index]
+         + fraction * (curve->table[index + 1] - curve->table[index]);
+}
+
+void animation_batch_reserve(struct animation_batch* batch, uint32_t count);
+uint32_t animation_batch_add_group(struct animation_batch* batch, uint32_t group_count, struct animation_curve* curve, uint32_t kind);
+void animation_batch_evaluate(struct animation_batch* batch, struct animation_group* group);
+void animation_batch_destroy(struct animation_batch* batch);
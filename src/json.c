@@ -0,0 +1,404 @@
+#include "json.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_INITIAL_CAPACITY 4096
+
+void json_init(struct json* json) {
+  memset(json, 0, sizeof(struct json));
+  json->levels[0].selected = true;
+}
+
+void json_destroy(struct json* json) {
+  if (json->buffer) free(json->buffer);
+  if (json->fields_string) free(json->fields_string);
+  if (json->fields) free(json->fields);
+  memset(json, 0, sizeof(struct json));
+}
+
+// Discards the output, the requested fields are kept
+void json_reset(struct json* json) {
+  json->length = 0;
+  json->depth = 0;
+  json->skipped = 0;
+  json->capturing = 0;
+  for (uint32_t i = 0; i < json->field_count; i++) {
+    json->fields[i].has_value = false;
+    json->fields[i].is_container = false;
+  }
+
+  memset(&json->levels[0], 0, sizeof(struct json_level));
+  json->levels[0].selected = json->field_count == 0;
+  json->levels[0].matching = json->field_count < 64
+                             ? (1ULL << json->field_count) - 1
+                             : UINT64_MAX;
+}
+
+// Splits off the text up to the next delimiter like strsep, which is not
+// part of C99
+static char* json_split(char** cursor, char delimiter) {
+  char* token = *cursor;
+  char* end = strchr(token, delimiter);
+  if (end) {
+    *end = '\0';
+    *cursor = end + 1;
+  } else {
+    *cursor = NULL;
+  }
+  return token;
+}
+
+// Restricts the output to a comma separated list of dotted paths, e.g.
+// "label.value,icon.color". Containers on the way to a field are emitted
+// with only the members leading to the field.
+bool json_set_fields(struct json* json, char* fields) {
+  if (json->fields_string) free(json->fields_string);
+  if (json->fields) free(json->fields);
+  json->fields_string = NULL;
+  json->fields = NULL;
+  json->field_count = 0;
+
+  if (fields && *fields) {
+    size_t length = strlen(fields) + 1;
+    json->fields_string = malloc(length);
+    memcpy(json->fields_string, fields, length);
+    json->fields = malloc(sizeof(struct json_field) * JSON_MAX_FIELDS);
+
+    char* cursor = json->fields_string;
+    while (cursor) {
+      char* path = json_split(&cursor, ',');
+      if (!*path) continue;
+      if (json->field_count == JSON_MAX_FIELDS) {
+        json_set_fields(json, NULL);
+        return false;
+      }
+
+      struct json_field* field = &json->fields[json->field_count++];
+      field->count = 0;
+      while (path) {
+        if (field->count == JSON_MAX_DEPTH) {
+          json_set_fields(json, NULL);
+          return false;
+        }
+        field->segments[field->count++] = json_split(&path, '.');
+      }
+    }
+  }
+
+  json_reset(json);
+  return true;
+}
+
+// Compares the scalar a field resolved to, strings without their quotes
+bool json_field_equals(struct json* json, uint32_t field, char* value) {
+  if (field >= json->field_count || !json->fields[field].has_value)
+    return false;
+
+  char* text = json->buffer + json->fields[field].value_offset;
+  size_t length = json->fields[field].value_length;
+  if (length >= 2 && text[0] == '"' && text[length - 1] == '"') {
+    text++;
+    length -= 2;
+  }
+  return length == strlen(value) && !memcmp(text, value, length);
+}
+
+void json_flush(struct json* json, FILE* rsp) {
+  if (json->length == 0) return;
+  fwrite(json->buffer, 1, json->length, rsp);
+  fputc('\n', rsp);
+  json_reset(json);
+}
+
+static void json_reserve(struct json* json, size_t size) {
+  if (json->length + size <= json->capacity) return;
+  size_t capacity = json->capacity ? json->capacity : JSON_INITIAL_CAPACITY;
+  while (capacity < json->length + size) capacity *= 2;
+
+  json->buffer = realloc(json->buffer, capacity);
+  json->capacity = capacity;
+}
+
+static void json_write(struct json* json, const char* data, size_t length) {
+  json_reserve(json, length);
+  memcpy(json->buffer + json->length, data, length);
+  json->length += length;
+}
+
+static void json_printf(struct json* json, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  json_reserve(json, 64);
+  int length = vsnprintf(json->buffer + json->length,
+                         json->capacity - json->length,
+                         format,
+                         args                          );
+  va_end(args);
+
+  if (length < 0) return;
+  if (json->length + length >= json->capacity) {
+    json_reserve(json, length + 1);
+    va_start(args, format);
+    vsnprintf(json->buffer + json->length,
+              json->capacity - json->length,
+              format,
+              args                          );
+    va_end(args);
+  }
+  json->length += length;
+}
+
+// Integers and colors are the bulk of the scalars, they are formatted by
+// hand instead of going through vsnprintf.
+static void json_write_uint(struct json* json, uint64_t value) {
+  char digits[20];
+  uint32_t count = 0;
+  do {
+    digits[sizeof(digits) - ++count] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  json_write(json, digits + sizeof(digits) - count, count);
+}
+
+static void json_write_hex(struct json* json, uint32_t value) {
+  char digits[8];
+  uint32_t count = 0;
+  do {
+    digits[sizeof(digits) - ++count] = "0123456789abcdef"[value & 0xf];
+    value >>= 4;
+  } while (value);
+  json_write(json, digits + sizeof(digits) - count, count);
+}
+
+// Length of the leading run of characters that can be copied verbatim,
+// the scan stops at the terminating NUL as well.
+static inline size_t json_verbatim_length(const unsigned char* string) {
+  const unsigned char* cursor = string;
+  while (*cursor >= 0x20 && *cursor != '"' && *cursor != '\\') cursor++;
+  return cursor - string;
+}
+
+static void json_write_string(struct json* json, char* string) {
+  const unsigned char* cursor = (const unsigned char*)string;
+  size_t length = json_verbatim_length(cursor);
+
+  json_reserve(json, length + 2);
+  json->buffer[json->length++] = '"';
+  memcpy(json->buffer + json->length, cursor, length);
+  json->length += length;
+  cursor += length;
+
+  // Only strings with characters that need escaping take the slow path
+  while (*cursor) {
+    switch (*cursor) {
+      case '"': json_write(json, "\\\"", 2); break;
+      case '\\': json_write(json, "\\\\", 2); break;
+      case '\n': json_write(json, "\\n", 2); break;
+      case '\r': json_write(json, "\\r", 2); break;
+      case '\t': json_write(json, "\\t", 2); break;
+      default: json_printf(json, "\\u%04x", *cursor); break;
+    }
+    cursor++;
+
+    length = json_verbatim_length(cursor);
+    json_write(json, (const char*)cursor, length);
+    cursor += length;
+  }
+
+  json_write(json, "\"", 1);
+}
+
+static void json_indent(struct json* json, uint32_t depth) {
+  json_reserve(json, depth);
+  memset(json->buffer + json->length, '\t', depth);
+  json->length += depth;
+}
+
+// Decides whether the value with the given key is part of the projection
+// and derives the state of its members in case it is a container.
+static bool json_select(struct json* json, char* key, bool container, struct json_level* next) {
+  struct json_level* level = &json->levels[json->depth];
+  *next = *level;
+  next->has_members = false;
+  if (level->selected) return true;
+  if (!key) return container;
+
+  uint64_t matching = 0;
+  bool selected = false;
+  for (uint32_t i = 0; i < json->field_count; i++) {
+    if (!(level->matching & (1ULL << i))) continue;
+    struct json_field* field = &json->fields[i];
+    if (strcmp(field->segments[level->segment], key) != 0) continue;
+
+    if (field->count == level->segment + 1) {
+      if (container) field->is_container = true;
+      else json->capturing |= 1ULL << i;
+      selected = true;
+      continue;
+    }
+    matching |= 1ULL << i;
+  }
+
+  if (selected) {
+    next->selected = true;
+    return true;
+  }
+
+  next->segment = level->segment + 1;
+  next->matching = matching;
+  return container && matching;
+}
+
+static void json_begin_value(struct json* json, char* key) {
+  if (json->depth > 0) {
+    struct json_level* level = &json->levels[json->depth];
+    if (json->compact) {
+      if (level->has_members) json_write(json, ",", 1);
+    } else {
+      if (level->has_members) json_write(json, ",\n", 2);
+      else json_write(json, "\n", 1);
+      json_indent(json, json->depth);
+    }
+    level->has_members = true;
+  }
+
+  if (key) {
+    json_write_string(json, key);
+    json_write(json, ": ", json->compact ? 1 : 2);
+  }
+}
+
+// Values outside of the projection are dropped before they are formatted,
+// skipped containers are only counted such that their end can be matched.
+// Containers nested deeper than JSON_MAX_DEPTH are dropped the same way.
+static bool json_begin_container(struct json* json, char* key, char bracket) {
+  struct json_level next;
+  if (json->skipped > 0
+      || json->depth >= JSON_MAX_DEPTH - 1
+      || !json_select(json, key, true, &next)) {
+    json->skipped++;
+    return false;
+  }
+
+  json_begin_value(json, key);
+  json_write(json, &bracket, 1);
+  json->depth++;
+  json->levels[json->depth] = next;
+  return true;
+}
+
+static void json_end_container(struct json* json, char bracket) {
+  if (json->skipped > 0) {
+    json->skipped--;
+    return;
+  }
+
+  if (json->depth == 0) return;
+  if (json->levels[json->depth].has_members && !json->compact) {
+    json_write(json, "\n", 1);
+    json_indent(json, json->depth - 1);
+  }
+  json->depth--;
+  json_write(json, &bracket, 1);
+}
+
+static bool json_begin_scalar(struct json* json, char* key) {
+  struct json_level next;
+  json->capturing = 0;
+  if (json->skipped > 0 || !json_select(json, key, false, &next)) return false;
+
+  json_begin_value(json, key);
+  if (!json->capturing) return true;
+  for (uint32_t i = 0; i < json->field_count; i++) {
+    if (json->capturing & (1ULL << i))
+      json->fields[i].value_offset = json->length;
+  }
+  return true;
+}
+
+static void json_end_scalar(struct json* json) {
+  if (!json->capturing) return;
+  for (uint32_t i = 0; i < json->field_count; i++) {
+    if (!(json->capturing & (1ULL << i))) continue;
+    json->fields[i].value_length = json->length - json->fields[i].value_offset;
+    json->fields[i].has_value = true;
+  }
+  json->capturing = 0;
+}
+
+bool json_object_begin(struct json* json, char* key) {
+  return json_begin_container(json, key, '{');
+}
+
+void json_object_end(struct json* json) {
+  json_end_container(json, '}');
+}
+
+bool json_array_begin(struct json* json, char* key) {
+  return json_begin_container(json, key, '[');
+}
+
+void json_array_end(struct json* json) {
+  json_end_container(json, ']');
+}
+
+void json_string(struct json* json, char* key, char* value) {
+  if (!json_begin_scalar(json, key)) return;
+  if (value) json_write_string(json, value);
+  else json_write(json, "null", 4);
+  json_end_scalar(json);
+}
+
+void json_int(struct json* json, char* key, int64_t value) {
+  if (!json_begin_scalar(json, key)) return;
+  if (value < 0) {
+    json_write(json, "-", 1);
+    json_write_uint(json, -(uint64_t)value);
+  } else {
+    json_write_uint(json, value);
+  }
+  json_end_scalar(json);
+}
+
+void json_uint(struct json* json, char* key, uint64_t value) {
+  if (!json_begin_scalar(json, key)) return;
+  json_write_uint(json, value);
+  json_end_scalar(json);
+}
+
+// isfinite() is folded to true under -ffast-math, the exponent bits are
+// checked directly instead: all ones encodes NaN and the infinities.
+static bool json_is_finite(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return ((bits >> 52) & 0x7ff) != 0x7ff;
+}
+
+void json_float(struct json* json, char* key, double value, uint32_t precision) {
+  if (!json_begin_scalar(json, key)) return;
+  if (json_is_finite(value)) json_printf(json, "%.*f", precision, value);
+  else json_write(json, "null", 4);
+  json_end_scalar(json);
+}
+
+void json_color(struct json* json, char* key, uint32_t color) {
+  if (!json_begin_scalar(json, key)) return;
+  json_write(json, "\"0x", 3);
+  json_write_hex(json, color);
+  json_write(json, "\"", 1);
+  json_end_scalar(json);
+}
+
+void json_null(struct json* json, char* key) {
+  if (!json_begin_scalar(json, key)) return;
+  json_write(json, "null", 4);
+  json_end_scalar(json);
+}
+
+// Inserts an already serialized value
+void json_raw(struct json* json, char* key, char* value, size_t length) {
+  if (!json_begin_scalar(json, key)) return;
+  json_write(json, value, length);
+  json_end_scalar(json);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define JSON_MAX_DEPTH  32
+#define JSON_MAX_FIELDS 64
+
+// A requested field given as dotted path, e.g. "label.value". The position
+// of the scalar value the path resolved to in the output is recorded, such
+// that fields can be used as conditions.
+struct json_field {
+  char* segments[JSON_MAX_DEPTH];
+  uint32_t count;
+
+  bool has_value;
+  bool is_container;
+  size_t value_offset;
+  size_t value_length;
+};
+
+struct json_level {
+  bool has_members;
+
+  // Projection state: a selected level is emitted entirely, otherwise only
+  // the members leading to one of the matching fields are emitted.
+  bool selected;
+  uint32_t segment;
+  uint64_t matching;
+};
+
+// Streams pretty printed JSON into a growable buffer. Members are separated
+// and indented automatically, the key is NULL for array elements and for
+// the root value.
+// Containers outside of the requested fields are not emitted, in which case
+// their begin function returns false. The end function is called anyway.
+struct json {
+  char* buffer;
+  size_t length;
+  size_t capacity;
+
+  // Compact output is written on a single line without indentation
+  bool compact;
+  uint32_t depth;
+  uint32_t skipped;
+  struct json_level levels[JSON_MAX_DEPTH];
+
+  char* fields_string;
+  struct json_field* fields;
+  uint32_t field_count;
+
+  // Fields resolving to the scalar currently being written
+  uint64_t capturing;
+};
+
+void json_init(struct json* json);
+void json_destroy(struct json* json);
+void json_reset(struct json* json);
+void json_flush(struct json* json, FILE* rsp);
+bool json_set_fields(struct json* json, char* fields);
+bool json_field_equals(struct json* json, uint32_t field, char* value);
+
+bool json_object_begin(struct json* json, char* key);
+void json_object_end(struct json* json);
+bool json_array_begin(struct json* json, char* key);
+void json_array_end(struct json* json);
+
+void json_string(struct json* json, char* key, char* value);
+void json_int(struct json* json, char* key, int64_t value);
+void json_uint(struct json* json, char* key, uint64_t value);
+void json_float(struct json* json, char* key, double value, uint32_t precision);
+void json_color(struct json* json, char* key, uint32_t color);
+void json_null(struct json* json, char* key);
+void json_raw(struct json* json, char* key, char* value, size_t length);
@@ -49,6 +49,33 @@ void mach_receive_message(mach_port_t port, struct mach_buffer* buffer, bool tim
   }
 }
 
+static void mach_message_fill(struct mach_message* msg, mach_port_t port, mach_port_t response_port, char* message, uint32_t len) {
+  msg->header.msgh_remote_port = port;
+  if (response_port) {
+    msg->header.msgh_local_port = response_port;
+    msg->header.msgh_id = response_port;
+    msg->header.msgh_bits = MACH_MSGH_BITS_SET(MACH_MSG_TYPE_COPY_SEND,
+                                               MACH_MSG_TYPE_MAKE_SEND,
+                                               0,
+                                               MACH_MSGH_BITS_COMPLEX  );
+  } else {
+    msg->header.msgh_bits = MACH_MSGH_BITS_SET(MACH_MSG_TYPE_COPY_SEND
+                                               & MACH_MSGH_BITS_REMOTE_MASK,
+                                               0,
+                                               0,
+                                               MACH_MSGH_BITS_COMPLEX       );
+  }
+
+  msg->header.msgh_size = sizeof(struct mach_message);
+
+  msg->msgh_descriptor_count = 1;
+  msg->descriptor.address = message;
+  msg->descriptor.size = len * sizeof(char);
+  msg->descriptor.copy = MACH_MSG_VIRTUAL_COPY;
+  msg->descriptor.deallocate = false;
+  msg->descriptor.type = MACH_MSG_OOL_DESCRIPTOR;
+}
+
 char* mach_send_message(mach_port_t port, char* message, uint32_t len, bool await_response) {
   if (!message || !port) return NULL;
 
@@ -68,30 +95,9 @@ char* mach_send_message(mach_port_t port, char* message, uint32_t len, bool awai
   }
 
   struct mach_message msg = { 0 };
-  msg.header.msgh_remote_port = port;
-  if (await_response) {
-    msg.header.msgh_local_port = response_port;
-    msg.header.msgh_id = response_port;
-    msg.header.msgh_bits = MACH_MSGH_BITS_SET(MACH_MSG_TYPE_COPY_SEND,
-                                              MACH_MSG_TYPE_MAKE_SEND,
-                                              0,
-                                              MACH_MSGH_BITS_COMPLEX  );
-  } else {
-    msg.header.msgh_bits = MACH_MSGH_BITS_SET(MACH_MSG_TYPE_COPY_SEND
-                                              & MACH_MSGH_BITS_REMOTE_MASK,
-                                              0,
-                                              0,
-                                              MACH_MSGH_BITS_COMPLEX       );
-  }
-
-  msg.header.msgh_size = sizeof(struct mach_message);
-
-  msg.msgh_descriptor_count = 1;
-  msg.descriptor.address = message;
-  msg.descriptor.size = len * sizeof(char);
-  msg.descriptor.copy = MACH_MSG_VIRTUAL_COPY;
-  msg.descriptor.deallocate = false;
-  msg.descriptor.type = MACH_MSG_OOL_DESCRIPTOR;
+  mach_message_fill(&msg, port, await_response ? response_port : 0,
+                          message,
+                          len                                      );
 
   mach_msg(&msg.header,
            MACH_SEND_MSG,
@@ -124,6 +130,75 @@ char* mach_send_message(mach_port_t port, char* message, uint32_t len, bool awai
   return NULL;
 }
 
+// Never blocks the event loop: a watcher that does not keep up with the
+// frames gets MACH_SEND_TIMED_OUT and a dead one MACH_SEND_INVALID_DEST
+mach_msg_return_t mach_send_stream_message(mach_port_t port, char* message, uint32_t len) {
+  if (!message || !port) return MACH_SEND_INVALID_DEST;
+
+  struct mach_message msg = { 0 };
+  mach_message_fill(&msg, port, 0, message, len);
+  return mach_msg(&msg.header,
+                  MACH_SEND_MSG | MACH_SEND_TIMEOUT,
+                  sizeof(struct mach_message),
+                  0,
+                  MACH_PORT_NULL,
+                  0,
+                  MACH_PORT_NULL                    );
+}
+
+// Sends the message and hands every message arriving on the response port
+// to the handler until the server goes away
+void mach_receive_stream(mach_port_t port, char* message, uint32_t len, mach_stream_handler* handler) {
+  if (!message || !port) return;
+
+  mach_port_t response_port;
+  mach_port_name_t task = mach_task_self();
+  if (mach_port_allocate(task, MACH_PORT_RIGHT_RECEIVE,
+                               &response_port          ) != KERN_SUCCESS) {
+    return;
+  }
+
+  if (mach_port_insert_right(task, response_port,
+                                   response_port,
+                                   MACH_MSG_TYPE_MAKE_SEND)!= KERN_SUCCESS) {
+    return;
+  }
+
+  mach_port_t previous;
+  mach_port_request_notification(task, port, MACH_NOTIFY_DEAD_NAME,
+                                              0,
+                                              response_port,
+                                              MACH_MSG_TYPE_MAKE_SEND_ONCE,
+                                              &previous                   );
+
+  struct mach_message msg = { 0 };
+  mach_message_fill(&msg, port, response_port, message, len);
+  mach_msg(&msg.header,
+           MACH_SEND_MSG,
+           sizeof(struct mach_message),
+           0,
+           MACH_PORT_NULL,
+           MACH_MSG_TIMEOUT_NONE,
+           MACH_PORT_NULL             );
+
+  while (true) {
+    struct mach_buffer buffer = { 0 };
+    mach_receive_message(response_port, &buffer, false);
+    if (buffer.message.header.msgh_id == MACH_NOTIFY_DEAD_NAME
+        || !(buffer.message.header.msgh_bits & MACH_MSGH_BITS_COMPLEX)
+        || !buffer.message.descriptor.address) {
+      break;
+    }
+
+    bool proceed = handler(buffer.message.descriptor.address);
+    mach_msg_destroy(&buffer.message.header);
+    if (!proceed) break;
+  }
+
+  mach_port_mod_refs(task, response_port, MACH_PORT_RIGHT_RECEIVE, -1);
+  mach_port_deallocate(task, response_port);
+}
+
 void mach_message_callback(CFMachPortRef port, void* message, CFIndex size, void* context) {
   struct mach_server* mach_server = context;
   struct mach_buffer buffer;
@@ -2,6 +2,7 @@
 #include <bootstrap.h>
 #include <mach/mach.h>
 #include <mach/message.h>
+#include <mach/notify.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -22,6 +23,9 @@ struct mach_buffer {
 #define MACH_HANDLER(name) void name(struct mach_buffer* message)
 typedef MACH_HANDLER(mach_handler);
 
+#define MACH_STREAM_HANDLER(name) bool name(char* message)
+typedef MACH_STREAM_HANDLER(mach_stream_handler);
+
 struct mach_server {
   bool is_running;
   mach_port_name_t task;
@@ -33,4 +37,6 @@ struct mach_server {
 
 bool mach_server_begin(struct mach_server* mach_server, mach_handler handler);
 char* mach_send_message(mach_port_t port, char* message, uint32_t len, bool await_response);
+mach_msg_return_t mach_send_stream_message(mach_port_t port, char* message, uint32_t len);
+void mach_receive_stream(mach_port_t port, char* message, uint32_t len, mach_stream_handler* handler);
 mach_port_t mach_get_bs_port(char* bs_name);
@@ -8,6 +8,10 @@
 #include "media.h"
 #include "wifi.h"
 #include "power.h"
+#include "text_cache.h"
+#include "batch.h"
+#include "startup.h"
+#include "image_cache.h"
 
 extern struct bar_manager g_bar_manager;
 
@@ -49,18 +53,20 @@ static struct bar_item** get_bar_items_for_regex(struct token reg, FILE* rsp, ui
   return bar_items;
 }
 
-static void handle_domain_subscribe(FILE* rsp, struct token domain, char* message) {
+static bool handle_domain_subscribe(FILE* rsp, struct token domain, char* message) {
   struct token name = get_token(&message);
 
   int item_index_for_name = bar_manager_get_item_index_for_name(&g_bar_manager,
                                                                 name.text    );
   if (item_index_for_name < 0) {
     respond(rsp, "[!] Subscribe: Item not found '%s'\n", name.text);
-    return;
+    return false;
   }
   struct bar_item* bar_item = g_bar_manager.bar_items[item_index_for_name];
 
   bar_item_parse_subscribe_message(bar_item, message, rsp);
+  watch_list_mark(&g_bar_manager.watch_list, bar_item);
+  return true;
 }
 
 static void handle_domain_trigger(FILE* rsp, struct token domain, char* message) {
@@ -115,15 +121,11 @@ static void handle_domain_push(FILE* rsp, struct token domain, char* message) {
     respond(rsp, "[!] Push: Item '%s' not a graph\n", name.text);
     return;
   }
-  struct token y = get_token(&message);
-  while (y.text && y.length > 0) {
-    graph_push_back(&bar_item->graph, token_to_float(y));
-    y = get_token(&message);
-  }
-  bar_item_needs_update(bar_item);
+  if (graph_push(&bar_item->graph, rsp, message))
+    bar_item_needs_update(bar_item);
 }
 
-static void handle_domain_rename(FILE* rsp, struct token domain, char* message) {
+static bool handle_domain_rename(FILE* rsp, struct token domain, char* message) {
   struct token old_name  = get_token(&message);
   struct token new_name  = get_token(&message);
   int item_index_for_old_name = bar_manager_get_item_index_for_name(&g_bar_manager,
@@ -133,13 +135,14 @@ static void handle_domain_rename(FILE* rsp, struct token domain, char* message)
   if (item_index_for_old_name < 0 || item_index_for_new_name >= 0) {
     respond(rsp, "[!] Rename: Failed to rename item: %s -> %s\n", old_name.text,
                                                                   new_name.text);
-    return;
+    return false;
   }
   bar_item_set_name(g_bar_manager.bar_items[item_index_for_old_name],
                     token_to_string(new_name)                        );
+  return true;
 }
 
-static void handle_domain_clone(FILE* rsp, struct token domain, char* message) {
+static bool handle_domain_clone(FILE* rsp, struct token domain, char* message) {
   struct token name = get_token(&message);
   struct token parent = get_token(&message);
   struct token modifier = get_token(&message);
@@ -152,24 +155,26 @@ static void handle_domain_clone(FILE* rsp, struct token domain, char* message) {
     parent_item = g_bar_manager.bar_items[parent_index];
   else {
     respond(rsp, "[!] Clone: Parent Item '%s' not found\n", parent.text);
-    return;
+    return false;
   }
 
   if (bar_manager_get_item_index_for_name(&g_bar_manager, name.text) >= 0) {
     respond(rsp, "[?] Clone: Item '%s' already exists\n", name.text);
-    return;
+    return false;
   }
   struct bar_item* bar_item = bar_manager_create_item(&g_bar_manager);
   bar_item_inherit_from_item(bar_item, parent_item);
   bar_item_set_name(bar_item, token_to_string(name));
+  bar_item->restored = g_bar_manager.restoring;
   if (token_equals(modifier, ARGUMENT_COMMON_VAL_BEFORE))
     bar_manager_move_item(&g_bar_manager, bar_item, parent_item, true);
   else if (token_equals(modifier, ARGUMENT_COMMON_VAL_AFTER))
     bar_manager_move_item(&g_bar_manager, bar_item, parent_item, false);
   bar_item_needs_update(bar_item);
+  return true;
 }
 
-static void handle_domain_add(FILE* rsp, struct token domain, char* message) {
+static bool handle_domain_add(FILE* rsp, struct token domain, char* message) {
   struct token command  = get_token(&message);
 
   if (token_equals(command, COMMAND_ADD_EVENT)) {
@@ -181,7 +186,7 @@ static void handle_domain_add(FILE* rsp, struct token domain, char* message) {
     else custom_events_append(&g_bar_manager.custom_events,
                               token_to_string(event),
                               NULL                         );
-    return;
+    return true;
   }
 
   struct token name = get_token(&message);
@@ -189,9 +194,10 @@ static void handle_domain_add(FILE* rsp, struct token domain, char* message) {
 
   if (bar_manager_get_item_index_for_name(&g_bar_manager, name.text) >= 0) {
     respond(rsp, "[?] Add: Item '%s' already exists\n", name.text);
-    return;
+    return false;
   }
   struct bar_item* bar_item = bar_manager_create_item(&g_bar_manager);
+  bar_item->restored = g_bar_manager.restoring;
 
   if (!bar_item_set_type(bar_item, command.text)) {
     respond(rsp, "[?] Add %s: Invalid type '%s', assuming 'item'\n",
@@ -204,13 +210,13 @@ static void handle_domain_add(FILE* rsp, struct token domain, char* message) {
     respond(rsp, "[!] Add %s: Illegal position '%s'\n", name.text,
                                                         position.text);
     bar_manager_remove_item(&g_bar_manager, bar_item);
-    return;
+    return false;
   }
 
   if (!bar_item_set_name(bar_item, token_to_string(name))) {
     respond(rsp, "[!] Add: Illegal name '%s'\n", name.text);
     bar_manager_remove_item(&g_bar_manager, bar_item);
-    return;
+    return false;
   }
 
   if (token_equals(command, COMMAND_ADD_ITEM)) {
@@ -287,7 +293,7 @@ static void handle_domain_add(FILE* rsp, struct token domain, char* message) {
           free(bar_items);
         } else if (first) {
           bar_manager_remove_item(&g_bar_manager, bar_item);
-          break;
+          return false;
         }
         member = get_token(&message);
       }
@@ -308,7 +314,7 @@ static void handle_domain_add(FILE* rsp, struct token domain, char* message) {
 
         free(pair);
         bar_manager_remove_item(&g_bar_manager, bar_item);
-        return;
+        return false;
       }
       struct bar_item* target_item = g_bar_manager.bar_items[item_index_for_name];
       popup_add_item(&target_item->popup, bar_item);
@@ -317,6 +323,7 @@ static void handle_domain_add(FILE* rsp, struct token domain, char* message) {
   }
 
   bar_item_needs_update(bar_item);
+  return true;
 }
 
 static void handle_domain_default(FILE* rsp, struct token domain, char* message) {
@@ -353,6 +360,15 @@ static bool handle_domain_bar(FILE *rsp, struct token domain, char *message) {
     needs_refresh = bar_manager_set_font_smoothing(&g_bar_manager,
                                                    evaluate_boolean_state(state,
                                                                           g_bar_manager.font_smoothing));
+  } else if (token_equals(command, PROPERTY_ANIMATION_CLOCK)) {
+    struct token token = get_token(&message);
+    uint32_t rate = token_equals(token, ARGUMENT_ANIMATION_CLOCK_DISPLAY)
+                    ? 0
+                    : token_to_uint32t(token);
+    animator_set_frame_source(&g_bar_manager.animator, rate);
+  } else if (token_equals(command, PROPERTY_ANIMATION_FPS)) {
+    struct token token = get_token(&message);
+    animator_set_max_fps(&g_bar_manager.animator, token_to_uint32t(token));
   } else if (token_equals(command, PROPERTY_SHADOW)) {
     struct token state = get_token(&message);
     needs_refresh = bar_manager_set_shadow(&g_bar_manager,
@@ -487,10 +503,90 @@ static char* get_batch_line(char** message) {
   return rbr_msg;
 }
 
-static void handle_domain_query(FILE* rsp, struct token domain, char* message) {
-  struct token token = get_token(&message);
+// Conditions are comma separated <path>=<value> pairs, e.g.
+// "geometry.drawing=on", all of which have to hold for the item. They are
+// parsed once per query and all paths are projected into a single
+// serialization of each item.
+struct query_filter {
+  struct json json;
+  char* conditions;
+  char* paths[JSON_MAX_FIELDS];
+  char* values[JSON_MAX_FIELDS];
+  uint32_t count;
+
+  // Path of a condition naming a container instead of a value
+  char* invalid;
+};
+
+static bool query_filter_init(struct query_filter* filter, char* where) {
+  memset(filter, 0, sizeof(struct query_filter));
+  json_init(&filter->json);
+  if (!where) return true;
+
+  filter->conditions = string_copy(where);
+  char fields[strlen(where) + 1];
+  char* fields_cursor = fields;
+  char* cursor = filter->conditions;
+
+  while (cursor) {
+    char* condition = strsep(&cursor, ",");
+    if (!*condition) continue;
+
+    struct key_value_pair key_value_pair = get_key_value_pair(condition, '=');
+    if (!key_value_pair.key || !*key_value_pair.key
+        || filter->count == JSON_MAX_FIELDS) {
+      return false;
+    }
+
+    filter->paths[filter->count] = key_value_pair.key;
+    filter->values[filter->count++] = key_value_pair.value
+                                      ? key_value_pair.value
+                                      : "";
+    fields_cursor += sprintf(fields_cursor, "%s%s", fields_cursor == fields
+                                                    ? ""
+                                                    : ",",
+                                                    key_value_pair.key     );
+  }
+  *fields_cursor = '\0';
+
+  return filter->count > 0 && json_set_fields(&filter->json, fields);
+}
+
+static void query_filter_destroy(struct query_filter* filter) {
+  json_destroy(&filter->json);
+  if (filter->conditions) free(filter->conditions);
+}
 
-  if (token_equals(token, COMMAND_QUERY_DEFAULT_ITEMS)) {
+static bool query_item_matches(struct query_filter* filter, struct bar_item* bar_item) {
+  if (filter->invalid) return false;
+  if (!filter->count) return true;
+
+  json_reset(&filter->json);
+  bar_item_serialize(bar_item, &filter->json);
+
+  bool matches = true;
+  for (uint32_t i = 0; i < filter->count; i++) {
+    if (filter->json.fields[i].is_container) {
+      filter->invalid = filter->paths[i];
+      return false;
+    }
+    matches = matches && json_field_equals(&filter->json, i, filter->values[i]);
+  }
+  return matches;
+}
+
+static void handle_domain_query(FILE* rsp, struct token domain, char* message, char* fields, char* where) {
+  struct token token = get_token(&message);
+  struct json json;
+  struct query_filter filter;
+  json_init(&json);
+  bool valid_filter = query_filter_init(&filter, where);
+
+  if (!json_set_fields(&json, fields)) {
+    respond(rsp, "[!] Query: Invalid fields '%s'\n", fields);
+  } else if (!valid_filter) {
+    respond(rsp, "[!] Query: Invalid condition '%s'\n", where);
+  } else if (token_equals(token, COMMAND_QUERY_DEFAULT_ITEMS)) {
     print_all_menu_items(rsp);
   } else if (token_equals(token, COMMAND_QUERY_ITEM)) {
     struct token name  = get_token(&message);
@@ -498,30 +594,67 @@ static void handle_domain_query(FILE* rsp, struct token domain, char* message) {
                                                                   name.text      );
     if (item_index_for_name < 0) {
       respond(rsp, "[!] Query: Item '%s' not found\n", name.text);
-      return;
+    } else {
+      struct bar_item* bar_item = g_bar_manager.bar_items[item_index_for_name];
+      if (query_item_matches(&filter, bar_item))
+        bar_item_serialize(bar_item, &json);
+    }
+  } else if (token_equals(token, COMMAND_QUERY_ITEMS)) {
+    json_array_begin(&json, NULL);
+    for (int i = 0; i < g_bar_manager.bar_item_count; i++) {
+      struct bar_item* bar_item = g_bar_manager.bar_items[i];
+      if (query_item_matches(&filter, bar_item))
+        bar_item_serialize(bar_item, &json);
     }
-    bar_item_serialize(g_bar_manager.bar_items[item_index_for_name], rsp);
+    json_array_end(&json);
   } else if (token_equals(token, COMMAND_QUERY_BAR)) {
-    bar_manager_serialize(&g_bar_manager, rsp);
+    bar_manager_serialize(&g_bar_manager, &json);
   } else if (token_equals(token, COMMAND_QUERY_DEFAULTS)) {
-    bar_item_serialize(&g_bar_manager.default_item, rsp);
+    bar_item_serialize(&g_bar_manager.default_item, &json);
   } else if (token_equals(token, COMMAND_QUERY_EVENTS)) {
-    custom_events_serialize(&g_bar_manager.custom_events, rsp);
+    custom_events_serialize(&g_bar_manager.custom_events, &json);
   } else if (token_equals(token, COMMAND_QUERY_DISPLAYS)) {
-    display_serialize(rsp);
+    display_serialize(&json);
+  } else if (token_equals(token, COMMAND_QUERY_CACHES)) {
+    json_object_begin(&json, NULL);
+    json_object_begin(&json, "text");
+    text_cache_serialize(&g_text_cache, &json);
+    json_object_end(&json);
+    json_object_begin(&json, "image");
+    image_cache_serialize(&g_image_cache, &json);
+    json_object_end(&json);
+    json_object_end(&json);
+  } else if (token_equals(token, COMMAND_QUERY_STARTUP)) {
+    json_object_begin(&json, NULL);
+    startup_serialize(&g_startup, &json);
+    json_object_end(&json);
+  } else if (token_equals(token, COMMAND_QUERY_ANIMATIONS)) {
+    json_object_begin(&json, NULL);
+    animator_serialize(&g_bar_manager.animator, &json);
+    json_object_end(&json);
   } else {
     struct token name = token;
     int item_index_for_name = bar_manager_get_item_index_for_name(&g_bar_manager,
                                                                   name.text      );
     if (item_index_for_name < 0) {
       respond(rsp, "[!] Query: Invalid query, or item '%s' not found \n", name.text);
-      return;
+    } else {
+      struct bar_item* bar_item = g_bar_manager.bar_items[item_index_for_name];
+      if (query_item_matches(&filter, bar_item))
+        bar_item_serialize(bar_item, &json);
     }
-    bar_item_serialize(g_bar_manager.bar_items[item_index_for_name], rsp);
   }
+
+  if (filter.invalid) {
+    respond(rsp, "[!] Query: Condition '%s' does not name a value\n",
+                 filter.invalid                                       );
+  } else json_flush(&json, rsp);
+
+  json_destroy(&json);
+  query_filter_destroy(&filter);
 }
 
-static void handle_domain_remove(FILE* rsp, struct token domain, char* message) {
+static bool handle_domain_remove(FILE* rsp, struct token domain, char* message) {
   struct token name = get_token(&message);
   uint32_t count = 0;
   struct bar_item** bar_items = NULL;
@@ -535,22 +668,23 @@ static void handle_domain_remove(FILE* rsp, struct token domain, char* message)
                                                                   name.text      );
     if (item_index_for_name < 0) {
       respond(rsp, "[!] Remove: Item '%s' not found\n", name.text);
-      return;
+      return false;
     }
     bar_items = realloc(bar_items, sizeof(struct bar_item*));
     bar_items[0] = g_bar_manager.bar_items[item_index_for_name];
     count = 1;
   }
-  if (!bar_items || count == 0) return;
+  if (!bar_items || count == 0) return false;
 
   for (int i = 0; i < count; i++) {
     bar_manager_remove_item(&g_bar_manager, bar_items[i]);
   }
 
-  if (bar_items) free(bar_items);
+  free(bar_items);
+  return true;
 }
 
-static void handle_domain_move(FILE* rsp, struct token domain, char* message) {
+static bool handle_domain_move(FILE* rsp, struct token domain, char* message) {
   struct token name = get_token(&message);
   struct token direction = get_token(&message);
   struct token reference = get_token(&message);
@@ -559,7 +693,7 @@ static void handle_domain_move(FILE* rsp, struct token domain, char* message) {
   int reference_item_index = bar_manager_get_item_index_for_name(&g_bar_manager, reference.text);
   if (item_index < 0 || reference_item_index < 0) {
       respond(rsp, "[!] Move: Item '%s' or '%s' not found\n", name.text, reference.text);
-      return;
+      return false;
   }
 
   bar_manager_move_item(&g_bar_manager,
@@ -568,6 +702,7 @@ static void handle_domain_move(FILE* rsp, struct token domain, char* message) {
                         token_equals(direction, ARGUMENT_COMMON_VAL_BEFORE));
 
   bar_item_needs_update(g_bar_manager.bar_items[item_index]);
+  return true;
 }
 
 static void handle_domain_order(FILE* rsp, struct token domain, char* message) {
@@ -593,21 +728,115 @@ static void handle_domain_order(FILE* rsp, struct token domain, char* message) {
   bar_manager_refresh(&g_bar_manager, false, false);
 }
 
-void handle_message_mach(struct mach_buffer* buffer) {
-  if (!buffer->message.descriptor.address) return;
-  char* message = buffer->message.descriptor.address;
-  char* response = NULL;
-  size_t length = 0;
-  FILE* rsp = open_memstream(&response, &length);
-  fprintf(rsp, "");
+static void handle_domain_snapshot(FILE* rsp, struct token domain, char* message) {
+  struct token command = get_token(&message);
+  struct token path = get_token(&message);
+
+  char file[4096];
+  if (path.text && path.length > 0) snprintf(file, sizeof(file), "%s", path.text);
+  else snapshot_default_path(file, sizeof(file));
+
+  if (token_equals(command, COMMAND_SNAPSHOT_SAVE)) {
+    if (!snapshot_save(&g_bar_manager.snapshot, &g_bar_manager.config,
+                                                                  file)) {
+      respond(rsp, "[!] Snapshot: Could not write '%s'\n", file);
+    }
+  } else if (token_equals(command, COMMAND_SNAPSHOT_LOAD)) {
+    if (!handle_snapshot_file(file, rsp)) {
+      respond(rsp, "[!] Snapshot: '%s' is missing or incompatible\n", file);
+    }
+  } else {
+    respond(rsp, "[!] Snapshot: Invalid command '%s'\n", command.text);
+  }
+}
+
+// Length of the command starting at the cursor, up to the next command or
+// the end of the batch, with the same boundaries as get_batch_line
+static uint32_t get_segment_length(char* cursor) {
+  uint32_t length = 0;
+  while (cursor[length] || (cursor[length + 1] && cursor[length + 1] != '-'))
+    length++;
+  return length + 1;
+}
+
+static void journal_command(char* segment, uint32_t length, bool configured) {
+  snapshot_record(&g_bar_manager.snapshot, segment, length);
+  if (configured) snapshot_record(&g_bar_manager.config, segment, length);
+}
+
+// The first --add or --clone of an item restored from the snapshot claims
+// it. The same definition keeps the restored state, a different one replaces
+// the item. Returns true if the command is fully handled.
+static bool claim_restored_item(struct token name, char* segment, uint32_t length) {
+  int index = bar_manager_get_item_index_for_name(&g_bar_manager, name.text);
+  if (index < 0 || !g_bar_manager.bar_items[index]->restored) return false;
+
+  struct bar_item* bar_item = g_bar_manager.bar_items[index];
+  bar_item->restored = false;
+  if (snapshot_defines(&g_bar_manager.snapshot, bar_item->name,
+                                                segment,
+                                                length         )) {
+    return true;
+  }
+
+  char remove[name.length + strlen(DOMAIN_REMOVE) + 3];
+  uint32_t remove_length = sprintf(remove, "%s%c%s", DOMAIN_REMOVE,
+                                                     '\0',
+                                                     name.text     ) + 1;
+  bar_manager_remove_item(&g_bar_manager, bar_item);
+  journal_command(remove, remove_length, false);
+  return false;
+}
+
+// Nesting depth of handle_message, batches loaded by a message run nested
+static uint32_t g_message_depth = 0;
 
-  g_bar_manager.animator.interp_function = '\0';
-  g_bar_manager.animator.duration = 0;
+// Handles a batch of NUL separated commands. Client messages and in-process
+// loaders share this path, the port is the one changes are streamed to.
+void handle_message(char* message, mach_port_t port, FILE* rsp) {
+  // Property parsing splits key=value tokens in place, the journal records
+  // the state changing commands from an untouched copy
+  char* segment = NULL;
+  uint32_t segment_capacity = 0;
+
+  g_message_depth++;
+  animator_reset_timing(&g_bar_manager.animator);
   bar_manager_freeze(&g_bar_manager);
   struct token command = get_token(&message);
   bool bar_needs_refresh = false;
 
+  // Messages of the running config are tagged with its run, while it is
+  // reconciled its state changes only go to the shadow journal
+  uint32_t origin = 0;
+  if (token_equals(command, DOMAIN_ORIGIN)) {
+    origin = token_to_uint32t(get_token(&message));
+    command = get_token(&message);
+  }
+  bool configured = is_config_run(origin);
+  bool shadowed = configured && g_bar_manager.reconciling;
+  if (configured) startup_config_message(&g_startup);
+
   while (command.text && command.length > 0) {
+    bool tracked = snapshot_tracks(command.text);
+    bool journal = tracked;
+    uint32_t segment_length = 0;
+    if (tracked) {
+      segment_length = get_segment_length(command.text);
+      if (segment_length > segment_capacity) {
+        segment_capacity = 2 * segment_length;
+        segment = realloc(segment, segment_capacity);
+      }
+      memcpy(segment, command.text, segment_length);
+    }
+
+    if (shadowed && tracked) {
+      char* rbr_msg = get_batch_line(&message);
+      free(rbr_msg);
+      snapshot_record(&g_bar_manager.shadow, segment, segment_length);
+      command = get_token(&message);
+      continue;
+    }
+
     if (token_equals(command, DOMAIN_SET)) {
       struct token name = get_token(&message);
       uint32_t count = 0;
@@ -630,6 +859,7 @@ void handle_message_mach(struct mach_buffer* buffer) {
       if (!bar_items || count == 0) {
         char* rest = get_batch_line(&message);
         free(rest);
+        journal = false;
       } else {
         struct token token = get_token(&message);
         while (token.text && token.length > 0) {
@@ -642,6 +872,7 @@ void handle_message_mach(struct mach_buffer* buffer) {
               break;
             }
             bar_item_parse_set_message(bar_items[i], rbr_msg, rsp);
+            watch_list_mark(&g_bar_manager.watch_list, bar_items[i]);
             free(rbr_msg);
           }
           if (message && *message == '-') break;
@@ -663,8 +894,22 @@ void handle_message_mach(struct mach_buffer* buffer) {
         token = get_token(&message);
       }
     } else if (token_equals(command, DOMAIN_ANIMATE)) {
-      g_bar_manager.animator.interp_function = get_token(&message).text[0];
+      struct token curve = get_token(&message);
+      if (!animator_set_curve(&g_bar_manager.animator, curve.text)) {
+        respond(rsp, "[!] Animate: Invalid curve '%s'\n", curve.text);
+      }
       g_bar_manager.animator.duration = token_to_uint32t(get_token(&message));
+
+      g_bar_manager.animator.delay = 0;
+      g_bar_manager.animator.repeat = 0;
+      g_bar_manager.animator.yoyo = false;
+      while (message && *message && *message != '-') {
+        struct token option = get_token(&message);
+        if (!animator_set_timeline_option(&g_bar_manager.animator,
+                                          option.text             )) {
+          respond(rsp, "[!] Animate: Invalid option '%s'\n", option.text);
+        }
+      }
     } else if (token_equals(command, DOMAIN_BAR)) {
       struct token token = get_token(&message);
       while (token.text && token.length > 0) {
@@ -673,22 +918,33 @@ void handle_message_mach(struct mach_buffer* buffer) {
           respond(rsp, "[!] Bar: Expected <key>=<value> pair, but got: '%s'\n", token.text);
           break;
         }
+        animator_set_property(&g_bar_manager.animator, rbr_msg);
         bar_needs_refresh |= handle_domain_bar(rsp, command, rbr_msg);
+        animator_set_property(&g_bar_manager.animator, NULL);
         free(rbr_msg);
         if (message && *message == '-') break;
         token = get_token(&message);
       }
     } else if (token_equals(command, DOMAIN_ADD)) {
       char* rbr_msg = get_batch_line(&message);
-      handle_domain_add(rsp, command, rbr_msg);
+      char* cursor = rbr_msg;
+      struct token type = get_token(&cursor);
+      struct token name = get_token(&cursor);
+      if (token_equals(type, COMMAND_ADD_EVENT)
+          || !claim_restored_item(name, segment, segment_length)) {
+        journal = handle_domain_add(rsp, command, rbr_msg);
+      }
       free(rbr_msg);
     } else if (token_equals(command, DOMAIN_CLONE)) {
       char* rbr_msg = get_batch_line(&message);
-      handle_domain_clone(rsp, command, rbr_msg);
+      char* cursor = rbr_msg;
+      struct token name = get_token(&cursor);
+      if (!claim_restored_item(name, segment, segment_length))
+        journal = handle_domain_clone(rsp, command, rbr_msg);
       free(rbr_msg);
     } else if (token_equals(command, DOMAIN_SUBSCRIBE)) {
       char* rbr_msg = get_batch_line(&message);
-      handle_domain_subscribe(rsp, command, rbr_msg);
+      journal = handle_domain_subscribe(rsp, command, rbr_msg);
       free(rbr_msg);
     } else if (token_equals(command, DOMAIN_PUSH)) {
       char* rbr_msg = get_batch_line(&message);
@@ -703,31 +959,90 @@ void handle_message_mach(struct mach_buffer* buffer) {
       free(rbr_msg);
     } else if (token_equals(command, DOMAIN_QUERY)) {
       char* rbr_msg = get_batch_line(&message);
-      handle_domain_query(rsp, command, rbr_msg);
+      char* fields = NULL;
+      char* where = NULL;
+      while (message && *message == '-') {
+        char* cursor = message;
+        struct token option = get_token(&cursor);
+        if (token_equals(option, COMMAND_QUERY_FIELDS)) {
+          fields = get_token(&cursor).text;
+        } else if (token_equals(option, COMMAND_QUERY_WHERE)) {
+          where = get_token(&cursor).text;
+        } else {
+          break;
+        }
+        message = cursor;
+      }
+
+      handle_domain_query(rsp, command, rbr_msg, fields, where);
+      free(rbr_msg);
+    } else if (token_equals(command, DOMAIN_WATCH)) {
+      char* rbr_msg = get_batch_line(&message);
+      char* fields = NULL;
+      if (message && *message == '-') {
+        char* cursor = message;
+        struct token option = get_token(&cursor);
+        if (token_equals(option, COMMAND_QUERY_FIELDS)) {
+          fields = get_token(&cursor).text;
+          message = cursor;
+        }
+      }
+
+      watch_list_add(&g_bar_manager.watch_list,
+                     port,
+                     rbr_msg,
+                     fields,
+                     g_bar_manager.bar_items,
+                     g_bar_manager.bar_item_count,
+                     rsp                          );
+      free(rbr_msg);
+    } else if (token_equals(command, DOMAIN_SNAPSHOT)) {
+      char* rbr_msg = get_batch_line(&message);
+      handle_domain_snapshot(rsp, command, rbr_msg);
       free(rbr_msg);
+    } else if (token_equals(command, DOMAIN_LOAD)) {
+      struct token path = get_token(&message);
+      if (!path.text || path.length == 0) {
+        respond(rsp, "[!] Load: Missing path\n");
+      } else if (g_message_depth > BATCH_MAX_DEPTH) {
+        respond(rsp, "[!] Load: '%s' nested deeper than %d batches\n",
+                     path.text,
+                     BATCH_MAX_DEPTH                                 );
+      } else {
+        // The rest of this message animates with its own settings
+        struct animator_settings settings;
+        animator_save_settings(&g_bar_manager.animator, &settings);
+        handle_batch_file(path.text, origin, rsp);
+        animator_restore_settings(&g_bar_manager.animator, &settings);
+      }
     } else if (token_equals(command, DOMAIN_REORDER)) {
       char* rbr_msg = get_batch_line(&message);
       handle_domain_order(rsp, command, rbr_msg);
       free(rbr_msg);
     } else if (token_equals(command, DOMAIN_MOVE)) {
       char* rbr_msg = get_batch_line(&message);
-      handle_domain_move(rsp, command, rbr_msg);
+      journal = handle_domain_move(rsp, command, rbr_msg);
       free(rbr_msg);
     } else if (token_equals(command, DOMAIN_REMOVE)) {
       char* rbr_msg = get_batch_line(&message);
-      handle_domain_remove(rsp, command, rbr_msg);
+      journal = handle_domain_remove(rsp, command, rbr_msg);
       bar_needs_refresh = true;
       free(rbr_msg);
     } else if (token_equals(command, DOMAIN_RENAME)) {
       char* rbr_msg = get_batch_line(&message);
-      handle_domain_rename(rsp, command, rbr_msg);
+      journal = handle_domain_rename(rsp, command, rbr_msg);
       free(rbr_msg);
     } else if (token_equals(command, DOMAIN_EXIT)) {
+      if (getenv(STARTUP_REPORT_ENV)) startup_report(&g_startup, stdout);
       bar_manager_destroy(&g_bar_manager);
       exit(0);
     } else if (token_equals(command, DOMAIN_HOTLOAD)) {
       struct token token = get_token(&message);
-      hotload_set_state(evaluate_boolean_state(token, hotload_get_state()));
+      if (token_equals(token, ARGUMENT_HOTLOAD_RECONCILE)) {
+        hotload_set_state(HOTLOAD_STATE_RECONCILE);
+      } else {
+        hotload_set_state(evaluate_boolean_state(token, hotload_get_state()));
+      }
     } else if (token_equals(command, DOMAIN_ADD_FONT)) {
       struct token token = get_token(&message);
       font_register(token_to_string(token));
@@ -753,8 +1068,12 @@ void handle_message_mach(struct mach_buffer* buffer) {
       respond(rsp, "[!] Unknown domain '%s'\n", command.text);
       free(rbr_msg);
     }
+
+    // Failed commands are not journaled, they would fail on replay as well
+    if (journal) journal_command(segment, segment_length, configured);
     command = get_token(&message);
   }
+  if (segment) free(segment);
 
   if (bar_needs_refresh) {
     if (g_bar_manager.bar_needs_resize) bar_manager_resize(&g_bar_manager);
@@ -762,9 +1081,89 @@ void handle_message_mach(struct mach_buffer* buffer) {
     g_bar_manager.bar_needs_update = true;
   }
 
-  animator_lock(&g_bar_manager.animator);
+  // Animations of nested batches are locked with the message loading them,
+  // such that its remaining commands still update its own animations
+  if (--g_message_depth == 0) animator_lock(&g_bar_manager.animator);
   bar_manager_unfreeze(&g_bar_manager);
   bar_manager_refresh(&g_bar_manager, false, false);
+}
+
+// Replays a saved snapshot through the regular handlers
+bool handle_snapshot_file(char* path, FILE* rsp) {
+  char* batch = snapshot_read(path, NULL);
+  if (!batch) return false;
+
+  handle_message(batch, MACH_PORT_NULL, rsp);
+  free(batch);
+  return true;
+}
+
+// Applies a declarative or compiled config as one batch, without a round
+// trip per command. The batch is tagged with the origin (a config run) of
+// the message loading it, if any.
+bool handle_batch_file(char* path, uint32_t origin, FILE* rsp) {
+  uint32_t error_line;
+  char* batch = batch_read(path, &error_line);
+  if (!batch) {
+    if (error_line) {
+      respond(rsp, "[!] Load: Syntax error in '%s' on line %u\n", path,
+                                                                 error_line);
+    } else respond(rsp, "[!] Load: Could not read '%s'\n", path);
+    return false;
+  }
+
+  if (origin) {
+    char tag[32];
+    uint32_t tag_length = snprintf(tag, sizeof(tag), "%s%c%u", DOMAIN_ORIGIN,
+                                                               '\0',
+                                                               origin        )
+                          + 1;
+
+    uint32_t length = 0;
+    while (batch[length] || batch[length + 1]) length++;
+    char* tagged = malloc(tag_length + length + 2);
+    memcpy(tagged, tag, tag_length);
+    memcpy(tagged + tag_length, batch, length + 2);
+    free(batch);
+    batch = tagged;
+  }
+
+  handle_message(batch, MACH_PORT_NULL, rsp);
+  free(batch);
+  return true;
+}
+
+// Restores the last state as provisional items and the journal of the config
+// that produced it. Returns true if the next config run has to be reconciled
+// against it, such that items the config no longer adds are removed again.
+bool restore_snapshot(void) {
+  char path[4096];
+  snapshot_default_path(path, sizeof(path));
+  if (!file_exists(path)) return false;
+
+  char* batch = snapshot_read(path, &g_bar_manager.config);
+  if (!batch) {
+    printf("snapshot '%s' is invalid or outdated..\n", path);
+    return false;
+  }
+
+  g_bar_manager.restoring = true;
+  handle_message(batch, MACH_PORT_NULL, NULL);
+  g_bar_manager.restoring = false;
+  free(batch);
+  return true;
+}
+
+void handle_message_mach(struct mach_buffer* buffer) {
+  if (!buffer->message.descriptor.address) return;
+  char* response = NULL;
+  size_t length = 0;
+  FILE* rsp = open_memstream(&response, &length);
+  fprintf(rsp, "");
+
+  handle_message(buffer->message.descriptor.address,
+                 buffer->message.header.msgh_remote_port,
+                 rsp                                     );
 
   if (rsp) fclose(rsp);
 
@@ -15,4 +15,8 @@
 
 
 MACH_HANDLER(mach_message_handler);
+void handle_message(char* message, mach_port_t port, FILE* rsp);
 void handle_message_mach(struct mach_buffer* buffer);
+bool handle_snapshot_file(char* path, FILE* rsp);
+bool restore_snapshot(void);
+bool handle_batch_file(char* path, uint32_t origin, FILE* rsp);
@@ -31,6 +31,8 @@
 #define DOMAIN_EXIT                            "--exit"
 
 #define DOMAIN_HOTLOAD                         "--hotload"
+#define ARGUMENT_HOTLOAD_RECONCILE             "reconcile"
+#define DOMAIN_ORIGIN                          "--origin"
 #define DOMAIN_RELOAD                          "--reload"
 #define DOMAIN_ADD_FONT                        "--load-font"
 
@@ -70,6 +72,9 @@
 #define PROPERTY_CORNER_RADIUS                 "corner_radius"
 #define PROPERTY_FILL_COLOR                    "fill_color"
 #define PROPERTY_LINE_WIDTH                    "line_width"
+#define PROPERTY_SAMPLES                       "samples"
+#define PROPERTY_SERIES                        "series"
+#define PROPERTY_AUTOSCALE                     "autoscale"
 #define PROPERTY_BLUR_RADIUS                   "blur_radius"
 #define PROPERTY_DRAWING                       "drawing"
 #define PROPERTY_CLIP                          "clip"
@@ -126,6 +131,8 @@
 #define PROPERTY_SHOW_IN_FULLSCREEN            "show_in_fullscreen"
 #define PROPERTY_HIDDEN                        "hidden"
 #define PROPERTY_FONT_SMOOTHING                "font_smoothing"
+#define PROPERTY_ANIMATION_FPS                 "animation_fps"
+#define PROPERTY_ANIMATION_CLOCK               "animation_clock"
 #define PROPERTY_SHADOW                        "shadow"
 #define PROPERTY_ALIGN                         "align"
 #define PROPERTY_NOTCH_WIDTH                   "notch_width"
@@ -160,6 +167,20 @@
 #define COMMAND_QUERY_BAR                      "bar"
 #define COMMAND_QUERY_EVENTS                   "events"
 #define COMMAND_QUERY_DISPLAYS                 "displays"
+#define COMMAND_QUERY_CACHES                   "caches"
+#define COMMAND_QUERY_ANIMATIONS               "animations"
+#define COMMAND_QUERY_ITEMS                    "items"
+#define COMMAND_QUERY_STARTUP                  "startup"
+#define COMMAND_QUERY_FIELDS                   "--fields"
+#define COMMAND_QUERY_WHERE                    "--where"
+
+#define DOMAIN_WATCH                           "--watch"
+
+#define DOMAIN_SNAPSHOT                        "--snapshot"
+#define COMMAND_SNAPSHOT_SAVE                  "save"
+#define COMMAND_SNAPSHOT_LOAD                  "load"
+
+#define DOMAIN_LOAD                            "--load"
 
 #define ARGUMENT_COMMON_VAL_ON                 "on"
 #define ARGUMENT_COMMON_VAL_NOT_OFF            "!off"
@@ -188,6 +209,11 @@
 #define ARGUMENT_DYNAMIC                       "dynamic"
 
 #define ARGUMENT_WINDOW                        "window"
+#define ARGUMENT_ANIMATION_CLOCK_DISPLAY       "display"
+#define ARGUMENT_ANIMATION_DELAY               "delay"
+#define ARGUMENT_ANIMATION_REPEAT              "repeat"
+#define ARGUMENT_ANIMATION_YOYO                "yoyo"
+#define ARGUMENT_ANIMATION_FOREVER             "forever"
 
 #define POSITION_TOP          't'
 #define POSITION_BOTTOM       'b'
@@ -27,6 +27,8 @@ static const char help_str[] = {
   "                                  \tAdd graph component\n"
   "      --push <name> <data point> ... <data point>\n"
   "                                  \tPush data points to a graph\n"
+  "      --push <name> s0:<point>,<point> s1:<point> ...\n"
+  "                                  \tPush data points to graph series\n"
   "      --add space <name> <position>\tAdd space component\n"
   "      --add bracket <name> <member name> ... <member name>\n"
   "                                  \tAdd bracket component\n"
@@ -46,13 +48,39 @@ static const char help_str[] = {
   "      --query <name>            \tQuery item properties\n"
   "      --query defaults          \tQuery default properties\n"
   "      --query events            \tQuery events\n"
-  "      --query default_menu_items\tQuery names of available items for aliases\n\n"
+  "      --query default_menu_items\tQuery names of available items for aliases\n"
+  "      --query caches            \tQuery render cache statistics\n"
+  "      --query animations        \tQuery animations and animator statistics\n"
+  "      --query items             \tQuery the properties of all items\n"
+  "      --query startup           \tQuery the duration of the startup phases\n"
+  "      --query ... [optional: --fields <path>,...,<path>]\n"
+  "                  [optional: --where <path>=<value>,...,<path>=<value>]\n"
+  "                                \tOnly serialize the given fields (e.g. label.value),\n"
+  "                                \tonly list items matching all conditions\n\n"
+  "Watching for changes\n"
+  "      --watch [optional: <name> ... <name>] [optional: --fields <path>,...,<path>]\n"
+  "                                \tPrint the state of the given (or all) items and\n"
+  "                                \tone line per changed item on every frame\n\n"
   "Animations, see https://felixkratz.github.io/SketchyBar/config/animations\n"
-  "      --animate <linear|quadratic|tanh|sin|exp|circ> <duration> \\\n"
+  "      --animate <linear|quadratic|tanh|sin|exp|circ|bounce|overshoot> <duration> \\\n"
+  "      --animate <cubic_bezier(x1,y1,x2,y2)|spring(stiffness,damping)> <duration> \\\n"
+  "                [optional: delay=<duration> repeat=<count|forever> yoyo=<boolean>] \\\n"
   "                --bar <property=value> ... <property=value>\\\n"
   "                --set <name> <property=value> ... <property=value>\n"
-  "                         \tAnimate from given source to target property values\n\n"
+  "                         \tAnimate from given source to target property values,\n"
+  "                         \trepeated values of a property form a keyframe timeline\n\n"
   "Reloading the config\n"
-  "      --hotload <boolean>        \tEnable or disable the config hotloader\n"
-  "      --reload [optional: <path>]\tReload the current or the given config\n\n"
+  "      --hotload <boolean|reconcile>\n"
+  "                                 \tEnable or disable the config hotloader, in\n"
+  "                                 \treconcile mode only changes are applied\n"
+  "      --reload [optional: <path>]\tReload the current or the given config\n"
+  "      --snapshot save [optional: <path>]\n"
+  "                                 \tSave the current items, bar and defaults\n"
+  "      --snapshot load [optional: <path>]\n"
+  "                                 \tRestore a saved state, the default snapshot\n"
+  "                                 \tis restored before the config runs and items\n"
+  "                                 \tthe config no longer adds are removed\n"
+  "      --load <path>              \tApply a declarative (.batch) or compiled\n"
+  "                                 \tconfig in a single batch, configs ending\n"
+  "                                 \tin .batch are loaded this way on startup\n\n"
 };
@@ -6,6 +6,7 @@
 #include <sys/stat.h>
 #include <time.h>
 #include "env_vars.h"
+#include "tokens.h"
 #include "defines.h"
 #include "extern.h"
 
@@ -29,11 +30,6 @@ static CGPoint g_nirvana = {-9999, -9999};
 
 static double deg_to_rad = 2.* M_PI / 360.;
 
-struct token {
-  char *text;
-  unsigned int length;
-};
-
 struct notification {
   char* name;
   char* info;
@@ -58,31 +54,6 @@ static inline void notification_destroy(struct notification* notification) {
   free(notification);
 }
 
-static inline double function_linear(double x) {
-  return x;
-}
-
-static inline double function_square(double x) {
-  return x*x;
-}
-
-static inline double function_tanh(double x) {
-  double a = 0.52;
-  return a * tanh(2. * atanh(1. / (2. * a)) * (x  - 0.5)) + 0.5;
-}
-
-static inline double function_sin(double x) {
-  return sin(M_PI / 2. * x);
-}
-
-static inline double function_exp(double x) {
-  return x*exp(x - 1.);
-}
-
-static inline double function_circ(double x) {
-    return sqrt(1.f - powf(x - 1.f, 2.f));
-}
-
 static inline char* format_bool(bool b) {
   return b ? "on" : "off";
 }
@@ -124,7 +95,7 @@ static inline void respond(FILE* rsp, char* response, ...) {
   va_list args_stdout;
   va_start(args_rsp, response);
   va_copy(args_stdout, args_rsp);
-  vfprintf(rsp, response, args_rsp);
+  if (rsp) vfprintf(rsp, response, args_rsp);
   vfprintf(stdout, response, args_stdout);
   va_end(args_rsp);
   va_end(args_stdout);
@@ -169,10 +140,6 @@ static inline bool is_root(void) {
   return getuid() == 0 || geteuid() == 0;
 }
 
-static inline bool string_equals(const char *a, const char *b) {
-  return a && b && strcmp(a, b) == 0;
-}
-
 static inline char* get_type_description(uint32_t type) {
   switch (type) {
     case kCGEventLeftMouseUp:
@@ -224,64 +191,6 @@ static inline char** token_split(struct token token, char split, uint32_t* count
   return list;
 }
 
-static inline bool token_equals(struct token token, char *match) {
-  char *at = match;
-  for (int i = 0; i < token.length; ++i, ++at) {
-    if ((*at == 0) || (token.text[i] != *at)) {
-      return false;
-    }
-  }
-  return *at == 0;
-}
-
-static inline char *token_to_string(struct token token) {
-  char *result = malloc(token.length + 1);
-  if (!result) return NULL;
-
-  memcpy(result, token.text, token.length);
-  result[token.length] = '\0';
-  return result;
-}
-
-static inline uint32_t token_to_uint32t(struct token token) {
-  char buffer[token.length + 1];
-  memcpy(buffer, token.text, token.length);
-  buffer[token.length] = '\0';
-  return strtoul(buffer, NULL, 0);
-}
-
-static inline int token_to_int(struct token token) {
-  char buffer[token.length + 1];
-  memcpy(buffer, token.text, token.length);
-  buffer[token.length] = '\0';
-  return (int) strtol(buffer, NULL, 0);
-}
-
-static inline float token_to_float(struct token token) {
-  char buffer[token.length + 1];
-  memcpy(buffer, token.text, token.length);
-  buffer[token.length] = '\0';
-  return strtof(buffer, NULL);
-}
-
-static inline struct token get_token(char **message) {
-  struct token token;
-
-  token.text = *message;
-  while (**message) {
-    ++(*message);
-  }
-  token.length = *message - token.text;
-
-  if ((*message)[0] == '\0' && (*message)[1] != '\0') {
-    ++(*message);
-  } else {
-    // NOTE(koekeishiya): don't go past the null-terminator
-  }
-
-  return token;
-}
-
 static inline bool evaluate_boolean_state(struct token state, bool previous_state) {
   if (token_equals(state, ARGUMENT_COMMON_VAL_ON)
       || token_equals(state, ARGUMENT_COMMON_VAL_YES)
@@ -362,17 +271,59 @@ static inline void add_rounded_rect_path(CGMutablePathRef path, CGRect rect,
   CGPathCloseSubpath(path);
 }
 
-static inline void clip_rect(CGContextRef context, CGRect region, float clip, struct corner_radii* corner_radii) {
+static inline CGPathRef rounded_rect_path_create(CGRect rect, struct corner_radii* corner_radii) {
   CGMutablePathRef path = CGPathCreateMutable();
-  add_rounded_rect_path(path, region,
+  add_rounded_rect_path(path, rect,
                        corner_radii->top_left, corner_radii->top_right,
                        corner_radii->bottom_left, corner_radii->bottom_right);
+  return path;
+}
+
+// Rounded rect path which is kept around as long as its rect and radii do not
+// change. Only rounded_rect_path_update modifies the cache and it must be
+// called from the main thread, render threads use rounded_rect_path_get.
+struct rounded_rect_path {
+  CGPathRef path;
+  CGRect rect;
+  struct corner_radii corner_radii;
+};
+
+static inline bool rounded_rect_path_matches(struct rounded_rect_path* cache, CGRect rect, struct corner_radii* corner_radii) {
+  return cache->path
+         && CGRectEqualToRect(cache->rect, rect)
+         && memcmp(&cache->corner_radii,
+                   corner_radii,
+                   sizeof(struct corner_radii)) == 0;
+}
+
+static inline void rounded_rect_path_update(struct rounded_rect_path* cache, CGRect rect, struct corner_radii* corner_radii) {
+  if (rounded_rect_path_matches(cache, rect, corner_radii)) return;
+  if (cache->path) CGPathRelease(cache->path);
+  cache->path = rounded_rect_path_create(rect, corner_radii);
+  cache->rect = rect;
+  cache->corner_radii = *corner_radii;
+}
+
+// Returns a path which has to be released with CGPathRelease.
+static inline CGPathRef rounded_rect_path_get(struct rounded_rect_path* cache, CGRect rect, struct corner_radii* corner_radii) {
+  if (rounded_rect_path_matches(cache, rect, corner_radii))
+    return CGPathRetain(cache->path);
+  return rounded_rect_path_create(rect, corner_radii);
+}
+
+static inline void rounded_rect_path_destroy(struct rounded_rect_path* cache) {
+  if (cache->path) CGPathRelease(cache->path);
+  cache->path = NULL;
+}
+
+// Main thread only, the path of the clipped region is kept in the cache.
+static inline void clip_rect(CGContextRef context, struct rounded_rect_path* cache, CGRect region, float clip, struct corner_radii* corner_radii) {
+  rounded_rect_path_update(cache, region, corner_radii);
   CGContextSetBlendMode(context, kCGBlendModeDestinationOut);
   CGContextSetRGBFillColor(context, 0.f, 0.f, 0.f, clip);
-  CGContextAddPath(context, path);
+  CGContextAddPath(context, cache->path);
   CGContextDrawPath(context, kCGPathFillStroke);
   CGContextSetBlendMode(context, kCGBlendModeNormal);
-  CFRelease(path);
 }
 
 static inline CGRect cgrect_mirror_y(CGRect rect, float y) {
@@ -381,6 +332,13 @@ static inline CGRect cgrect_mirror_y(CGRect rect, float y) {
   return mirrored_rect;
 }
 
+static inline uint64_t hash_rect(uint64_t hash, CGRect rect) {
+  hash = hash_float(hash, rect.origin.x);
+  hash = hash_float(hash, rect.origin.y);
+  hash = hash_float(hash, rect.size.width);
+  return hash_float(hash, rect.size.height);
+}
+
 static inline bool cgrect_contains_point(CGRect* r, CGPoint* p) {
   return p->x >= r->origin.x && p->x <= r->origin.x + r->size.width &&
          p->y >= r->origin.y && p->y <= r->origin.y + r->size.height;
@@ -440,16 +398,6 @@ static inline char *cfstring_copy(CFStringRef string) {
   return result;
 }
 
-static inline char *string_copy(char *s) {
-  int length = strlen(s);
-  char *result = malloc(length + 1);
-  if (!result) return NULL;
-
-  memcpy(result, s, length);
-  result[length] = '\0';
-  return result;
-}
-
 static inline char* read_file(char* path) {
   int fd = open(path, O_RDONLY);
   int len = lseek(fd, 0, SEEK_END);
@@ -513,14 +461,17 @@ static inline bool sync_exec(char *command, struct env_vars *env_vars) {
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
-static inline bool fork_exec(char *command, struct env_vars* env_vars) {
+static inline pid_t fork_exec_pid(char *command, struct env_vars* env_vars) {
   int pid = vfork();
-  if (pid == -1) return false;
-  if (pid !=  0) return true;
+  if (pid != 0) return pid;
 
   alarm(FORK_TIMEOUT);
   exit(sync_exec(command, env_vars));
 }
+
+static inline bool fork_exec(char *command, struct env_vars* env_vars) {
+  return fork_exec_pid(command, env_vars) != -1;
+}
 #pragma clang diagnostic pop
 
 static inline int mission_control_index(uint64_t sid) {
@@ -0,0 +1,96 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Message tokens, string and hash helpers. These have no framework
+// dependencies, such that units built for tests and benchmarks can use
+// them without helpers.h.
+
+struct token {
+  char *text;
+  unsigned int length;
+};
+
+static inline bool string_equals(const char *a, const char *b) {
+  return a && b && strcmp(a, b) == 0;
+}
+
+static inline bool token_equals(struct token token, char *match) {
+  char *at = match;
+  for (int i = 0; i < token.length; ++i, ++at) {
+    if ((*at == 0) || (token.text[i] != *at)) {
+      return false;
+    }
+  }
+  return *at == 0;
+}
+
+static inline char *token_to_string(struct token token) {
+  char *result = malloc(token.length + 1);
+  if (!result) return NULL;
+
+  memcpy(result, token.text, token.length);
+  result[token.length] = '\0';
+  return result;
+}
+
+static inline uint32_t token_to_uint32t(struct token token) {
+  char buffer[token.length + 1];
+  memcpy(buffer, token.text, token.length);
+  buffer[token.length] = '\0';
+  return strtoul(buffer, NULL, 0);
+}
+
+static inline int token_to_int(struct token token) {
+  char buffer[token.length + 1];
+  memcpy(buffer, token.text, token.length);
+  buffer[token.length] = '\0';
+  return (int) strtol(buffer, NULL, 0);
+}
+
+static inline float token_to_float(struct token token) {
+  char buffer[token.length + 1];
+  memcpy(buffer, token.text, token.length);
+  buffer[token.length] = '\0';
+  return strtof(buffer, NULL);
+}
+
+static inline struct token get_token(char **message) {
+  struct token token;
+
+  token.text = *message;
+  while (**message) {
+    ++(*message);
+  }
+  token.length = *message - token.text;
+
+  if ((*message)[0] == '\0' && (*message)[1] != '\0') {
+    ++(*message);
+  } else {
+    // NOTE(koekeishiya): don't go past the null-terminator
+  }
+
+  return token;
+}
+
+static inline uint64_t hash_combine(uint64_t hash, uint64_t value) {
+  return (hash ^ value) * 0x100000001b3ULL;
+}
+
+static inline uint64_t hash_float(uint64_t hash, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(uint64_t));
+  return hash_combine(hash, bits);
+}
+
+static inline char *string_copy(char *s) {
+  int length = strlen(s);
+  char *result = malloc(length + 1);
+  if (!result) return NULL;
+
+  memcpy(result, s, length);
+  result[length] = '\0';
+  return result;
+}
@@ -321,6 +321,11 @@ void popup_clear_pointers(struct popup* popup) {
   popup->items = NULL;
   popup->num_items = 0;
   popup->host = NULL;
+  popup->background.shape.path = NULL;
+  gradient_clear_pointers(&popup->background.gradient);
+
+  // The copied layer is owned by the window of the ancestor
+  popup->window.layer = NULL;
   window_clear(&popup->window);
 }
 
@@ -345,6 +350,7 @@ void popup_draw(struct popup* popup) {
 
   window_assign_mouse_tracking_area(&popup->window, popup->window.frame);
 
+  background_prepare(&popup->background);
   bool shadow = popup->background.shadow.enabled;
   popup->background.shadow.enabled = false;
   background_draw(&popup->background, popup->window.context);
@@ -379,7 +385,7 @@ void popup_destroy(struct popup* popup) {
   popup_close_window(popup);
 }
 
-void popup_serialize(struct popup* popup, char* indent, FILE* rsp) {
+void popup_serialize(struct popup* popup, struct json* json) {
   char align[32] = { 0 };
   switch (popup->align) {
     case POSITION_LEFT:
@@ -402,30 +408,22 @@ void popup_serialize(struct popup* popup, char* indent, FILE* rsp) {
       break;
   }
 
-  fprintf(rsp, "%s\"drawing\": \"%s\",\n"
-               "%s\"horizontal\": \"%s\",\n"
-               "%s\"height\": %d,\n"
-               "%s\"blur_radius\": %u,\n"
-               "%s\"y_offset\": %d,\n"
-               "%s\"align\": \"%s\",\n"
-               "%s\"background\": {\n",
-               indent, format_bool(popup->drawing),
-               indent, format_bool(popup->horizontal),
-               indent, popup->overrides_cell_size ? popup->cell_size : -1,
-               indent, popup->blur_radius,
-               indent, popup->y_offset,
-               indent, align, indent                                      );
-
-  char deeper_indent[strlen(indent) + 2];
-  snprintf(deeper_indent, strlen(indent) + 2, "%s\t", indent);
-  background_serialize(&popup->background, deeper_indent, rsp, true);
-
-  fprintf(rsp, "\n%s},\n%s\"items\": [\n", indent, indent);
+  json_string(json, "drawing", format_bool(popup->drawing));
+  json_string(json, "horizontal", format_bool(popup->horizontal));
+  json_int(json, "height", popup->overrides_cell_size ? popup->cell_size : -1);
+  json_uint(json, "blur_radius", popup->blur_radius);
+  json_int(json, "y_offset", popup->y_offset);
+  json_string(json, "align", align);
+
+  json_object_begin(json, "background");
+  background_serialize(&popup->background, json, true);
+  json_object_end(json);
+
+  json_array_begin(json, "items");
   for (int i = 0; i < popup->num_items; i++) {
-    fprintf(rsp, "%s\t \"%s\"", indent, popup->items[i]->name);
-    if (i < popup->num_items - 1) fprintf(rsp, ",\n");
+    json_string(json, NULL, popup->items[i]->name);
   }
-  fprintf(rsp, "\n%s]", indent);
+  json_array_end(json);
 }
 
 static bool popup_set_yoffset(struct popup* popup, int y_offset) {
@@ -45,5 +45,5 @@ void popup_draw(struct popup* popup);
 void popup_destroy(struct popup* popup);
 
 void popup_change_space(struct popup* popup, uint64_t dsid, uint32_t adid);
-void popup_serialize(struct popup* popup, char* indent, FILE* rsp);
+void popup_serialize(struct popup* popup, struct json* json);
 bool popup_parse_sub_domain(struct popup* popup, FILE* rsp, struct token property, char* message);
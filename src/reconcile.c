@@ -0,0 +1,471 @@
+#include "reconcile.h"
+#include "misc/defines.h"
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The diff operates on journals only and does not touch any live state,
+// such that it can be exercised without a running bar.
+
+#define RECONCILE_ITEM    0
+#define RECONCILE_BAR     1
+#define RECONCILE_PATTERN 2
+
+struct reconcile_buffer {
+  char* data;
+  uint32_t length;
+  uint32_t capacity;
+};
+
+// An item as described by a journal: everything that has to be recreated
+// when it changes is folded into the definition, properties can be set on
+// the live item directly.
+struct reconcile_item {
+  char kind;
+  char* name;
+  char* type;
+  char* position;
+  bool removed;
+
+  struct reconcile_buffer definition;
+  struct snapshot_record** properties;
+  uint32_t property_count;
+
+  bool emit;
+  bool exists;
+};
+
+struct reconcile_model {
+  struct reconcile_item* items;
+  uint32_t item_count;
+
+  struct reconcile_buffer defaults;
+  struct snapshot_record* reorder;
+
+  // Item each record belongs to, -1 for global records
+  int* owners;
+  bool unsupported;
+};
+
+static void reconcile_buffer_append(struct reconcile_buffer* buffer, char* data, uint32_t length) {
+  if (length == 0) return;
+  if (buffer->length + length > buffer->capacity) {
+    buffer->capacity = (buffer->length + length) * 2;
+    buffer->data = realloc(buffer->data, buffer->capacity);
+  }
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+}
+
+static bool reconcile_buffer_equals(struct reconcile_buffer* a, struct reconcile_buffer* b) {
+  return a->length == b->length
+         && (a->length == 0 || memcmp(a->data, b->data, a->length) == 0);
+}
+
+// Returns the token at the given index of a record, NULL if it has fewer
+static char* reconcile_token(struct snapshot_record* record, uint32_t index) {
+  uint32_t offset = 0;
+  for (uint32_t i = 0; i < index; i++) {
+    offset += strlen(record->message + offset) + 1;
+    if (offset >= record->length) return NULL;
+  }
+  return record->message + offset;
+}
+
+static bool reconcile_is(struct snapshot_record* record, char* command) {
+  return strcmp(record->message, command) == 0;
+}
+
+static bool reconcile_is_pattern(char* name) {
+  uint32_t length = strlen(name);
+  return length > 1 && name[0] == REGEX_DELIMITER
+                    && name[length - 1] == REGEX_DELIMITER;
+}
+
+static bool reconcile_names_equal(char* a, char* b) {
+  if (!a || !b) return a == b;
+  return strcmp(a, b) == 0;
+}
+
+static int reconcile_find(struct reconcile_model* model, char kind, char* name) {
+  for (uint32_t i = 0; i < model->item_count; i++) {
+    struct reconcile_item* item = &model->items[i];
+    if (!item->removed && item->kind == kind
+        && reconcile_names_equal(item->name, name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int reconcile_add(struct reconcile_model* model, char kind, char* name) {
+  model->items = realloc(model->items, sizeof(struct reconcile_item)
+                                       * (model->item_count + 1));
+  struct reconcile_item* item = &model->items[model->item_count];
+  memset(item, 0, sizeof(struct reconcile_item));
+  item->kind = kind;
+  item->name = name;
+  return model->item_count++;
+}
+
+// Collects the live items matching the name, which is either an exact name
+// or a /regex/
+static uint32_t reconcile_match(struct reconcile_model* model, char* name, int* matches) {
+  if (!reconcile_is_pattern(name)) {
+    int index = reconcile_find(model, RECONCILE_ITEM, name);
+    if (index < 0) return 0;
+    matches[0] = index;
+    return 1;
+  }
+
+  uint32_t length = strlen(name);
+  char* expression = malloc(length - 1);
+  memcpy(expression, name + 1, length - 2);
+  expression[length - 2] = '\0';
+
+  regex_t regex;
+  uint32_t count = 0;
+  if (regcomp(&regex, expression, REG_EXTENDED) == 0) {
+    for (uint32_t i = 0; i < model->item_count; i++) {
+      struct reconcile_item* item = &model->items[i];
+      if (item->removed || item->kind != RECONCILE_ITEM) continue;
+      if (regexec(&regex, item->name, 0, NULL, 0) == 0) matches[count++] = i;
+    }
+    regfree(&regex);
+  }
+  free(expression);
+  return count;
+}
+
+static void reconcile_set_property(struct reconcile_item* item, struct snapshot_record* record) {
+  for (uint32_t i = 0; i < item->property_count; i++) {
+    if (strcmp(item->properties[i]->key, record->key) == 0) {
+      item->properties[i] = record;
+      return;
+    }
+  }
+
+  item->properties = realloc(item->properties,
+                             sizeof(struct snapshot_record*)
+                             * (item->property_count + 1));
+  item->properties[item->property_count++] = record;
+}
+
+static struct snapshot_record* reconcile_get_property(struct reconcile_item* item, char* key) {
+  for (uint32_t i = 0; i < item->property_count; i++) {
+    if (strcmp(item->properties[i]->key, key) == 0) return item->properties[i];
+  }
+  return NULL;
+}
+
+// The value is the last token, i.e. the <key>=<value> pair
+static char* reconcile_value(struct snapshot_record* record) {
+  char* value = record->message;
+  char* end = record->message + record->length;
+  char* token = value;
+  while (token < end) {
+    value = token;
+    token += strlen(token) + 1;
+  }
+  return value;
+}
+
+static void reconcile_model_build(struct reconcile_model* model, struct snapshot* snapshot) {
+  memset(model, 0, sizeof(struct reconcile_model));
+  model->owners = malloc(sizeof(int) * (snapshot->record_count + 1));
+  int* matches = NULL;
+
+  for (uint32_t i = 0; i < snapshot->record_count; i++) {
+    struct snapshot_record* record = &snapshot->records[i];
+    model->owners[i] = -1;
+    if (!record->message) continue;
+    if (record->key) {
+      char kind = !record->item ? RECONCILE_BAR
+                                : (reconcile_is_pattern(record->item)
+                                   ? RECONCILE_PATTERN
+                                   : RECONCILE_ITEM);
+
+      int index = reconcile_find(model, kind, record->item);
+      if (index < 0 && kind == RECONCILE_ITEM) continue;
+      if (index < 0) index = reconcile_add(model, kind, record->item);
+      reconcile_set_property(&model->items[index], record);
+      model->owners[i] = index;
+      continue;
+    }
+
+    char* first = reconcile_token(record, 1);
+    char* second = reconcile_token(record, 2);
+    if (reconcile_is(record, DOMAIN_DEFAULT)) {
+      reconcile_buffer_append(&model->defaults, record->message,
+                                                record->length  );
+    } else if (reconcile_is(record, DOMAIN_ADD)) {
+      if (!first || !second || strcmp(first, COMMAND_ADD_EVENT) == 0) {
+        continue;
+      }
+
+      int index = reconcile_add(model, RECONCILE_ITEM, second);
+      struct reconcile_item* item = &model->items[index];
+      item->type = first;
+      item->position = reconcile_token(record, 3);
+      reconcile_buffer_append(&item->definition, model->defaults.data,
+                                                 model->defaults.length);
+      reconcile_buffer_append(&item->definition, record->message,
+                                                 record->length );
+      model->owners[i] = index;
+    } else if (reconcile_is(record, DOMAIN_CLONE)) {
+      if (!first || !second) continue;
+      int parent = reconcile_find(model, RECONCILE_ITEM, second);
+      int index = reconcile_add(model, RECONCILE_ITEM, first);
+      struct reconcile_item* item = &model->items[index];
+      reconcile_buffer_append(&item->definition, record->message,
+                                                 record->length );
+
+      // A clone depends on everything its parent had at the time
+      if (parent >= 0) {
+        struct reconcile_item* ancestor = &model->items[parent];
+        item->type = ancestor->type;
+        item->position = ancestor->position;
+        reconcile_buffer_append(&item->definition, ancestor->definition.data,
+                                                   ancestor->definition.length);
+        for (uint32_t j = 0; j < ancestor->property_count; j++) {
+          reconcile_buffer_append(&item->definition,
+                                  ancestor->properties[j]->message,
+                                  ancestor->properties[j]->length  );
+        }
+      }
+      model->owners[i] = index;
+    } else if (reconcile_is(record, DOMAIN_SUBSCRIBE)
+               || reconcile_is(record, DOMAIN_MOVE)) {
+      if (!first) continue;
+      matches = realloc(matches, sizeof(int) * (model->item_count + 1));
+      uint32_t count = reconcile_match(model, first, matches);
+      for (uint32_t j = 0; j < count; j++) {
+        reconcile_buffer_append(&model->items[matches[j]].definition,
+                                record->message,
+                                record->length                      );
+      }
+      if (count == 1 && !reconcile_is_pattern(first)) {
+        model->owners[i] = matches[0];
+      } else if (count > 0) {
+        model->unsupported = true;
+      }
+    } else if (reconcile_is(record, DOMAIN_RENAME)) {
+      if (!first || !second) continue;
+      int index = reconcile_find(model, RECONCILE_ITEM, first);
+      if (index < 0) continue;
+      struct reconcile_item* item = &model->items[index];
+      item->name = second;
+      reconcile_buffer_append(&item->definition, record->message,
+                                                 record->length );
+      model->owners[i] = index;
+    } else if (reconcile_is(record, DOMAIN_REMOVE)) {
+      if (!first) continue;
+      matches = realloc(matches, sizeof(int) * (model->item_count + 1));
+      uint32_t count = reconcile_match(model, first, matches);
+      for (uint32_t j = 0; j < count; j++) model->items[matches[j]].removed = true;
+
+      if (count == 1 && !reconcile_is_pattern(first)) {
+        model->owners[i] = matches[0];
+      } else if (count > 0) {
+        model->unsupported = true;
+      }
+    } else if (reconcile_is(record, DOMAIN_REORDER)) {
+      model->reorder = record;
+    }
+  }
+
+  if (matches) free(matches);
+}
+
+static void reconcile_model_destroy(struct reconcile_model* model) {
+  for (uint32_t i = 0; i < model->item_count; i++) {
+    if (model->items[i].definition.data) free(model->items[i].definition.data);
+    if (model->items[i].properties) free(model->items[i].properties);
+  }
+  if (model->items) free(model->items);
+  if (model->defaults.data) free(model->defaults.data);
+  if (model->owners) free(model->owners);
+}
+
+static bool reconcile_contains(struct snapshot* snapshot, struct snapshot_record* record) {
+  for (uint32_t i = 0; i < snapshot->record_count; i++) {
+    struct snapshot_record* other = &snapshot->records[i];
+    if (other->message && other->length == record->length
+        && memcmp(other->message, record->message, record->length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Marks the target items which have to be (re)created on the live bar.
+// Returns false if the current state can not be reached by a delta.
+static bool reconcile_mark(struct reconcile_model* current, struct reconcile_model* target, struct reconcile_stats* stats) {
+  for (uint32_t i = 0; i < target->item_count; i++) {
+    struct reconcile_item* item = &target->items[i];
+    if (item->removed) continue;
+
+    int index = reconcile_find(current, item->kind, item->name);
+    if (index < 0) {
+      item->emit = item->kind == RECONCILE_ITEM;
+      if (item->emit) stats->added++;
+      continue;
+    }
+
+    struct reconcile_item* existing = &current->items[index];
+    existing->exists = true;
+    item->exists = true;
+    if (!reconcile_buffer_equals(&item->definition, &existing->definition)) {
+      item->emit = true;
+    }
+
+    // Properties can not be unset, the item is recreated without them
+    for (uint32_t j = 0; j < existing->property_count; j++) {
+      if (!reconcile_get_property(item, existing->properties[j]->key)) {
+        if (item->kind != RECONCILE_ITEM) return false;
+        item->emit = true;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < current->item_count; i++) {
+    struct reconcile_item* item = &current->items[i];
+    if (item->removed || item->exists) continue;
+    if (item->kind != RECONCILE_ITEM) return false;
+    stats->removed++;
+  }
+
+  // Popup children and brackets reference other items
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    bool any = stats->removed > 0;
+    for (uint32_t i = 0; i < target->item_count; i++) {
+      struct reconcile_item* item = &target->items[i];
+      if (!item->removed && item->emit) any = true;
+    }
+
+    for (uint32_t i = 0; i < target->item_count; i++) {
+      struct reconcile_item* item = &target->items[i];
+      if (item->removed || item->emit || item->kind != RECONCILE_ITEM) {
+        continue;
+      }
+
+      bool depends = item->type && strcmp(item->type, TYPE_GROUP) == 0
+                     && any;
+
+      if (!depends && item->position
+          && strncmp(item->position, SUB_DOMAIN_POPUP ".",
+                                     strlen(SUB_DOMAIN_POPUP) + 1) == 0) {
+        char* parent_name = item->position + strlen(SUB_DOMAIN_POPUP) + 1;
+        int parent = reconcile_find(target, RECONCILE_ITEM, parent_name);
+        depends = parent < 0 || target->items[parent].emit;
+      }
+
+      if (depends) {
+        item->emit = true;
+        changed = true;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < target->item_count; i++) {
+    struct reconcile_item* item = &target->items[i];
+    if (!item->removed && item->emit && item->exists) stats->recreated++;
+  }
+  return true;
+}
+
+// Returns a batch message which turns the state described by the current
+// journal into the one described by the target journal, NULL if this is
+// only possible by rebuilding the bar from scratch.
+char* reconcile_diff(struct snapshot* current, struct snapshot* target, struct reconcile_stats* stats) {
+  memset(stats, 0, sizeof(struct reconcile_stats));
+
+  struct reconcile_model current_model, target_model;
+  reconcile_model_build(&current_model, current);
+  reconcile_model_build(&target_model, target);
+
+  if (current_model.unsupported
+      || target_model.unsupported
+      || !reconcile_mark(&current_model, &target_model, stats)) {
+    reconcile_model_destroy(&current_model);
+    reconcile_model_destroy(&target_model);
+    return NULL;
+  }
+
+  struct reconcile_buffer batch = { 0 };
+  for (uint32_t i = 0; i < current_model.item_count; i++) {
+    struct reconcile_item* item = &current_model.items[i];
+    if (item->removed || item->kind != RECONCILE_ITEM) continue;
+
+    int index = reconcile_find(&target_model, RECONCILE_ITEM, item->name);
+    if (index < 0 || target_model.items[index].emit) {
+      reconcile_buffer_append(&batch, DOMAIN_REMOVE, strlen(DOMAIN_REMOVE) + 1);
+      reconcile_buffer_append(&batch, item->name, strlen(item->name) + 1);
+    }
+  }
+
+  // Items are created with the defaults valid at their position in the
+  // config, which requires replaying the defaults from a clean state
+  bool created = stats->added > 0 || stats->recreated > 0;
+  bool replay_defaults = created && target_model.defaults.length > 0;
+  replay_defaults |= !reconcile_buffer_equals(&current_model.defaults,
+                                              &target_model.defaults  );
+  if (replay_defaults) {
+    reconcile_buffer_append(&batch, DOMAIN_DEFAULT, strlen(DOMAIN_DEFAULT) + 1);
+    reconcile_buffer_append(&batch, COMMAND_DEFAULT_RESET,
+                                    strlen(COMMAND_DEFAULT_RESET) + 1);
+  }
+
+  for (uint32_t i = 0; i < target->record_count; i++) {
+    struct snapshot_record* record = &target->records[i];
+    int owner = target_model.owners[i];
+    bool emit = false;
+    if (!record->message) continue;
+
+    if (owner >= 0) {
+      struct reconcile_item* item = &target_model.items[owner];
+      if (item->emit || (item->kind == RECONCILE_PATTERN && created)) {
+        emit = true;
+      } else if (record->key) {
+        int index = reconcile_find(&current_model, item->kind, item->name);
+        struct snapshot_record* existing = index >= 0
+            ? reconcile_get_property(&current_model.items[index], record->key)
+            : NULL;
+
+        emit = !existing || strcmp(reconcile_value(existing),
+                                   reconcile_value(record)   ) != 0;
+        if (emit) stats->changed++;
+      }
+    } else if (reconcile_is(record, DOMAIN_DEFAULT)) {
+      emit = replay_defaults;
+    } else if (reconcile_is(record, DOMAIN_ADD)
+               || reconcile_is(record, DOMAIN_ADD_FONT)) {
+      emit = !reconcile_contains(current, record);
+    }
+
+    if (emit) reconcile_buffer_append(&batch, record->message, record->length);
+  }
+
+  // New items are appended, restore the order of the config
+  if (created) {
+    reconcile_buffer_append(&batch, DOMAIN_REORDER, strlen(DOMAIN_REORDER) + 1);
+    for (uint32_t i = 0; i < target_model.item_count; i++) {
+      struct reconcile_item* item = &target_model.items[i];
+      if (item->removed || item->kind != RECONCILE_ITEM) continue;
+      reconcile_buffer_append(&batch, item->name, strlen(item->name) + 1);
+    }
+  }
+
+  if (target_model.reorder
+      && (created || !reconcile_contains(current, target_model.reorder))) {
+    reconcile_buffer_append(&batch, target_model.reorder->message,
+                                    target_model.reorder->length  );
+  }
+
+  reconcile_buffer_append(&batch, "\0", 2);
+  reconcile_model_destroy(&current_model);
+  reconcile_model_destroy(&target_model);
+  return batch.data;
+}
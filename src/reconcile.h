@@ -0,0 +1,11 @@
+#pragma once
+#include "snapshot.h"
+
+struct reconcile_stats {
+  uint32_t added;
+  uint32_t removed;
+  uint32_t recreated;
+  uint32_t changed;
+};
+
+char* reconcile_diff(struct snapshot* current, struct snapshot* target, struct reconcile_stats* stats);
@@ -42,21 +42,25 @@ static bool shadow_set_color(struct shadow* shadow, uint32_t color) {
   return color_set_hex(&shadow->color, color) || changed;
 }
 
+uint64_t shadow_get_key(struct shadow* shadow, uint64_t hash) {
+  hash = hash_combine(hash, shadow->enabled);
+  if (!shadow->enabled) return hash;
+  hash = hash_combine(hash, shadow->color.hex);
+  hash = hash_float(hash, shadow->offset.x);
+  return hash_float(hash, shadow->offset.y);
+}
+
 CGRect shadow_get_bounds(struct shadow* shadow, CGRect reference_bounds) {
   return (CGRect){{reference_bounds.origin.x + shadow->offset.x,
                    reference_bounds.origin.y + shadow->offset.y },
                    reference_bounds.size                          };
 }
 
-void shadow_serialize(struct shadow* shadow, char* indent, FILE* rsp) {
-  fprintf(rsp, "%s\"drawing\": \"%s\",\n"
-               "%s\"color\": \"0x%x\",\n"
-               "%s\"angle\": %u,\n"
-               "%s\"distance\": %u",
-               indent, format_bool(shadow->enabled),
-               indent, shadow->color.hex,
-               indent, shadow->angle,
-               indent, shadow->distance                   );
+void shadow_serialize(struct shadow* shadow, struct json* json) {
+  json_string(json, "drawing", format_bool(shadow->enabled));
+  json_color(json, "color", shadow->color.hex);
+  json_uint(json, "angle", shadow->angle);
+  json_uint(json, "distance", shadow->distance);
 }
 
 bool shadow_parse_sub_domain(struct shadow* shadow, FILE* rsp, struct token property, char* message) {
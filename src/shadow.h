@@ -1,5 +1,6 @@
 #pragma once
 #include "misc/helpers.h"
+#include "json.h"
 #include "color.h"
 
 struct shadow {
@@ -13,7 +14,8 @@ struct shadow {
 };
 
 void shadow_init(struct shadow* shadow);
+uint64_t shadow_get_key(struct shadow* shadow, uint64_t hash);
 CGRect shadow_get_bounds(struct shadow* shadow, CGRect reference_bounds);
 
-void shadow_serialize(struct shadow* shadow, char* indent, FILE* rsp);
+void shadow_serialize(struct shadow* shadow, struct json* json);
 bool shadow_parse_sub_domain(struct shadow* shadow, FILE* rsp, struct token property, char* message);
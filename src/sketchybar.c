@@ -9,6 +9,9 @@
 #include "misc/help.h"
 #include "media.h"
 #include "hotload.h"
+#include "text_cache.h"
+#include "image_cache.h"
+#include "startup.h"
 #include <libgen.h>
 
 #define LCFILE_PATH_FMT  "/tmp/%s_%s.lock"
@@ -43,6 +46,9 @@ CFTypeRef g_transaction;
 int g_space_management_mode;
 
 struct bar_manager g_bar_manager;
+struct text_cache g_text_cache;
+struct image_cache g_image_cache;
+struct startup g_startup;
 struct mach_server g_mach_server;
 void *g_workspace_context;
 
@@ -54,6 +60,25 @@ bool g_brightness_events;
 int64_t g_disable_capture = 0;
 pid_t g_pid = 0;
 
+// The first message is the reply to the watch request, an empty message
+// after it ends the stream
+static bool g_stream_replied = false;
+static int g_stream_status = EXIT_SUCCESS;
+static MACH_STREAM_HANDLER(client_print_stream) {
+  if (!*message && g_stream_replied) return false;
+  g_stream_replied = true;
+
+  if (strlen(message) > 2 && message[1] == '!') {
+    fprintf(stderr, "%s", message);
+    g_stream_status = EXIT_FAILURE;
+    return false;
+  }
+
+  fprintf(stdout, "%s", message);
+  fflush(stdout);
+  return true;
+}
+
 static int client_send_message(int argc, char **argv) {
   if (argc <= 1) {
     return EXIT_SUCCESS;
@@ -72,9 +97,18 @@ static int client_send_message(int argc, char **argv) {
     message_length += argl[i] + 1;
   }
 
+  // Commands issued by the config are tagged with its run
+  char* run = getenv(CONFIG_RUN_ENV);
+  if (run) message_length += strlen(DOMAIN_ORIGIN) + strlen(run) + 2;
+
   char* message = malloc((sizeof(char) * (message_length + 1)));
   char* temp = message;
 
+  if (run) {
+    temp += sprintf(temp, "%s", DOMAIN_ORIGIN) + 1;
+    temp += sprintf(temp, "%s", run) + 1;
+  }
+
   for (int i = 1; i < argc; ++i) {
     memcpy(temp, argv[i], argl[i]);
     temp += argl[i];
@@ -85,6 +119,14 @@ static int client_send_message(int argc, char **argv) {
   char bs_name[256];
   snprintf(bs_name, 256, MACH_BS_NAME_FMT, g_name);
 
+  if (string_equals(argv[1], DOMAIN_WATCH)) {
+    mach_receive_stream(mach_get_bs_port(bs_name), message,
+                                                   message_length,
+                                                   client_print_stream);
+    free(message);
+    return g_stream_status;
+  }
+
   char* rsp = mach_send_message(mach_get_bs_port(bs_name),
                                 message,
                                 message_length,
@@ -197,9 +239,12 @@ int main(int argc, char **argv) {
 
   if (argc > 1) parse_arguments(argc, argv);
 
+  startup_init(&g_startup);
   pid_for_task(mach_task_self(), &g_pid);
   init_misc_settings();
+  startup_begin(&g_startup, STARTUP_PHASE_LOCK);
   acquire_lockfile();
+  startup_end(&g_startup, STARTUP_PHASE_LOCK);
 
   SLSRegisterNotifyProc((void*)system_events, 904, NULL);
   SLSRegisterNotifyProc((void*)system_events, 905, NULL);
@@ -216,24 +261,37 @@ int main(int argc, char **argv) {
   event_post(&init);
 
   workspace_event_handler_init(&g_workspace_context);
+  text_cache_init(&g_text_cache);
+  image_cache_init(&g_image_cache);
+  startup_begin(&g_startup, STARTUP_PHASE_BAR_INIT);
   bar_manager_init(&g_bar_manager);
+  startup_end(&g_startup, STARTUP_PHASE_BAR_INIT);
 
   mouse_begin();
   display_begin();
   workspace_event_handler_begin(&g_workspace_context);
 
+  startup_begin(&g_startup, STARTUP_PHASE_BAR_BEGIN);
   windows_freeze();
   bar_manager_begin(&g_bar_manager);
   windows_unfreeze();
+  startup_end(&g_startup, STARTUP_PHASE_BAR_BEGIN);
 
+  startup_begin(&g_startup, STARTUP_PHASE_MACH_SERVER);
   if (!mach_server_begin(&g_mach_server, mach_message_handler))
     error("%s: could not initialize daemon! abort..\n", g_name);
+  startup_end(&g_startup, STARTUP_PHASE_MACH_SERVER);
 
   begin_receiving_power_events();
   begin_receiving_network_events();
   initialize_media_events();
 
-  exec_config_file();
+  bool restored = restore_snapshot();
+  startup_begin(&g_startup, STARTUP_PHASE_CONFIG_EXEC);
+  startup_begin(&g_startup, STARTUP_PHASE_CONFIG_MESSAGES);
+  if (restored) reconcile_config();
+  else exec_config_file();
+  startup_end(&g_startup, STARTUP_PHASE_CONFIG_EXEC);
   begin_receiving_config_change_events();
 
   #if __MAC_OS_X_VERSION_MAX_ALLOWED >= 140000
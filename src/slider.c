@@ -106,24 +106,23 @@ void slider_destroy(struct slider* slider) {
   slider_clear_pointers(slider);
 }
 
-void slider_serialize(struct slider* slider, char* indent, FILE* rsp) {
-  fprintf(rsp, "%s\"highlight_color\": \"0x%x\",\n"
-               "%s\"percentage\": \"%d\",\n"
-               "%s\"width\": \"%d\",\n",
-               indent, slider->foreground_color,
-               indent, slider->percentage,
-               indent, (int)slider->background.bounds.size.width);
-
-  char deeper_indent[strlen(indent) + 2];
-  snprintf(deeper_indent, strlen(indent) + 2, "%s\t", indent);
-
-  fprintf(rsp, "%s\"background\": {\n", indent);
-  background_serialize(&slider->background, deeper_indent, rsp, false);
-  fprintf(rsp, "\n%s},\n", indent);
-
-  fprintf(rsp, "%s\"knob\": {\n", indent);
-  text_serialize(&slider->knob, deeper_indent, rsp);
-  fprintf(rsp, "\n%s}", indent);
+void slider_serialize(struct slider* slider, struct json* json) {
+  char percentage[16];
+  char width[16];
+  snprintf(percentage, 16, "%d", slider->percentage);
+  snprintf(width, 16, "%d", (int)slider->background.bounds.size.width);
+
+  json_color(json, "highlight_color", slider->foreground_color);
+  json_string(json, "percentage", percentage);
+  json_string(json, "width", width);
+
+  json_object_begin(json, "background");
+  background_serialize(&slider->background, json, false);
+  json_object_end(json);
+
+  json_object_begin(json, "knob");
+  text_serialize(&slider->knob, json);
+  json_object_end(json);
 }
 
 bool slider_parse_sub_domain(struct slider* slider, FILE* rsp, struct token property, char* message) {
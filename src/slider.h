@@ -25,5 +25,5 @@ uint32_t slider_get_length(struct slider* slider);
 
 void slider_cancel_drag(struct slider* slider);
 void slider_destroy(struct slider* slider);
-void slider_serialize(struct slider* slider, char* indent, FILE* rsp);
+void slider_serialize(struct slider* slider, struct json* json);
 bool slider_parse_sub_domain(struct slider* graph, FILE* rsp, struct token property, char* message);
@@ -0,0 +1,522 @@
+#include "snapshot.h"
+#include "misc/tokens.h"
+#include "misc/defines.h"
+#include <regex.h>
+#include <sys/stat.h>
+
+extern char g_name[256];
+
+#define SNAPSHOT_INDEX_MIN_SIZE 64
+
+struct snapshot_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_count;
+  uint32_t config_count;
+};
+
+static bool snapshot_names_equal(char* a, char* b) {
+  if (!a || !b) return a == b;
+  return string_equals(a, b);
+}
+
+static void snapshot_record_destroy(struct snapshot_record* record) {
+  if (record->item) free(record->item);
+  if (record->key) free(record->key);
+  if (record->message) free(record->message);
+}
+
+static uint64_t snapshot_hash_string(uint64_t hash, char* string) {
+  if (!string) return hash_combine(hash, 0x100);
+  while (*string) hash = hash_combine(hash, (unsigned char)*string++);
+  return hash_combine(hash, 0);
+}
+
+static uint64_t snapshot_hash(struct snapshot_record* record) {
+  uint64_t hash = snapshot_hash_string(0xcbf29ce484222325ULL, record->item);
+  hash = snapshot_hash_string(hash, record->key);
+  return hash_combine(hash, record->definition);
+}
+
+static bool snapshot_is_indexed(struct snapshot_record* record) {
+  return record->message && (record->key || record->definition);
+}
+
+static uint32_t* snapshot_bucket(struct snapshot* snapshot, uint64_t hash) {
+  return &snapshot->index[(hash ^ (hash >> 32)) & (snapshot->index_size - 1)];
+}
+
+static void snapshot_link(struct snapshot* snapshot, uint32_t index) {
+  struct snapshot_record* record = &snapshot->records[index];
+  uint32_t* bucket = snapshot_bucket(snapshot, record->hash);
+  record->next = *bucket;
+  *bucket = index;
+}
+
+static void snapshot_unlink(struct snapshot* snapshot, uint32_t index) {
+  uint32_t* slot = snapshot_bucket(snapshot, snapshot->records[index].hash);
+  while (*slot != SNAPSHOT_NO_RECORD && *slot != index)
+    slot = &snapshot->records[*slot].next;
+
+  if (*slot == index) *slot = snapshot->records[index].next;
+  snapshot->records[index].next = SNAPSHOT_NO_RECORD;
+}
+
+// Rehashes all records, the table is kept at most half full
+static void snapshot_reindex(struct snapshot* snapshot) {
+  uint32_t size = SNAPSHOT_INDEX_MIN_SIZE;
+  while (size < 2 * snapshot->record_count) size *= 2;
+  if (size != snapshot->index_size) {
+    snapshot->index = realloc(snapshot->index, sizeof(uint32_t) * size);
+    snapshot->index_size = size;
+  }
+  memset(snapshot->index, 0xff, sizeof(uint32_t) * size);
+
+  for (uint32_t i = 0; i < snapshot->record_count; i++) {
+    struct snapshot_record* record = &snapshot->records[i];
+    record->next = SNAPSHOT_NO_RECORD;
+    if (!snapshot_is_indexed(record)) continue;
+    record->hash = snapshot_hash(record);
+    snapshot_link(snapshot, i);
+  }
+}
+
+static uint32_t snapshot_find(struct snapshot* snapshot, struct snapshot_record* record) {
+  if (!snapshot->index_size) return SNAPSHOT_NO_RECORD;
+
+  uint32_t index = *snapshot_bucket(snapshot, record->hash);
+  while (index != SNAPSHOT_NO_RECORD) {
+    struct snapshot_record* other = &snapshot->records[index];
+    if (other->hash == record->hash
+        && other->definition == record->definition
+        && snapshot_names_equal(other->item, record->item)
+        && snapshot_names_equal(other->key, record->key)) {
+      return index;
+    }
+    index = other->next;
+  }
+  return SNAPSHOT_NO_RECORD;
+}
+
+static void snapshot_drop(struct snapshot* snapshot, uint32_t index) {
+  struct snapshot_record* record = &snapshot->records[index];
+  if (snapshot_is_indexed(record)) snapshot_unlink(snapshot, index);
+  snapshot_record_destroy(record);
+  memset(record, 0, sizeof(struct snapshot_record));
+  record->next = SNAPSHOT_NO_RECORD;
+  snapshot->dropped_count++;
+}
+
+// Squeezes out the dropped records once they make up half of the journal
+static void snapshot_compact(struct snapshot* snapshot) {
+  if (snapshot->dropped_count < SNAPSHOT_INDEX_MIN_SIZE
+      || 2 * snapshot->dropped_count < snapshot->record_count) {
+    return;
+  }
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < snapshot->record_count; i++) {
+    if (snapshot->records[i].message)
+      snapshot->records[count++] = snapshot->records[i];
+  }
+  snapshot->record_count = count;
+  snapshot->dropped_count = 0;
+  snapshot_reindex(snapshot);
+}
+
+// Takes ownership of the message, the item and the key. A property set
+// again moves to the end, where its item is guaranteed to exist on replay,
+// while a definition keeps its place such that later records still apply.
+static void snapshot_append(struct snapshot* snapshot, char* item, char* key, bool definition, char* message, uint32_t length) {
+  struct snapshot_record record = {
+    .item = item,
+    .key = key,
+    .definition = definition,
+    .message = message,
+    .length = length,
+    .hash = 0,
+    .next = SNAPSHOT_NO_RECORD
+  };
+
+  bool indexed = snapshot_is_indexed(&record);
+  if (indexed) {
+    record.hash = snapshot_hash(&record);
+    uint32_t existing = snapshot_find(snapshot, &record);
+
+    if (existing != SNAPSHOT_NO_RECORD && definition) {
+      struct snapshot_record* previous = &snapshot->records[existing];
+      free(previous->message);
+      previous->message = message;
+      previous->length = length;
+      if (item) free(item);
+      if (key) free(key);
+      return;
+    } else if (existing != SNAPSHOT_NO_RECORD) {
+      snapshot_drop(snapshot, existing);
+    }
+  }
+
+  if (snapshot->record_count == snapshot->record_capacity) {
+    snapshot->record_capacity = snapshot->record_capacity
+                                ? 2 * snapshot->record_capacity
+                                : SNAPSHOT_INDEX_MIN_SIZE;
+    snapshot->records = realloc(snapshot->records,
+                                sizeof(struct snapshot_record)
+                                * snapshot->record_capacity   );
+  }
+
+  uint32_t index = snapshot->record_count++;
+  snapshot->records[index] = record;
+  if (2 * snapshot->record_count > snapshot->index_size) {
+    snapshot_reindex(snapshot);
+  } else if (indexed) {
+    snapshot_link(snapshot, index);
+  }
+}
+
+// Returns the token at the given index of a record, NULL if it has fewer
+static char* snapshot_token(struct snapshot_record* record, uint32_t index) {
+  uint32_t offset = 0;
+  for (uint32_t i = 0; i < index; i++) {
+    offset += strlen(record->message + offset) + 1;
+    if (offset >= record->length) return NULL;
+  }
+  return record->message + offset;
+}
+
+static bool snapshot_item_matches(char* item, struct token name, regex_t* regex) {
+  if (!item) return false;
+  if (regex) return regexec(regex, item, 0, NULL, 0) == 0;
+  return token_equals(name, item);
+}
+
+// Drops all records of the items matching the name, which is either an
+// exact name or a /regex/. Returns false if nothing was dropped, or if an
+// item has to stay for a clone that was created from it.
+static bool snapshot_drop_items(struct snapshot* snapshot, struct token name) {
+  regex_t storage;
+  regex_t* regex = NULL;
+  if (name.length > 1 && name.text[0] == REGEX_DELIMITER
+      && name.text[name.length - 1] == REGEX_DELIMITER  ) {
+    char expression[name.length - 1];
+    memcpy(expression, name.text + 1, name.length - 2);
+    expression[name.length - 2] = '\0';
+    if (regcomp(&storage, expression, REG_EXTENDED | REG_NOSUB) != 0)
+      return false;
+    regex = &storage;
+  }
+
+  bool referenced = false;
+  bool matched = false;
+  for (uint32_t i = 0; i < snapshot->record_count && !referenced; i++) {
+    struct snapshot_record* record = &snapshot->records[i];
+    if (!record->message) continue;
+    if (snapshot_item_matches(record->item, name, regex)) {
+      matched = true;
+    } else if (record->definition
+               && string_equals(record->message, DOMAIN_CLONE)) {
+      char* parent = snapshot_token(record, 2);
+      referenced = snapshot_item_matches(parent, name, regex);
+    }
+  }
+
+  if (matched && !referenced) {
+    for (uint32_t i = 0; i < snapshot->record_count; i++) {
+      struct snapshot_record* record = &snapshot->records[i];
+      if (record->message && snapshot_item_matches(record->item, name, regex))
+        snapshot_drop(snapshot, i);
+    }
+  }
+
+  if (regex) regfree(regex);
+  return matched && !referenced;
+}
+
+// Packs the tokens into a NUL separated command
+static char* snapshot_pack(struct token* tokens, uint32_t count, uint32_t* length) {
+  *length = 0;
+  for (uint32_t i = 0; i < count; i++) *length += tokens[i].length + 1;
+
+  char* message = malloc(*length);
+  char* cursor = message;
+  for (uint32_t i = 0; i < count; i++) {
+    memcpy(cursor, tokens[i].text, tokens[i].length);
+    cursor += tokens[i].length;
+    *cursor++ = '\0';
+  }
+  return message;
+}
+
+static char* snapshot_key(struct token token) {
+  uint32_t length = 0;
+  while (length < token.length && token.text[length] != '=') length++;
+  return token_to_string((struct token) { token.text, length });
+}
+
+static void snapshot_record_properties(struct snapshot* snapshot, struct token command, struct token name, char* message) {
+  struct token token = get_token(&message);
+  while (token.text && token.length > 0) {
+    struct token tokens[3] = { command, name, token };
+    uint32_t count = 3;
+    if (!name.text) {
+      tokens[1] = token;
+      count = 2;
+    }
+
+    uint32_t length;
+    char* packed = snapshot_pack(tokens, count, &length);
+    snapshot_append(snapshot, name.text ? token_to_string(name) : NULL,
+                              snapshot_key(token),
+                              false,
+                              packed,
+                              length                                   );
+    token = get_token(&message);
+  }
+}
+
+// Whether the command changes the configured state
+bool snapshot_tracks(char* command) {
+  return string_equals(command, DOMAIN_SET)
+         || string_equals(command, DOMAIN_BAR)
+         || string_equals(command, DOMAIN_RENAME)
+         || string_equals(command, DOMAIN_REMOVE)
+         || string_equals(command, DOMAIN_ADD)
+         || string_equals(command, DOMAIN_CLONE)
+         || string_equals(command, DOMAIN_DEFAULT)
+         || string_equals(command, DOMAIN_SUBSCRIBE)
+         || string_equals(command, DOMAIN_REORDER)
+         || string_equals(command, DOMAIN_MOVE)
+         || string_equals(command, DOMAIN_ADD_FONT);
+}
+
+// Records a command segment as received by the message handler. Commands
+// which do not change the configured state are ignored.
+void snapshot_record(struct snapshot* snapshot, char* segment, uint32_t length) {
+  while (length > 0 && segment[length - 1] == '\0') length--;
+  if (length == 0 || !snapshot_tracks(segment)) return;
+
+  char* message = malloc(length + 2);
+  memcpy(message, segment, length);
+  message[length] = '\0';
+  message[length + 1] = '\0';
+
+  char* cursor = message;
+  struct token command = get_token(&cursor);
+  struct token first = get_token(&cursor);
+  char* item = NULL;
+  bool definition = false;
+
+  if (token_equals(command, DOMAIN_SET)) {
+    snapshot_record_properties(snapshot, command, first, cursor);
+    free(message);
+    snapshot_compact(snapshot);
+    return;
+  } else if (token_equals(command, DOMAIN_BAR)) {
+    snapshot_record_properties(snapshot, command,
+                                         (struct token){ NULL, 0 },
+                                         first.text                 );
+    free(message);
+    snapshot_compact(snapshot);
+    return;
+  } else if (token_equals(command, DOMAIN_REMOVE)) {
+    // The records of the item are gone, such that there is nothing to remove
+    // on replay
+    if (snapshot_drop_items(snapshot, first)) {
+      free(message);
+      snapshot_compact(snapshot);
+      return;
+    }
+  } else if (token_equals(command, DOMAIN_RENAME)) {
+    struct token new_name = get_token(&cursor);
+    for (uint32_t i = 0; i < snapshot->record_count; i++) {
+      struct snapshot_record* record = &snapshot->records[i];
+      if (record->item && token_equals(first, record->item)) {
+        free(record->item);
+        record->item = token_to_string(new_name);
+      }
+    }
+    snapshot_reindex(snapshot);
+    item = token_to_string(new_name);
+  } else if (token_equals(command, DOMAIN_ADD)) {
+    struct token name = get_token(&cursor);
+    if (!token_equals(first, COMMAND_ADD_EVENT) && name.length > 0) {
+      item = token_to_string(name);
+      definition = true;
+    }
+  } else if (token_equals(command, DOMAIN_CLONE)) {
+    item = token_to_string(first);
+    definition = true;
+  } else if (token_equals(command, DOMAIN_SUBSCRIBE)
+             || token_equals(command, DOMAIN_MOVE)) {
+    item = token_to_string(first);
+  }
+
+  snapshot_append(snapshot, item, NULL, definition, message, length + 1);
+  snapshot_compact(snapshot);
+}
+
+// Whether the journal defines the item with exactly the given command
+bool snapshot_defines(struct snapshot* snapshot, char* item, char* segment, uint32_t length) {
+  while (length > 0 && segment[length - 1] == '\0') length--;
+
+  struct snapshot_record record = { .item = item, .definition = true };
+  record.hash = snapshot_hash(&record);
+  uint32_t index = snapshot_find(snapshot, &record);
+  if (index == SNAPSHOT_NO_RECORD) return false;
+
+  struct snapshot_record* definition = &snapshot->records[index];
+  return definition->length == length + 1
+         && memcmp(definition->message, segment, length) == 0;
+}
+
+// Concatenates all records into a single batch message
+char* snapshot_batch(struct snapshot* snapshot) {
+  uint32_t length = 0;
+  for (uint32_t i = 0; i < snapshot->record_count; i++)
+    length += snapshot->records[i].length;
+
+  char* batch = malloc(length + 2);
+  char* cursor = batch;
+  for (uint32_t i = 0; i < snapshot->record_count; i++) {
+    if (!snapshot->records[i].message) continue;
+    memcpy(cursor, snapshot->records[i].message, snapshot->records[i].length);
+    cursor += snapshot->records[i].length;
+  }
+  cursor[0] = '\0';
+  cursor[1] = '\0';
+  return batch;
+}
+
+void snapshot_init(struct snapshot* snapshot) {
+  snapshot->records = NULL;
+  snapshot->record_count = 0;
+  snapshot->record_capacity = 0;
+  snapshot->dropped_count = 0;
+  snapshot->index = NULL;
+  snapshot->index_size = 0;
+}
+
+void snapshot_destroy(struct snapshot* snapshot) {
+  for (uint32_t i = 0; i < snapshot->record_count; i++)
+    snapshot_record_destroy(&snapshot->records[i]);
+  if (snapshot->records) free(snapshot->records);
+  if (snapshot->index) free(snapshot->index);
+  snapshot_init(snapshot);
+}
+
+void snapshot_default_path(char* buffer, uint32_t size) {
+  char* home = getenv("HOME");
+  snprintf(buffer, size, SNAPSHOT_PATH_FMT, home ? home : "/tmp", g_name);
+}
+
+static uint32_t snapshot_live_count(struct snapshot* snapshot) {
+  return snapshot ? snapshot->record_count - snapshot->dropped_count : 0;
+}
+
+static bool snapshot_write_records(struct snapshot* snapshot, FILE* file) {
+  if (!snapshot) return true;
+  for (uint32_t i = 0; i < snapshot->record_count; i++) {
+    struct snapshot_record* record = &snapshot->records[i];
+    if (!record->message) continue;
+    if (fwrite(&record->length, sizeof(uint32_t), 1, file) != 1
+        || fwrite(record->message, record->length, 1, file) != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The journal of the last config run is stored along with the state, such
+// that the config can be reconciled against the restored state. The
+// snapshot is written to a temporary file first, such that a crash never
+// leaves a truncated snapshot behind.
+bool snapshot_save(struct snapshot* snapshot, struct snapshot* config, char* path) {
+  char directory[4096];
+  snprintf(directory, sizeof(directory), "%s", path);
+  char* separator = strrchr(directory, '/');
+  if (separator && separator != directory) {
+    *separator = '\0';
+    mkdir(directory, 0700);
+  }
+
+  char temporary[4096];
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE* file = fopen(temporary, "wb");
+  if (!file) return false;
+
+  struct snapshot_header header = { SNAPSHOT_MAGIC,
+                                    SNAPSHOT_VERSION,
+                                    snapshot_live_count(snapshot),
+                                    snapshot_live_count(config)   };
+
+  bool success = fwrite(&header, sizeof(header), 1, file) == 1
+                 && snapshot_write_records(snapshot, file)
+                 && snapshot_write_records(config, file);
+
+  success &= fclose(file) == 0;
+  if (!success || rename(temporary, path) != 0) {
+    remove(temporary);
+    return false;
+  }
+  return true;
+}
+
+// Reads a snapshot into a single batch message, NULL if the file is missing,
+// corrupt or of a different version. The stored config journal is recorded
+// into config, if given.
+char* snapshot_read(char* path, struct snapshot* config) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return NULL;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  struct snapshot_header header;
+  if (size < (long)sizeof(header)
+      || fread(&header, sizeof(header), 1, file) != 1
+      || header.magic != SNAPSHOT_MAGIC
+      || header.version != SNAPSHOT_VERSION) {
+    fclose(file);
+    return NULL;
+  }
+
+  uint32_t capacity = size - sizeof(header);
+  char* batch = malloc(capacity + 2);
+  uint32_t length = 0;
+  bool valid = true;
+
+  struct snapshot restored;
+  snapshot_init(&restored);
+
+  for (uint32_t i = 0; valid && i < header.record_count + header.config_count;
+                                                                         i++) {
+    uint32_t record_length;
+    valid = fread(&record_length, sizeof(uint32_t), 1, file) == 1
+            && record_length > 0
+            && record_length <= capacity - length
+            && fread(batch + length, record_length, 1, file) == 1
+            && batch[length + record_length - 1] == '\0';
+
+    // Config records are not part of the state to replay
+    if (!valid) break;
+    if (i < header.record_count) length += record_length;
+    else if (config) snapshot_record(&restored, batch + length, record_length);
+  }
+  fclose(file);
+
+  if (!valid) {
+    snapshot_destroy(&restored);
+    free(batch);
+    return NULL;
+  }
+
+  if (config) {
+    snapshot_destroy(config);
+    *config = restored;
+  }
+
+  batch[length] = '\0';
+  batch[length + 1] = '\0';
+  return batch;
+}
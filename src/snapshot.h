@@ -0,0 +1,52 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SNAPSHOT_MAGIC    0x53424b53
+#define SNAPSHOT_VERSION  2
+#define SNAPSHOT_PATH_FMT "%s/.cache/%s.snapshot"
+
+#define SNAPSHOT_NO_RECORD UINT32_MAX
+
+// A single state changing command. Property assignments carry the item and
+// key they apply to and are replaced when the same property is set again,
+// the command creating an item (its definition) is replaced in place. All
+// records naming an item are dropped with it.
+struct snapshot_record {
+  char* item;
+  char* key;
+  bool definition;
+
+  char* message;
+  uint32_t length;
+
+  // Chain of the (item, key) index
+  uint64_t hash;
+  uint32_t next;
+};
+
+// Journal of all state changing commands since the config was loaded,
+// replaying it in order recreates the items, the bar and the defaults.
+// Dropped records stay in place without a message until the journal is
+// compacted.
+struct snapshot {
+  struct snapshot_record* records;
+  uint32_t record_count;
+  uint32_t record_capacity;
+  uint32_t dropped_count;
+
+  uint32_t* index;
+  uint32_t index_size;
+};
+
+void snapshot_init(struct snapshot* snapshot);
+void snapshot_destroy(struct snapshot* snapshot);
+bool snapshot_tracks(char* command);
+void snapshot_record(struct snapshot* snapshot, char* segment, uint32_t length);
+char* snapshot_batch(struct snapshot* snapshot);
+bool snapshot_defines(struct snapshot* snapshot, char* item, char* segment, uint32_t length);
+
+void snapshot_default_path(char* buffer, uint32_t size);
+bool snapshot_save(struct snapshot* snapshot, struct snapshot* config, char* path);
+char* snapshot_read(char* path, struct snapshot* config);
@@ -0,0 +1,130 @@
+#include "startup.h"
+#include <dispatch/dispatch.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static char* g_startup_phase_names[STARTUP_PHASE_COUNT] = {
+  [STARTUP_PHASE_LOCK] = "lock",
+  [STARTUP_PHASE_BAR_INIT] = "bar_manager_init",
+  [STARTUP_PHASE_BAR_BEGIN] = "bar_manager_begin",
+  [STARTUP_PHASE_MACH_SERVER] = "mach_server",
+  [STARTUP_PHASE_CONFIG_EXEC] = "config_exec",
+  [STARTUP_PHASE_CONFIG_MESSAGES] = "config_messages",
+  [STARTUP_PHASE_FIRST_FRAME] = "first_frame",
+  [STARTUP_PHASE_FIRST_SCRIPT] = "first_script",
+};
+
+static uint64_t startup_now() {
+  return clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW);
+}
+
+void startup_init(struct startup* startup) {
+  memset(startup, 0, sizeof(struct startup));
+  startup->launch = startup_now();
+}
+
+void startup_begin(struct startup* startup, enum startup_phase phase) {
+  if (startup->phases[phase].begin) return;
+  startup->phases[phase].begin = startup_now();
+}
+
+void startup_end(struct startup* startup, enum startup_phase phase) {
+  struct startup_timing* timing = &startup->phases[phase];
+  if (!timing->begin || timing->end) return;
+  timing->end = startup_now();
+}
+
+// The config phase lasts from the fork until the last message of the
+// first config run, which is only known once the config has exited
+void startup_config_message(struct startup* startup) {
+  if (startup->config_exited) return;
+  startup->phases[STARTUP_PHASE_CONFIG_MESSAGES].end = startup_now();
+}
+
+// The first full frame is the first frame drawn after the last config
+// message, it might have been drawn before the config process exited
+void startup_config_exited(struct startup* startup) {
+  if (startup->config_exited) return;
+  startup->config_exited = true;
+
+  struct startup_timing* frame = &startup->phases[STARTUP_PHASE_FIRST_FRAME];
+  uint64_t last_message = startup->phases[STARTUP_PHASE_CONFIG_MESSAGES].end;
+  frame->begin = last_message ? last_message : startup_now();
+  if (startup->last_frame > frame->begin) frame->end = startup->last_frame;
+}
+
+void startup_frame(struct startup* startup) {
+  if (!startup->config_exited) startup->last_frame = startup_now();
+  else startup_end(startup, STARTUP_PHASE_FIRST_FRAME);
+}
+
+static void startup_script_exited(void* context) {
+  struct startup* startup = context;
+  startup_end(startup, STARTUP_PHASE_FIRST_SCRIPT);
+
+  if (startup->script_source) {
+    dispatch_source_cancel(startup->script_source);
+    dispatch_release(startup->script_source);
+    startup->script_source = NULL;
+  }
+}
+
+void startup_script(struct startup* startup, pid_t pid) {
+  if (pid <= 0 || startup->phases[STARTUP_PHASE_FIRST_SCRIPT].begin) return;
+  startup_begin(startup, STARTUP_PHASE_FIRST_SCRIPT);
+
+  dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_PROC,
+                                                    pid,
+                                                    DISPATCH_PROC_EXIT,
+                                                    dispatch_get_main_queue());
+  if (!source) return;
+
+  startup->script_source = source;
+  dispatch_set_context(source, startup);
+  dispatch_source_set_event_handler_f(source, startup_script_exited);
+  dispatch_resume(source);
+
+  // The script might have exited before the source was armed
+  if (kill(pid, 0) == -1 && errno == ESRCH) startup_script_exited(startup);
+}
+
+static void startup_serialize_phase(struct startup* startup, struct json* json, enum startup_phase phase) {
+  struct startup_timing* timing = &startup->phases[phase];
+  if (!timing->begin || !timing->end) {
+    json_null(json, g_startup_phase_names[phase]);
+    return;
+  }
+
+  json_object_begin(json, g_startup_phase_names[phase]);
+  json_float(json, "start_ms", (timing->begin - startup->launch) / 1e6, 3);
+  json_float(json, "duration_ms", (timing->end - timing->begin) / 1e6, 3);
+  json_object_end(json);
+}
+
+void startup_serialize(struct startup* startup, struct json* json) {
+  uint64_t ready = 0;
+  for (int i = 0; i < STARTUP_PHASE_COUNT; i++) {
+    if (startup->phases[i].end > ready) ready = startup->phases[i].end;
+  }
+
+  json_float(json, "total_ms", ready ? (ready - startup->launch) / 1e6 : 0.0,
+                               3                                             );
+  json_object_begin(json, "phases");
+  for (int i = 0; i < STARTUP_PHASE_COUNT; i++) {
+    startup_serialize_phase(startup, json, i);
+  }
+  json_object_end(json);
+}
+
+void startup_report(struct startup* startup, FILE* file) {
+  struct json json;
+  json_init(&json);
+  json_object_begin(&json, NULL);
+  startup_serialize(startup, &json);
+  json_object_end(&json);
+  json_flush(&json, file);
+  json_destroy(&json);
+}
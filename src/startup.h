@@ -0,0 +1,50 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include "json.h"
+
+// Set to print the startup report to stdout when the bar exits
+#define STARTUP_REPORT_ENV "BAR_STARTUP_REPORT"
+
+enum startup_phase {
+  STARTUP_PHASE_LOCK,
+  STARTUP_PHASE_BAR_INIT,
+  STARTUP_PHASE_BAR_BEGIN,
+  STARTUP_PHASE_MACH_SERVER,
+  STARTUP_PHASE_CONFIG_EXEC,
+  STARTUP_PHASE_CONFIG_MESSAGES,
+  STARTUP_PHASE_FIRST_FRAME,
+  STARTUP_PHASE_FIRST_SCRIPT,
+  STARTUP_PHASE_COUNT
+};
+
+struct startup_timing {
+  uint64_t begin;
+  uint64_t end;
+};
+
+// Monotonic timestamps of the startup phases, relative to the launch of the
+// process. Every phase is only measured once, later reloads do not count.
+struct startup {
+  uint64_t launch;
+  bool config_exited;
+  uint64_t last_frame;
+  void* script_source;
+  struct startup_timing phases[STARTUP_PHASE_COUNT];
+};
+
+extern struct startup g_startup;
+
+void startup_init(struct startup* startup);
+void startup_begin(struct startup* startup, enum startup_phase phase);
+void startup_end(struct startup* startup, enum startup_phase phase);
+
+void startup_config_message(struct startup* startup);
+void startup_config_exited(struct startup* startup);
+void startup_frame(struct startup* startup);
+void startup_script(struct startup* startup, pid_t pid);
+
+void startup_serialize(struct startup* startup, struct json* json);
+void startup_report(struct startup* startup, FILE* file);
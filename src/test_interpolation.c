@@ -0,0 +1,81 @@
+#include "interpolation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Drives color animations through the batch kernel with curves that leave
+// [0, 1] and checks every channel of every frame against the clamped
+// reference value of the curve, such that a wrapping channel shows up.
+//   test_interpolation
+
+#define TEST_FRAMES 60
+
+static bool run_curve(char* description, uint32_t from, uint32_t to) {
+  struct animation_curve* curve = animation_curve_parse(description);
+  if (!curve) {
+    printf("[!] Test: Invalid curve '%s'\n", description);
+    return false;
+  }
+
+  struct animation_batch batch;
+  memset(&batch, 0, sizeof(struct animation_batch));
+  animation_batch_reserve(&batch, 1);
+  animation_batch_add_group(&batch, 0, curve, ANIMATION_KIND_BYTES);
+  struct animation_group* group = &batch.groups[0];
+  group->offset = 0;
+  group->count = 1;
+  batch.from[0] = from;
+  batch.to[0] = to;
+
+  bool passed = true;
+  for (uint32_t frame = 0; frame <= TEST_FRAMES && passed; frame++) {
+    batch.progress[0] = (double)frame / TEST_FRAMES;
+    animation_batch_evaluate(&batch, group);
+
+    double t = animation_curve_evaluate(curve, batch.progress[0]);
+    unsigned char from_bytes[4], to_bytes[4], bytes[4];
+    memcpy(from_bytes, &from, sizeof(from_bytes));
+    memcpy(to_bytes, &to, sizeof(to_bytes));
+    memcpy(bytes, &batch.values[0], sizeof(bytes));
+
+    for (int c = 0; c < 4; c++) {
+      double expected = (1. - t) * from_bytes[c] + t * to_bytes[c];
+      if (expected < 0.) expected = 0.;
+      if (expected > 255.) expected = 255.;
+      if (bytes[c] < expected - 1. || bytes[c] > expected + 1.) {
+        printf("  frame %u: got 0x%08x, channel %d expected %.1f\n",
+               frame,
+               (uint32_t)batch.values[0],
+               c,
+               expected                  );
+        passed = false;
+      }
+    }
+  }
+
+  printf("%s %s 0x%08x -> 0x%08x\n", passed ? "[ok]" : "[!!]",
+                                     description,
+                                     from,
+                                     to                        );
+  animation_batch_destroy(&batch);
+  return passed;
+}
+
+int main(int argc, char **argv) {
+  struct { char* curve; uint32_t from; uint32_t to; } cases[] = {
+    { "linear",         0xff000000, 0x00ffffff },
+    { "overshoot",      0xff000000, 0x00ffffff },
+    { "overshoot",      0x00ffffff, 0xff000000 },
+    { "spring(300,8)",  0xff000000, 0x00ffffff },
+    { "cubic_bezier(0.5,-0.6,0.5,1.6)", 0x80ff0000, 0xff00ff80 },
+  };
+
+  uint32_t count = sizeof(cases) / sizeof(cases[0]);
+  uint32_t failed = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!run_curve(cases[i].curve, cases[i].from, cases[i].to)) failed++;
+  }
+
+  printf("%u cases, %u failed\n", count, failed);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
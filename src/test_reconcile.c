@@ -0,0 +1,116 @@
+#include "reconcile.h"
+#include "batch.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Runs reconcile_diff on journal fixtures. Every case is a directory with
+// the journal of the last config run (current.batch), the one of the new run
+// (target.batch) and the expected delta (delta.batch), all in the syntax of
+// a declarative config. A case without a delta expects a full rebuild.
+//   test_reconcile <case>...
+
+char g_name[256] = "sketchybar";
+
+static uint32_t batch_length(char* batch) {
+  uint32_t length = 0;
+  while (batch[length] || batch[length + 1]) length++;
+  return length + 2;
+}
+
+// Records the commands of a batch one by one, as the message handler does
+static void journal_batch(struct snapshot* snapshot, char* batch) {
+  char* cursor = batch;
+  while (*cursor) {
+    uint32_t length = 0;
+    while (cursor[length]
+           || (cursor[length + 1] && cursor[length + 1] != '-')) {
+      length++;
+    }
+    snapshot_record(snapshot, cursor, length + 1);
+    cursor += length + 1;
+  }
+}
+
+static void print_batch(char* batch) {
+  if (!batch) {
+    printf("    (rebuild)\n");
+    return;
+  }
+
+  char* cursor = batch;
+  while (*cursor) {
+    printf(cursor == batch ? "    %s" : (cursor[0] == '-' && cursor[1] == '-'
+                                       ? "\n    %s" : " %s"), cursor);
+    cursor += strlen(cursor) + 1;
+  }
+  printf("\n");
+}
+
+static bool load_journal(struct snapshot* snapshot, char* directory, char* name) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", directory, name);
+
+  uint32_t error_line;
+  char* batch = batch_read(path, &error_line);
+  if (!batch) {
+    printf("[!] Test: Could not read '%s'\n", path);
+    return false;
+  }
+  journal_batch(snapshot, batch);
+  free(batch);
+  return true;
+}
+
+static bool run_case(char* directory) {
+  struct snapshot current, target;
+  snapshot_init(&current);
+  snapshot_init(&target);
+  if (!load_journal(&current, directory, "current.batch")
+      || !load_journal(&target, directory, "target.batch")) {
+    snapshot_destroy(&current);
+    snapshot_destroy(&target);
+    return false;
+  }
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/delta.batch", directory);
+  uint32_t error_line;
+  char* expected = batch_read(path, &error_line);
+
+  struct reconcile_stats stats;
+  char* delta = reconcile_diff(&current, &target, &stats);
+
+  bool passed = (!delta && !expected)
+                || (delta && expected
+                    && batch_length(delta) == batch_length(expected)
+                    && memcmp(delta, expected, batch_length(delta)) == 0);
+
+  printf("%s %s\n", passed ? "[ok]" : "[!!]", directory);
+  if (!passed) {
+    printf("  expected:\n");
+    print_batch(expected);
+    printf("  got:\n");
+    print_batch(delta);
+  }
+
+  if (delta) free(delta);
+  if (expected) free(expected);
+  snapshot_destroy(&current);
+  snapshot_destroy(&target);
+  return passed;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("Usage: %s <case>...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  uint32_t failed = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!run_case(argv[i])) failed++;
+  }
+
+  printf("%d cases, %u failed\n", argc - 1, failed);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
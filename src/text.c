@@ -1,5 +1,6 @@
 #include "text.h"
 #include "bar_manager.h"
+#include "text_cache.h"
 
 static void text_calculate_truncated_width(struct text* text, CFDictionaryRef attributes) {
   if (text->max_chars > 0) {
@@ -122,6 +123,8 @@ void text_copy(struct text* text, struct text* source) {
   font_set_family(&text->font, string_copy(source->font.family), true);
   font_set_style(&text->font, string_copy(source->font.style), true);
   font_set_size(&text->font, source->font.size);
+  if (source->font.features)
+    font_set_features(&text->font, string_copy(source->font.features));
   text_set_string(text, string_copy(source->string), true);
 }
 
@@ -277,6 +280,7 @@ bool text_animate_scroll(struct text* text) {
   if (text->has_const_width && text->custom_width < text->width) return false;
   if (text->width == 0 || text->width == text->bounds.size.width) return false;
 
+  animator_reset_timing(&g_bar_manager.animator);
   g_bar_manager.animator.duration = text->scroll_duration
                                     * (text->bounds.size.width / text->width);
   g_bar_manager.animator.interp_function = INTERP_FUNCTION_LINEAR;
@@ -304,9 +308,7 @@ bool text_animate_scroll(struct text* text) {
   g_bar_manager.animator.duration = text->scroll_duration;
   ANIMATE_FLOAT(text_set_scroll, text, text->scroll, 0);
 
-  g_bar_manager.animator.duration = 0;
-  g_bar_manager.animator.interp_function = '\0';
-
+  animator_reset_timing(&g_bar_manager.animator);
   return needs_refresh;
 }
 
@@ -331,6 +333,18 @@ void text_draw(struct text* text, CGContextRef context) {
     CFRelease(path);
   }
 
+  struct color color = text->highlight ? text->highlight_color : text->color;
+  if (text->scroll == 0.f
+      && text_cache_draw(&g_text_cache,
+                         text,
+                         &color,
+                         CGPointMake(text->bounds.origin.x + text->padding_left,
+                                     text->bounds.origin.y + text->y_offset    ),
+                         context                                                )) {
+    CGContextRestoreGState(context);
+    return;
+  }
+
   if (text->shadow.enabled) {
     CGContextSetRGBFillColor(context,
                              text->shadow.color.r,
@@ -345,7 +359,6 @@ void text_draw(struct text* text, CGContextRef context) {
     CTLineDraw(text->line.line, context);
   }
 
-  struct color color = text->highlight ? text->highlight_color : text->color;
   CGContextSetRGBFillColor(context, color.r, color.g, color.b, color.a);
 
   CGContextSetTextPosition(context,
@@ -356,7 +369,7 @@ void text_draw(struct text* text, CGContextRef context) {
   CGContextRestoreGState(context);
 }
 
-void text_serialize(struct text* text, char* indent, FILE* rsp) {
+void text_serialize(struct text* text, struct json* json) {
   char align[32] = { 0 };
   switch (text->align) {
     case POSITION_LEFT:
@@ -379,39 +392,31 @@ void text_serialize(struct text* text, char* indent, FILE* rsp) {
       break;
   }
 
-  fprintf(rsp, "%s\"value\": \"%s\",\n"
-               "%s\"drawing\": \"%s\",\n"
-               "%s\"highlight\": \"%s\",\n"
-               "%s\"color\": \"0x%x\",\n"
-               "%s\"highlight_color\": \"0x%x\",\n"
-               "%s\"padding_left\": %d,\n"
-               "%s\"padding_right\": %d,\n"
-               "%s\"y_offset\": %d,\n"
-               "%s\"font\": \"%s:%s:%.2f\",\n"
-               "%s\"width\": %d,\n"
-               "%s\"scroll_duration\": %d,\n"
-               "%s\"align\": \"%s\",\n"
-               "%s\"background\": {\n",
-               indent, text->string,
-               indent, format_bool(text->drawing),
-               indent, format_bool(text->highlight),
-               indent, text->color.hex,
-               indent, text->highlight_color.hex,
-               indent, text->padding_left,
-               indent, text->padding_right,
-               indent, text->y_offset,
-               indent, text->font.family, text->font.style, text->font.size,
-               indent, text->custom_width,
-               indent, text->scroll_duration,
-               indent, align, indent                                        );
-
-  char deeper_indent[strlen(indent) + 2];
-  snprintf(deeper_indent, strlen(indent) + 2, "%s\t", indent);
-  background_serialize(&text->background, deeper_indent, rsp, true);
-
-  fprintf(rsp, "\n%s},\n%s\"shadow\": {\n", indent, indent);
-  shadow_serialize(&text->shadow, deeper_indent, rsp);
-  fprintf(rsp, "\n%s}", indent);
+  char font[256];
+  snprintf(font, 256, "%s:%s:%.2f", text->font.family,
+                                    text->font.style,
+                                    text->font.size   );
+
+  json_string(json, "value", text->string);
+  json_string(json, "drawing", format_bool(text->drawing));
+  json_string(json, "highlight", format_bool(text->highlight));
+  json_color(json, "color", text->color.hex);
+  json_color(json, "highlight_color", text->highlight_color.hex);
+  json_int(json, "padding_left", text->padding_left);
+  json_int(json, "padding_right", text->padding_right);
+  json_int(json, "y_offset", text->y_offset);
+  json_string(json, "font", font);
+  json_int(json, "width", text->custom_width);
+  json_int(json, "scroll_duration", text->scroll_duration);
+  json_string(json, "align", align);
+
+  json_object_begin(json, "background");
+  background_serialize(&text->background, json, true);
+  json_object_end(json);
+
+  json_object_begin(json, "shadow");
+  shadow_serialize(&text->shadow, json);
+  json_object_end(json);
 }
 
 bool text_parse_sub_domain(struct text* text, FILE* rsp, struct token property, char* message) {
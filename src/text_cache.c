@@ -0,0 +1,260 @@
+#include "text_cache.h"
+#include "text.h"
+#include "bar_manager.h"
+
+static uint64_t text_cache_hash(struct text_cache_key* key) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char* c = key->string; *c; c++) {
+    hash ^= (uint8_t)*c;
+    hash *= 0x100000001b3ULL;
+  }
+
+  uint64_t fields[] = { (uint64_t)(uintptr_t)key->ct_font,
+                        key->color,
+                        key->shadow ? key->shadow_color : 0,
+                        (uint64_t)(int64_t)(key->shadow_offset.x * 64.f),
+                        (uint64_t)(int64_t)(key->shadow_offset.y * 64.f),
+                        (uint64_t)(key->scale * 64.f),
+                        ((uint64_t)key->shadow << 1) | key->smoothing   };
+
+  for (int i = 0; i < array_count(fields); i++) {
+    hash ^= fields[i] + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+  }
+  return hash;
+}
+
+static bool text_cache_key_equals(struct text_cache_key* a, struct text_cache_key* b) {
+  return a->hash == b->hash
+         && a->ct_font == b->ct_font
+         && a->color == b->color
+         && a->shadow == b->shadow
+         && a->smoothing == b->smoothing
+         && a->scale == b->scale
+         && (!a->shadow || (a->shadow_color == b->shadow_color
+                            && CGPointEqualToPoint(a->shadow_offset,
+                                                   b->shadow_offset)))
+         && strcmp(a->string, b->string) == 0;
+}
+
+static void text_cache_lru_unlink(struct text_cache* cache, struct text_cache_entry* entry) {
+  if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+  else cache->lru_head = entry->lru_next;
+  if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+  else cache->lru_tail = entry->lru_prev;
+  entry->lru_prev = NULL;
+  entry->lru_next = NULL;
+}
+
+static void text_cache_lru_push_front(struct text_cache* cache, struct text_cache_entry* entry) {
+  entry->lru_prev = NULL;
+  entry->lru_next = cache->lru_head;
+  if (cache->lru_head) cache->lru_head->lru_prev = entry;
+  cache->lru_head = entry;
+  if (!cache->lru_tail) cache->lru_tail = entry;
+}
+
+static void text_cache_entry_destroy(struct text_cache_entry* entry) {
+  CGImageRelease(entry->image);
+  CFRelease(entry->key.ct_font);
+  free(entry->key.string);
+  free(entry);
+}
+
+static struct text_cache_entry* text_cache_lookup(struct text_cache* cache, struct text_cache_key* key) {
+  struct text_cache_entry* entry = cache->buckets[key->hash % TEXT_CACHE_BUCKETS];
+  while (entry && !text_cache_key_equals(&entry->key, key))
+    entry = entry->bucket_next;
+  return entry;
+}
+
+static void text_cache_remove(struct text_cache* cache, struct text_cache_entry* entry) {
+  struct text_cache_entry** slot
+                      = &cache->buckets[entry->key.hash % TEXT_CACHE_BUCKETS];
+  while (*slot && *slot != entry) slot = &(*slot)->bucket_next;
+  if (*slot) *slot = entry->bucket_next;
+
+  text_cache_lru_unlink(cache, entry);
+  cache->bytes -= entry->bytes;
+  cache->count--;
+  text_cache_entry_destroy(entry);
+}
+
+static void text_cache_evict(struct text_cache* cache, uint64_t required) {
+  while (cache->lru_tail && cache->bytes + required > cache->budget) {
+    text_cache_remove(cache, cache->lru_tail);
+    cache->evictions++;
+  }
+}
+
+static struct text_cache_entry* text_cache_rasterize(struct text_cache_key* key, struct text* text) {
+  CGRect rect = CGRectMake(0,
+                           -text->line.descent,
+                           CTLineGetTypographicBounds(text->line.line,
+                                                      NULL,
+                                                      NULL,
+                                                      NULL            ),
+                           text->line.ascent + text->line.descent     );
+
+  rect = CGRectUnion(rect,
+                     CTLineGetBoundsWithOptions(text->line.line,
+                                                kCTLineBoundsUseGlyphPathBounds));
+
+  if (key->shadow) {
+    rect = CGRectUnion(rect, CGRectOffset(rect, key->shadow_offset.x,
+                                                key->shadow_offset.y));
+  }
+
+  rect = CGRectIntegral(CGRectInset(rect, -2.f, -2.f));
+
+  uint32_t width = (uint32_t)ceilf(rect.size.width * key->scale);
+  uint32_t height = (uint32_t)ceilf(rect.size.height * key->scale);
+  if (width == 0 || height == 0) return NULL;
+
+  CGColorSpaceRef color_space = CGColorSpaceCreateDeviceRGB();
+  CGContextRef context = CGBitmapContextCreate(NULL,
+                                               width,
+                                               height,
+                                               8,
+                                               0,
+                                               color_space,
+                                               kCGImageAlphaPremultipliedFirst
+                                               | kCGBitmapByteOrder32Host    );
+  CGColorSpaceRelease(color_space);
+  if (!context) return NULL;
+
+  CGContextSetAllowsFontSmoothing(context, key->smoothing);
+  CGContextScaleCTM(context, key->scale, key->scale);
+  CGContextTranslateCTM(context, -rect.origin.x, -rect.origin.y);
+
+  if (key->shadow) {
+    CGContextSetRGBFillColor(context,
+                             text->shadow.color.r,
+                             text->shadow.color.g,
+                             text->shadow.color.b,
+                             text->shadow.color.a );
+
+    CGContextSetTextPosition(context, key->shadow_offset.x,
+                                      key->shadow_offset.y );
+    CTLineDraw(text->line.line, context);
+  }
+
+  struct color color;
+  color_init(&color, key->color);
+  CGContextSetRGBFillColor(context, color.r, color.g, color.b, color.a);
+  CGContextSetTextPosition(context, 0, 0);
+  CTLineDraw(text->line.line, context);
+
+  CGImageRef image = CGBitmapContextCreateImage(context);
+  uint32_t bytes = CGBitmapContextGetBytesPerRow(context) * height;
+  CGContextRelease(context);
+  if (!image) return NULL;
+
+  struct text_cache_entry* entry = malloc(sizeof(struct text_cache_entry));
+  memset(entry, 0, sizeof(struct text_cache_entry));
+  entry->key = *key;
+  entry->key.string = string_copy(key->string);
+  entry->key.ct_font = CFRetain(key->ct_font);
+  entry->image = image;
+  entry->rect = rect;
+  entry->bytes = bytes;
+  return entry;
+}
+
+void text_cache_init(struct text_cache* cache) {
+  memset(cache, 0, sizeof(struct text_cache));
+  pthread_mutex_init(&cache->mutex, NULL);
+  cache->budget = TEXT_CACHE_BUDGET;
+}
+
+// Draws the text line (and its shadow) from a cached bitmap, rasterizing it
+// on a miss. Returns false if the text can not be served from the cache.
+bool text_cache_draw(struct text_cache* cache, struct text* text, struct color* color, CGPoint position, CGContextRef context) {
+  if (!text->line.line || !text->string || !text->font.ct_font) return false;
+
+  struct text_cache_key key;
+  key.string = text->string;
+  key.ct_font = text->font.ct_font;
+  key.color = color->hex;
+  key.shadow = text->shadow.enabled;
+  key.shadow_color = text->shadow.enabled ? text->shadow.color.hex : 0;
+  key.shadow_offset = text->shadow.enabled ? text->shadow.offset
+                                           : CGPointZero;
+  key.smoothing = g_bar_manager.font_smoothing;
+  key.scale = CGContextConvertSizeToDeviceSpace(context,
+                                                CGSizeMake(1.f, 1.f)).width;
+  if (key.scale <= 0.f) key.scale = 1.f;
+  key.hash = text_cache_hash(&key);
+
+  pthread_mutex_lock(&cache->mutex);
+  struct text_cache_entry* entry = text_cache_lookup(cache, &key);
+
+  if (entry) {
+    cache->hits++;
+    text_cache_lru_unlink(cache, entry);
+  } else {
+    // Misses are rasterized outside of the lock such that the render
+    // threads do not serialize behind CoreText
+    cache->misses++;
+    pthread_mutex_unlock(&cache->mutex);
+    struct text_cache_entry* rasterized = text_cache_rasterize(&key, text);
+    if (!rasterized || rasterized->bytes > cache->budget) {
+      if (rasterized) text_cache_entry_destroy(rasterized);
+      return false;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    entry = text_cache_lookup(cache, &key);
+    if (entry) {
+      // Another thread inserted the same line in the meantime
+      text_cache_lru_unlink(cache, entry);
+      text_cache_entry_destroy(rasterized);
+    } else {
+      entry = rasterized;
+      text_cache_evict(cache, entry->bytes);
+      struct text_cache_entry** bucket
+                                = &cache->buckets[key.hash % TEXT_CACHE_BUCKETS];
+      entry->bucket_next = *bucket;
+      *bucket = entry;
+      cache->bytes += entry->bytes;
+      cache->count++;
+    }
+  }
+  text_cache_lru_push_front(cache, entry);
+
+  CGImageRef image = CGImageRetain(entry->image);
+  CGRect rect = CGRectOffset(entry->rect, position.x, position.y);
+  pthread_mutex_unlock(&cache->mutex);
+
+  // The bitmap is rasterized on the device pixel grid, drawing it at a
+  // fractional device position would resample (and blur) it
+  CGPoint origin = CGContextConvertPointToDeviceSpace(context, rect.origin);
+  origin.x = roundf(origin.x);
+  origin.y = roundf(origin.y);
+  rect.origin = CGContextConvertPointToUserSpace(context, origin);
+
+  CGContextDrawImage(context, rect, image);
+  CGImageRelease(image);
+  return true;
+}
+
+void text_cache_flush(struct text_cache* cache) {
+  pthread_mutex_lock(&cache->mutex);
+  while (cache->lru_head) text_cache_remove(cache, cache->lru_head);
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+void text_cache_destroy(struct text_cache* cache) {
+  text_cache_flush(cache);
+  pthread_mutex_destroy(&cache->mutex);
+}
+
+void text_cache_serialize(struct text_cache* cache, struct json* json) {
+  pthread_mutex_lock(&cache->mutex);
+  json_uint(json, "entries", cache->count);
+  json_uint(json, "bytes", cache->bytes);
+  json_uint(json, "budget", cache->budget);
+  json_uint(json, "hits", cache->hits);
+  json_uint(json, "misses", cache->misses);
+  json_uint(json, "evictions", cache->evictions);
+  pthread_mutex_unlock(&cache->mutex);
+}
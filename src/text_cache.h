@@ -0,0 +1,59 @@
+#pragma once
+#include <CoreText/CoreText.h>
+#include <pthread.h>
+#include "misc/helpers.h"
+#include "json.h"
+
+#define TEXT_CACHE_BUCKETS 512
+#define TEXT_CACHE_BUDGET  (8 * 1024 * 1024)
+
+struct text_cache_key {
+  uint64_t hash;
+  char* string;
+  CTFontRef ct_font;
+  uint32_t color;
+  uint32_t shadow_color;
+  CGPoint shadow_offset;
+  bool shadow;
+  bool smoothing;
+  float scale;
+};
+
+struct text_cache_entry {
+  struct text_cache_key key;
+
+  CGImageRef image;
+  CGRect rect;
+  uint32_t bytes;
+
+  struct text_cache_entry* bucket_next;
+  struct text_cache_entry* lru_prev;
+  struct text_cache_entry* lru_next;
+};
+
+struct text_cache {
+  pthread_mutex_t mutex;
+
+  struct text_cache_entry* buckets[TEXT_CACHE_BUCKETS];
+  struct text_cache_entry* lru_head;
+  struct text_cache_entry* lru_tail;
+
+  uint32_t count;
+  uint64_t bytes;
+  uint64_t budget;
+
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+};
+
+struct text;
+struct color;
+
+void text_cache_init(struct text_cache* cache);
+bool text_cache_draw(struct text_cache* cache, struct text* text, struct color* color, CGPoint position, CGContextRef context);
+void text_cache_flush(struct text_cache* cache);
+void text_cache_destroy(struct text_cache* cache);
+void text_cache_serialize(struct text_cache* cache, struct json* json);
+
+extern struct text_cache g_text_cache;
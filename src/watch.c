@@ -0,0 +1,239 @@
+#include "watch.h"
+#include "misc/helpers.h"
+
+static void watch_target_destroy(struct watch_target* target) {
+  if (target->name) free(target->name);
+  if (target->snapshot) free(target->snapshot);
+  if (target->pending) free(target->pending);
+}
+
+static void watch_destroy(struct watch* watch) {
+  for (int i = 0; i < watch->target_count; i++)
+    watch_target_destroy(&watch->targets[i]);
+  if (watch->targets) free(watch->targets);
+
+  for (int i = 0; i < watch->name_count; i++) free(watch->names[i]);
+  if (watch->names) free(watch->names);
+
+  json_destroy(&watch->state);
+  json_destroy(&watch->record);
+  if (watch->port) mach_port_deallocate(mach_task_self(), watch->port);
+  free(watch);
+}
+
+static bool watch_includes(struct watch* watch, char* name) {
+  if (watch->name_count == 0) return true;
+  for (int i = 0; i < watch->name_count; i++) {
+    if (string_equals(watch->names[i], name)) return true;
+  }
+  return false;
+}
+
+static struct watch_target* watch_find_target(struct watch* watch, char* name) {
+  for (int i = 0; i < watch->target_count; i++) {
+    if (string_equals(watch->targets[i].name, name))
+      return &watch->targets[i];
+  }
+  return NULL;
+}
+
+static struct watch_target* watch_get_target(struct watch* watch, char* name) {
+  struct watch_target* target = watch_find_target(watch, name);
+  if (target) return target;
+
+  watch->targets = realloc(watch->targets, sizeof(struct watch_target)
+                                           * (watch->target_count + 1));
+  target = &watch->targets[watch->target_count++];
+  memset(target, 0, sizeof(struct watch_target));
+  target->name = string_copy(name);
+  return target;
+}
+
+static void watch_set_dirty(struct watch* watch, struct watch_target* target, bool dirty) {
+  if (target->dirty == dirty) return;
+  target->dirty = dirty;
+  if (dirty) watch->dirty_count++;
+  else watch->dirty_count--;
+}
+
+// Items are staged when they were redrawn in this frame or are still dirty
+// from a change that did not reach the client yet
+static bool watch_needs_stage(struct watch* watch, struct bar_item* bar_item) {
+  if (!watch_includes(watch, bar_item->name)) return false;
+  if (bar_item->needs_update) return true;
+  if (!watch->dirty_count) return false;
+
+  struct watch_target* target = watch_find_target(watch, bar_item->name);
+  return target && target->dirty;
+}
+
+// Writes a record to the stream if the watched state of the item differs
+// from the last state delivered to the client
+static bool watch_stage_item(struct watch* watch, struct bar_item* bar_item, FILE* stream) {
+  json_reset(&watch->state);
+  bar_item_serialize(bar_item, &watch->state);
+
+  struct watch_target* target = watch_get_target(watch, bar_item->name);
+  if (target->snapshot
+      && target->snapshot_length == watch->state.length
+      && memcmp(target->snapshot, watch->state.buffer,
+                                  watch->state.length  ) == 0) {
+    watch_set_dirty(watch, target, false);
+    return false;
+  }
+
+  watch_set_dirty(watch, target, true);
+
+  if (target->pending) free(target->pending);
+  target->pending = malloc(watch->state.length);
+  target->pending_length = watch->state.length;
+  memcpy(target->pending, watch->state.buffer, watch->state.length);
+
+  json_object_begin(&watch->record, NULL);
+  json_string(&watch->record, "item", bar_item->name);
+  json_raw(&watch->record, "state", target->pending,
+                                    target->pending_length);
+  json_object_end(&watch->record);
+  json_flush(&watch->record, stream);
+  return true;
+}
+
+// Staged states become the new reference once they reached the client,
+// the targets of a dropped frame stay dirty and are staged again with the
+// next frame or tick
+static void watch_commit(struct watch* watch, bool delivered) {
+  for (int i = 0; i < watch->target_count; i++) {
+    struct watch_target* target = &watch->targets[i];
+    if (!target->pending) continue;
+
+    if (delivered) {
+      if (target->snapshot) free(target->snapshot);
+      target->snapshot = target->pending;
+      target->snapshot_length = target->pending_length;
+      watch_set_dirty(watch, target, false);
+    } else {
+      free(target->pending);
+    }
+    target->pending = NULL;
+    target->pending_length = 0;
+  }
+}
+
+static void watch_list_remove(struct watch_list* list, uint32_t index) {
+  watch_destroy(list->watches[index]);
+  memmove(&list->watches[index], &list->watches[index + 1],
+          sizeof(struct watch*) * (list->watch_count - index - 1));
+  list->watch_count--;
+}
+
+void watch_list_init(struct watch_list* list) {
+  list->watches = NULL;
+  list->watch_count = 0;
+}
+
+// Watchers receive an empty message to end their stream
+void watch_list_destroy(struct watch_list* list) {
+  for (int i = 0; i < list->watch_count; i++) {
+    mach_send_stream_message(list->watches[i]->port, "", 1);
+    watch_destroy(list->watches[i]);
+  }
+  if (list->watches) free(list->watches);
+  watch_list_init(list);
+}
+
+bool watch_list_add(struct watch_list* list, mach_port_t port, char* names, char* fields, struct bar_item** bar_items, uint32_t bar_item_count, FILE* rsp) {
+  if (!port) {
+    respond(rsp, "[!] Watch: No response port to stream changes to\n");
+    return false;
+  }
+
+  struct watch* watch = malloc(sizeof(struct watch));
+  memset(watch, 0, sizeof(struct watch));
+  json_init(&watch->state);
+  json_init(&watch->record);
+  watch->state.compact = true;
+  watch->record.compact = true;
+
+  if (fields && !json_set_fields(&watch->state, fields)) {
+    respond(rsp, "[!] Watch: Invalid field list '%s'\n", fields);
+    watch_destroy(watch);
+    return false;
+  }
+
+  struct token name = get_token(&names);
+  while (name.text && name.length > 0) {
+    watch->names = realloc(watch->names, sizeof(char*)
+                                         * (watch->name_count + 1));
+    watch->names[watch->name_count++] = token_to_string(name);
+    name = get_token(&names);
+  }
+
+  // The request message is destroyed after it has been handled, the watch
+  // holds its own reference to the response port
+  if (mach_port_mod_refs(mach_task_self(), port,
+                                           MACH_PORT_RIGHT_SEND,
+                                           1                   ) != KERN_SUCCESS) {
+    respond(rsp, "[!] Watch: Could not retain the response port\n");
+    watch_destroy(watch);
+    return false;
+  }
+  watch->port = port;
+
+  for (int i = 0; i < bar_item_count; i++) {
+    if (!watch_includes(watch, bar_items[i]->name)) continue;
+    watch_stage_item(watch, bar_items[i], rsp);
+  }
+  watch_commit(watch, true);
+
+  list->watches = realloc(list->watches, sizeof(struct watch*)
+                                         * (list->watch_count + 1));
+  list->watches[list->watch_count++] = watch;
+  return true;
+}
+
+// Marks an item as changed for all of its watchers, for setters that do not
+// redraw the item (e.g. script, update_freq or subscriptions)
+void watch_list_mark(struct watch_list* list, struct bar_item* bar_item) {
+  for (int i = 0; i < list->watch_count; i++) {
+    struct watch* watch = list->watches[i];
+    if (!watch_includes(watch, bar_item->name)) continue;
+    watch_set_dirty(watch, watch_get_target(watch, bar_item->name), true);
+  }
+}
+
+// Sends all changes of the current frame, one message per watch
+void watch_list_flush(struct watch_list* list, struct bar_item** bar_items, uint32_t bar_item_count) {
+  for (int i = 0; i < list->watch_count; i++) {
+    struct watch* watch = list->watches[i];
+    char* frame = NULL;
+    size_t length = 0;
+    FILE* stream = NULL;
+
+    for (int j = 0; j < bar_item_count; j++) {
+      struct bar_item* bar_item = bar_items[j];
+      if (!watch_needs_stage(watch, bar_item)) continue;
+
+      if (!stream) stream = open_memstream(&frame, &length);
+      watch_stage_item(watch, bar_item, stream);
+    }
+
+    if (!stream) continue;
+    fclose(stream);
+
+    if (length == 0) {
+      free(frame);
+      continue;
+    }
+
+    mach_msg_return_t result = mach_send_stream_message(watch->port,
+                                                        frame,
+                                                        length + 1  );
+    free(frame);
+    watch_commit(watch, result == MACH_MSG_SUCCESS);
+
+    if (result == MACH_SEND_INVALID_DEST) {
+      watch_list_remove(list, i);
+      i--;
+    }
+  }
+}
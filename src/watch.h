@@ -0,0 +1,45 @@
+#pragma once
+#include "bar_item.h"
+#include "mach.h"
+#include "json.h"
+
+// Last state sent to a watcher for a single item
+struct watch_target {
+  char* name;
+  char* snapshot;
+  size_t snapshot_length;
+
+  char* pending;
+  size_t pending_length;
+
+  // Changed since the last state the client received, survives frames that
+  // could not be delivered
+  bool dirty;
+};
+
+// A client subscribed to property changes. The client keeps its response
+// port open and receives one message per frame with one record per line.
+struct watch {
+  mach_port_t port;
+
+  char** names;
+  uint32_t name_count;
+
+  struct json state;
+  struct json record;
+
+  struct watch_target* targets;
+  uint32_t target_count;
+  uint32_t dirty_count;
+};
+
+struct watch_list {
+  struct watch** watches;
+  uint32_t watch_count;
+};
+
+void watch_list_init(struct watch_list* list);
+void watch_list_destroy(struct watch_list* list);
+bool watch_list_add(struct watch_list* list, mach_port_t port, char* names, char* fields, struct bar_item** bar_items, uint32_t bar_item_count, FILE* rsp);
+void watch_list_mark(struct watch_list* list, struct bar_item* bar_item);
+void watch_list_flush(struct watch_list* list, struct bar_item** bar_items, uint32_t bar_item_count);
@@ -16,6 +16,8 @@ void window_init(struct window* window) {
   window->needs_move = false;
   window->needs_resize = false;
   window->order_mode = W_ABOVE;
+  window->layer = NULL;
+  window->layer_key = 0;
 }
 
 static CFTypeRef window_create_region(struct window* window, CGRect frame) {
@@ -92,7 +94,10 @@ void window_create(struct window* window, CGRect frame) {
 }
 
 void window_clear(struct window* window) {
+  if (window->layer) CGLayerRelease(window->layer);
   window->context = NULL;
+  window->layer = NULL;
+  window->layer_key = 0;
   window->parent = NULL;
   window->id = 0;
   window->origin = CGPointZero;
@@ -22,6 +22,10 @@ struct window {
   CGRect frame;
   CGPoint origin;
   CGContextRef context;
+
+  // Cached static layer (e.g. the item background) and its content key
+  CGLayerRef layer;
+  uint64_t layer_key;
 };
 
 void window_init(struct window* window);
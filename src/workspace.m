@@ -84,7 +84,7 @@ char* workspace_copy_app_name_for_pid(pid_t pid) {
   }
 }
 
-CGImageRef workspace_icon_for_app(char* app) {
+CGImageRef workspace_icon_for_app(char* app, float scale) {
   @autoreleasepool {
     NSString* ns_app = [NSString stringWithUTF8String:app];
     NSURL* path = [[NSWorkspace sharedWorkspace] URLForApplicationWithBundleIdentifier:ns_app];
@@ -107,7 +107,6 @@ CGImageRef workspace_icon_for_app(char* app) {
     NSImage* image = [[NSWorkspace sharedWorkspace] iconForFile:path.path];
     if (!image) return NULL;
 
-    float scale = workspace_get_scale();
     NSRect rect = NSMakeRect( 0, 0, 32 * scale, 32 * scale);
     return (CGImageRef)CFRetain([image CGImageForProposedRect: &rect
                                                       context: NULL